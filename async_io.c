@@ -0,0 +1,558 @@
+#define _GNU_SOURCE     /* syscall() and pthread extras under -std=c11 */
+
+#include "async_io.h"
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SM_HAVE_IO_URING 1
+#endif
+#endif
+
+/* Worker threads used by the fallback backend. */
+#define AIO_MAX_WORKERS 4
+
+/* --------------------------------------------------------------------------
+   Internal bookkeeping kept in SM_IOQueue->mgmtData
+   -------------------------------------------------------------------------- */
+typedef struct AIO_Slot {
+    SM_IOToken token;
+    int pageNum;
+    int writing;
+    int fd;
+    SM_Internal *meta;  /* owning handle, for page checksums */
+    char *buf;
+    off_t off;
+    RC rc;              /* thread backend: result filled in by the worker */
+} AIO_Slot;
+
+typedef struct AIO_Queue {
+    int depth;
+    AIO_Slot *slots;            /* one per request that may be in flight */
+    int *freeSlots;             /* stack of unused slot indices */
+    int numFree;
+    int inFlight;               /* submitted and not yet reaped */
+    int writesInFlight;         /* how many of those are writes */
+    SM_IOToken nextToken;
+
+#ifdef SM_HAVE_IO_URING
+    /* io_uring backend */
+    int ringFd;
+    void *sqMap, *cqMap;
+    size_t sqMapLen, cqMapLen;
+    struct io_uring_sqe *sqes;
+    size_t sqesLen;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    unsigned toSubmit;          /* SQEs queued but not yet handed to the kernel */
+#endif
+
+    /* thread-pool backend */
+    pthread_t workers[AIO_MAX_WORKERS];
+    int numWorkers;
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    int *pending;               /* FIFO of slots waiting for a worker */
+    int pendHead, pendCount;
+    int *finished;              /* FIFO of slots waiting to be reaped */
+    int finHead, finCount;
+    int stopping;
+} AIO_Queue;
+
+/* --------------------------------------------------------------------------
+   Small utility helpers (file-local)
+   -------------------------------------------------------------------------- */
+
+static RC get_queue(SM_IOQueue *q, AIO_Queue **out) {
+    if (q == NULL || q->mgmtData == NULL) {
+        RC_message = "I/O queue not initialized";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+    *out = (AIO_Queue *)q->mgmtData;
+    return RC_OK;
+}
+
+/* Error a synchronous call would have returned for a failed transfer. */
+static RC failure_rc(int writing) {
+    return writing ? RC_WRITE_FAILED : RC_READ_NON_EXISTING_PAGE;
+}
+
+/* Turn a finished slot into a completion record and recycle the slot.
+   Checksums, holes and the read-ahead buffer are handled here, on the
+   reaping thread, once data is in place: a cursor read between submission
+   and completion may still buffer the old page. */
+static void retire_slot(AIO_Queue *aq, int slot, RC rc, SM_IOCompletion *ev) {
+    AIO_Slot *s = &aq->slots[slot];
+    if (rc == RC_OK && s->writing) {
+        sm_holes_clear(s->meta, s->pageNum, 1);
+        sm_invalidate_prefetch(s->meta, s->pageNum, 1);
+    }
+    if (rc == RC_OK)
+        rc = s->writing ? sm_checksum_update(s->meta, s->pageNum, &s->buf, 1)
+                        : sm_checksum_verify(s->meta, s->pageNum, s->buf);
+    sm_stats_io(s->meta, s->writing, s->pageNum, rc == RC_OK, rc);
+    ev->token = aq->slots[slot].token;
+    ev->pageNum = aq->slots[slot].pageNum;
+    ev->rc = rc;
+    aq->freeSlots[aq->numFree++] = slot;
+    aq->inFlight--;
+    if (s->writing) aq->writesInFlight--;
+}
+
+/* Move the bytes of one slot synchronously (thread backend and short-I/O tail). */
+static RC transfer_slot(AIO_Slot *s, size_t already) {
+    size_t rest = (size_t)s->meta->pageSize - already;
+    size_t moved = s->writing
+        ? sm_pwrite_full(s->fd, s->buf + already, rest, s->off + (off_t)already)
+        : sm_pread_full(s->fd, s->buf + already, rest, s->off + (off_t)already);
+    return (moved == rest) ? RC_OK : failure_rc(s->writing);
+}
+
+/* --------------------------------------------------------------------------
+   io_uring backend (raw syscalls; liburing is not required)
+   -------------------------------------------------------------------------- */
+#ifdef SM_HAVE_IO_URING
+
+/* Nonzero if the ring can run IORING_OP_READ and IORING_OP_WRITE; kernels
+   that predate IORING_REGISTER_PROBE lack those opcodes as well. */
+static int uring_probe(int fd) {
+    const unsigned nops = 256;
+    struct io_uring_probe *probe =
+        (struct io_uring_probe *)calloc(1, sizeof *probe + nops * sizeof probe->ops[0]);
+    if (probe == NULL) return 0;
+    int ok = 0;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, nops) == 0 &&
+        probe->last_op >= IORING_OP_READ && probe->last_op >= IORING_OP_WRITE)
+        ok = (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+             (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static int uring_setup(AIO_Queue *aq, int depth) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    int fd = (int)syscall(__NR_io_uring_setup, (unsigned)depth, &p);
+    if (fd < 0) return -1;
+    if (!uring_probe(fd)) goto fail_ring;
+
+    aq->sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    aq->cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (aq->cqMapLen > aq->sqMapLen) aq->sqMapLen = aq->cqMapLen;
+        aq->cqMapLen = 0;
+    }
+
+    aq->sqMap = mmap(NULL, aq->sqMapLen, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (aq->sqMap == MAP_FAILED) goto fail_ring;
+    if (aq->cqMapLen == 0) {
+        aq->cqMap = aq->sqMap;
+    } else {
+        aq->cqMap = mmap(NULL, aq->cqMapLen, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (aq->cqMap == MAP_FAILED) goto fail_sq;
+    }
+    aq->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    aq->sqes = mmap(NULL, aq->sqesLen, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (aq->sqes == MAP_FAILED) goto fail_cq;
+
+    char *sq = (char *)aq->sqMap, *cq = (char *)aq->cqMap;
+    aq->sqHead  = (unsigned *)(sq + p.sq_off.head);
+    aq->sqTail  = (unsigned *)(sq + p.sq_off.tail);
+    aq->sqMask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    aq->sqArray = (unsigned *)(sq + p.sq_off.array);
+    aq->cqHead  = (unsigned *)(cq + p.cq_off.head);
+    aq->cqTail  = (unsigned *)(cq + p.cq_off.tail);
+    aq->cqMask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    aq->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    aq->ringFd  = fd;
+    return 0;
+
+fail_cq:
+    if (aq->cqMap != aq->sqMap) munmap(aq->cqMap, aq->cqMapLen);
+fail_sq:
+    munmap(aq->sqMap, aq->sqMapLen);
+fail_ring:
+    close(fd);
+    return -1;
+}
+
+static void uring_teardown(AIO_Queue *aq) {
+    munmap(aq->sqes, aq->sqesLen);
+    if (aq->cqMap != aq->sqMap) munmap(aq->cqMap, aq->cqMapLen);
+    munmap(aq->sqMap, aq->sqMapLen);
+    close(aq->ringFd);
+}
+
+/* Queue one SQE; it reaches the kernel on the next uring_enter. */
+static void uring_queue(AIO_Queue *aq, int slot) {
+    AIO_Slot *s = &aq->slots[slot];
+    unsigned tail = *aq->sqTail;
+    unsigned idx = tail & *aq->sqMask;
+    struct io_uring_sqe *sqe = &aq->sqes[idx];
+
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode    = s->writing ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd        = s->fd;
+    sqe->addr      = (uint64_t)(uintptr_t)s->buf;
+    sqe->len       = (uint32_t)s->meta->pageSize;
+    sqe->off       = (uint64_t)s->off;
+    sqe->user_data = (uint64_t)slot;
+    aq->sqArray[idx] = idx;
+    __atomic_store_n(aq->sqTail, tail + 1, __ATOMIC_RELEASE);
+    aq->toSubmit++;
+}
+
+/* Nonzero if a write is among the SQEs not yet taken by the kernel or,
+   when none are queued, among the requests in flight. */
+static int uring_batch_writes(AIO_Queue *aq) {
+    if (aq->toSubmit == 0) return aq->writesInFlight > 0;
+    unsigned tail = *aq->sqTail;
+    for (unsigned t = tail - aq->toSubmit; t != tail; ++t)
+        if (aq->sqes[aq->sqArray[t & *aq->sqMask]].opcode == IORING_OP_WRITE) return 1;
+    return 0;
+}
+
+/* Submit queued SQEs and optionally wait for minComplete CQEs, in one call. */
+static RC uring_enter(AIO_Queue *aq, unsigned minComplete) {
+    if (aq->toSubmit == 0 && minComplete == 0) return RC_OK;
+    for (;;) {
+        unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+        long ret = syscall(__NR_io_uring_enter, aq->ringFd, aq->toSubmit,
+                           minComplete, flags, NULL, 0);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret < 0) {
+            RC_message = "io_uring_enter failed";
+            return failure_rc(uring_batch_writes(aq));
+        }
+        aq->toSubmit -= (unsigned)ret;
+        return RC_OK;
+    }
+}
+
+static int uring_reap(AIO_Queue *aq, SM_IOCompletion *events, int max) {
+    unsigned head = *aq->cqHead;
+    unsigned tail = __atomic_load_n(aq->cqTail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &aq->cqes[head & *aq->cqMask];
+        int slot = (int)cqe->user_data;
+        AIO_Slot *s = &aq->slots[slot];
+        RC rc;
+        if (cqe->res == s->meta->pageSize)
+            rc = RC_OK;
+        else if (cqe->res > 0)
+            rc = transfer_slot(s, (size_t)cqe->res);   /* finish a short transfer */
+        else
+            rc = failure_rc(s->writing);
+        retire_slot(aq, slot, rc, &events[n++]);
+        head++;
+    }
+    __atomic_store_n(aq->cqHead, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+#endif /* SM_HAVE_IO_URING */
+
+/* --------------------------------------------------------------------------
+   Thread-pool backend
+   -------------------------------------------------------------------------- */
+
+static void *aio_worker(void *arg) {
+    AIO_Queue *aq = (AIO_Queue *)arg;
+
+    pthread_mutex_lock(&aq->lock);
+    for (;;) {
+        while (!aq->stopping && aq->pendCount == 0)
+            pthread_cond_wait(&aq->workReady, &aq->lock);
+        if (aq->pendCount == 0) break;          /* stopping and drained */
+
+        int slot = aq->pending[aq->pendHead];
+        aq->pendHead = (aq->pendHead + 1) % aq->depth;
+        aq->pendCount--;
+        pthread_mutex_unlock(&aq->lock);
+
+        RC rc = transfer_slot(&aq->slots[slot], 0);
+
+        pthread_mutex_lock(&aq->lock);
+        aq->slots[slot].rc = rc;
+        aq->finished[(aq->finHead + aq->finCount) % aq->depth] = slot;
+        aq->finCount++;
+        pthread_cond_signal(&aq->workDone);
+    }
+    pthread_mutex_unlock(&aq->lock);
+    return NULL;
+}
+
+static int threads_setup(AIO_Queue *aq) {
+    aq->pending  = (int *)malloc((size_t)aq->depth * sizeof *aq->pending);
+    aq->finished = (int *)malloc((size_t)aq->depth * sizeof *aq->finished);
+    if (aq->pending == NULL || aq->finished == NULL) return -1;
+
+    pthread_mutex_init(&aq->lock, NULL);
+    pthread_cond_init(&aq->workReady, NULL);
+    pthread_cond_init(&aq->workDone, NULL);
+
+    int want = (aq->depth < AIO_MAX_WORKERS) ? aq->depth : AIO_MAX_WORKERS;
+    for (aq->numWorkers = 0; aq->numWorkers < want; aq->numWorkers++) {
+        if (pthread_create(&aq->workers[aq->numWorkers], NULL, aio_worker, aq) != 0)
+            break;
+    }
+    return (aq->numWorkers > 0) ? 0 : -1;
+}
+
+static void threads_teardown(AIO_Queue *aq) {
+    pthread_mutex_lock(&aq->lock);
+    aq->stopping = 1;
+    pthread_cond_broadcast(&aq->workReady);
+    pthread_mutex_unlock(&aq->lock);
+    for (int i = 0; i < aq->numWorkers; ++i)
+        pthread_join(aq->workers[i], NULL);
+    pthread_cond_destroy(&aq->workDone);
+    pthread_cond_destroy(&aq->workReady);
+    pthread_mutex_destroy(&aq->lock);
+}
+
+static void threads_queue(AIO_Queue *aq, int slot) {
+    pthread_mutex_lock(&aq->lock);
+    aq->pending[(aq->pendHead + aq->pendCount) % aq->depth] = slot;
+    aq->pendCount++;
+    pthread_cond_signal(&aq->workReady);
+    pthread_mutex_unlock(&aq->lock);
+}
+
+/* Reap finished slots; blocks until at least `need` are available. */
+static int threads_reap(AIO_Queue *aq, SM_IOCompletion *events, int need, int max) {
+    int n = 0;
+    pthread_mutex_lock(&aq->lock);
+    for (;;) {
+        while (aq->finCount > 0 && n < max) {
+            int slot = aq->finished[aq->finHead];
+            aq->finHead = (aq->finHead + 1) % aq->depth;
+            aq->finCount--;
+            retire_slot(aq, slot, aq->slots[slot].rc, &events[n++]);
+        }
+        if (n >= need) break;
+        pthread_cond_wait(&aq->workDone, &aq->lock);
+    }
+    pthread_mutex_unlock(&aq->lock);
+    return n;
+}
+
+/* --------------------------------------------------------------------------
+   Shared submit / reap paths
+   -------------------------------------------------------------------------- */
+
+static RC submit(SM_IOQueue *q, SM_FileHandle *fHandle, int pageNum,
+                 SM_PageHandle memPage, SM_IOToken *token, int writing) {
+    AIO_Queue *aq;
+    RC rc = get_queue(q, &aq);
+    if (rc != RC_OK) return rc;
+    SM_Internal *meta;
+    rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    if (memPage == NULL || pageNum < 0 || pageNum >= fHandle->totalNumPages) {
+        RC_message = "page number out of range";
+        return failure_rc(writing);
+    }
+    if (meta->ptt != NULL) {
+        RC_message = "compressed files do not support asynchronous I/O";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (meta->snap != NULL) {
+        RC_message = "snapshot handles do not support asynchronous I/O";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (sm_misaligned(meta, memPage)) {
+        RC_message = "direct I/O needs a PAGE_SIZE-aligned buffer (allocatePageHandle)";
+        return RC_PAGE_NOT_ALIGNED;
+    }
+    if (aq->numFree == 0) {
+        RC_message = "I/O queue is full; reap completions first";
+        return RC_IO_QUEUE_FULL;
+    }
+    /* the queue goes to the file directly: buffered writes get there first */
+    rc = sm_wb_drain(meta);
+    if (rc != RC_OK) return rc;
+    /* snapshots keep the old image; one taken while this is in flight may
+       see either */
+    if (writing) {
+        rc = sm_snap_write_begin(meta, pageNum, 1);
+        if (rc != RC_OK) return rc;
+        sm_snap_write_end(meta);
+    }
+
+    int slot = aq->freeSlots[--aq->numFree];
+    AIO_Slot *s = &aq->slots[slot];
+    s->token   = aq->nextToken++;
+    s->pageNum = pageNum;
+    s->writing = writing;
+    s->off     = sm_page_loc(meta, pageNum, &s->fd);
+    s->meta    = meta;
+    s->buf     = memPage;
+    aq->inFlight++;
+    if (writing) aq->writesInFlight++;
+
+#ifdef SM_HAVE_IO_URING
+    if (q->backend == SM_AIO_IO_URING)
+        uring_queue(aq, slot);
+    else
+#endif
+        threads_queue(aq, slot);
+
+    if (token != NULL) *token = s->token;
+    return RC_OK;
+}
+
+static RC reap(SM_IOQueue *q, SM_IOCompletion *events, int minEvents,
+               int maxEvents, int *numEvents) {
+    AIO_Queue *aq;
+    RC rc = get_queue(q, &aq);
+    if (rc != RC_OK) return rc;
+    if (events == NULL || maxEvents < 0 || numEvents == NULL) {
+        RC_message = "invalid arguments to completion reaping";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+
+    int need = minEvents;
+    if (need > aq->inFlight) need = aq->inFlight;
+    if (need > maxEvents) need = maxEvents;
+
+    int n = 0;
+#ifdef SM_HAVE_IO_URING
+    if (q->backend == SM_AIO_IO_URING) {
+        rc = uring_enter(aq, 0);
+        if (rc != RC_OK) return rc;
+        n = uring_reap(aq, events, maxEvents);
+        while (n < need) {
+            rc = uring_enter(aq, (unsigned)(need - n));
+            if (rc != RC_OK) break;
+            n += uring_reap(aq, events + n, maxEvents - n);
+        }
+        *numEvents = n;
+        return rc;
+    }
+#endif
+    n = threads_reap(aq, events, need, maxEvents);
+    *numEvents = n;
+    return RC_OK;
+}
+
+static void free_queue(AIO_Queue *aq) {
+    free(aq->finished);
+    free(aq->pending);
+    free(aq->freeSlots);
+    free(aq->slots);
+    free(aq);
+}
+
+/* --------------------------------------------------------------------------
+   Public API
+   -------------------------------------------------------------------------- */
+
+/* Create a queue allowing `depth` requests in flight on the chosen backend. */
+RC initIOQueue(SM_IOQueue *q, int depth, int backend) {
+    if (q == NULL || depth <= 0 ||
+        (backend != SM_AIO_AUTO && backend != SM_AIO_IO_URING && backend != SM_AIO_THREADS)) {
+        RC_message = "invalid arguments to initIOQueue";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+    AIO_Queue *aq = (AIO_Queue *)calloc(1, sizeof *aq);
+    if (aq == NULL) {
+        RC_message = "out of memory for I/O queue";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+    aq->depth     = depth;
+    aq->slots     = (AIO_Slot *)calloc((size_t)depth, sizeof *aq->slots);
+    aq->freeSlots = (int *)malloc((size_t)depth * sizeof *aq->freeSlots);
+    if (aq->slots == NULL || aq->freeSlots == NULL) {
+        free_queue(aq);
+        RC_message = "out of memory for I/O queue";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+    for (int i = 0; i < depth; ++i)
+        aq->freeSlots[i] = depth - 1 - i;
+    aq->numFree = depth;
+    aq->nextToken = 1;
+
+    int chosen = -1;
+#ifdef SM_HAVE_IO_URING
+    if (backend != SM_AIO_THREADS && uring_setup(aq, depth) == 0)
+        chosen = SM_AIO_IO_URING;
+#endif
+    if (chosen < 0 && backend != SM_AIO_IO_URING && threads_setup(aq) == 0)
+        chosen = SM_AIO_THREADS;
+    if (chosen < 0) {
+        free_queue(aq);
+        RC_message = (backend == SM_AIO_IO_URING) ? "io_uring is not available"
+                                                  : "starting I/O worker threads failed";
+        return RC_IO_QUEUE_NOT_INIT;
+    }
+
+    q->depth    = depth;
+    q->backend  = chosen;
+    q->mgmtData = aq;
+    return RC_OK;
+}
+
+/* Wait for every request still in flight, then release the queue. */
+RC shutdownIOQueue(SM_IOQueue *q) {
+    AIO_Queue *aq;
+    RC rc = get_queue(q, &aq);
+    if (rc != RC_OK) return rc;
+
+    SM_IOCompletion scratch[16];
+    while (aq->inFlight > 0) {
+        int n;
+        rc = reap(q, scratch, 1, 16, &n);
+        if (rc != RC_OK) break;
+    }
+
+#ifdef SM_HAVE_IO_URING
+    if (q->backend == SM_AIO_IO_URING)
+        uring_teardown(aq);
+    else
+#endif
+        threads_teardown(aq);
+
+    free_queue(aq);
+    q->mgmtData = NULL;
+    return rc;
+}
+
+RC submitRead(SM_IOQueue *q, SM_FileHandle *fHandle, int pageNum,
+              SM_PageHandle memPage, SM_IOToken *token) {
+    return submit(q, fHandle, pageNum, memPage, token, 0);
+}
+
+RC submitWrite(SM_IOQueue *q, SM_FileHandle *fHandle, int pageNum,
+               SM_PageHandle memPage, SM_IOToken *token) {
+    return submit(q, fHandle, pageNum, memPage, token, 1);
+}
+
+RC pollCompletions(SM_IOQueue *q, SM_IOCompletion *events, int maxEvents,
+                   int *numEvents) {
+    return reap(q, events, 0, maxEvents, numEvents);
+}
+
+RC waitCompletions(SM_IOQueue *q, SM_IOCompletion *events, int minEvents,
+                   int maxEvents, int *numEvents) {
+    return reap(q, events, minEvents, maxEvents, numEvents);
+}
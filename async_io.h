@@ -0,0 +1,50 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include "dberror.h"
+#include "storage_mgr.h"
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+/* backends for initIOQueue */
+#define SM_AIO_AUTO      0   /* io_uring if the kernel runs its read/write ops, else threads */
+#define SM_AIO_IO_URING  1
+#define SM_AIO_THREADS   2
+
+typedef long long SM_IOToken;
+
+typedef struct SM_IOQueue {
+	int depth;          /* maximum number of requests in flight */
+	int backend;        /* SM_AIO_IO_URING or SM_AIO_THREADS once initialized */
+	void *mgmtData;
+} SM_IOQueue;
+
+typedef struct SM_IOCompletion {
+	SM_IOToken token;   /* value handed out by submitRead/submitWrite */
+	int pageNum;
+	RC rc;              /* RC_OK or the error the synchronous call would give */
+} SM_IOCompletion;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* A queue is driven by one thread at a time. Buffers passed to submit*
+   must stay untouched until their completion has been reaped. Requests
+   are handed to the kernel in batches by pollCompletions/waitCompletions. */
+extern RC initIOQueue (SM_IOQueue *q, int depth, int backend);
+extern RC shutdownIOQueue (SM_IOQueue *q);
+
+extern RC submitRead (SM_IOQueue *q, SM_FileHandle *fHandle, int pageNum,
+		SM_PageHandle memPage, SM_IOToken *token);
+extern RC submitWrite (SM_IOQueue *q, SM_FileHandle *fHandle, int pageNum,
+		SM_PageHandle memPage, SM_IOToken *token);
+
+/* reap up to maxEvents finished requests without blocking */
+extern RC pollCompletions (SM_IOQueue *q, SM_IOCompletion *events,
+		int maxEvents, int *numEvents);
+/* block until at least minEvents requests (capped at those in flight) finish */
+extern RC waitCompletions (SM_IOQueue *q, SM_IOCompletion *events,
+		int minEvents, int maxEvents, int *numEvents);
+
+#endif
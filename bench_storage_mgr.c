@@ -0,0 +1,472 @@
+// bench_storage_mgr.c
+// Timing driver for the Storage Manager (not a correctness test)
+//
+// Every run is one row: workload x file layout x file size x thread count,
+// with throughput and p50/p99 per-operation latency, printed as CSV or JSON.
+// Layouts with larger pages hold the same bytes in proportionally fewer pages.
+//
+//   bench_storage_mgr [--format=csv|json] [--pages=N,N,...] [--threads=N,N,...]
+
+#define _GNU_SOURCE     /* clock_gettime under -std=c11 */
+
+#include "storage_mgr.h"
+#include "wal.h"
+#include "page_checksum.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_FILE "bench_pagefile.bin"
+
+/* Defaults: 4 MiB and 64 MiB files, one to four threads. */
+#define MAX_LIST 8
+static int default_pages[] = {1024, 16384};
+static int default_threads[] = {1, 2, 4};
+
+/* Sizes timed for one ensureCapacity call from an empty file. */
+static const int growth_pages[] = {1000, 100000, 1000000};
+
+/* Calls timed for the in-memory CRC32C rows. */
+#define CRC_PASSES 20000
+
+/* CRC32C passes per page in the scan callback (stand-in for per-page work). */
+#define SCAN_WORK_PASSES 8
+
+/* Durable updates: how many, and random pages changed by each. */
+#define UPDATE_COUNT 256
+#define UPDATE_PAGES 4
+
+/* --------------------------------------------------------------------------
+   Local utilities
+   -------------------------------------------------------------------------- */
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Abort the benchmark on any storage error; timings would be meaningless. */
+static void bench_check(RC rc, const char *what) {
+    if (rc != RC_OK) {
+        char *message = errorMessage(rc);
+        fprintf(stderr, "bench: %s failed: %s", what, message);
+        free(message);
+        exit(1);
+    }
+}
+
+static void *bench_alloc(size_t bytes) {
+    void *p = malloc(bytes);
+    if (p == NULL) {
+        fprintf(stderr, "bench: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* Sparse, repetitive records, like a lightly filled table page. */
+static void fill_page(SM_PageHandle page, int pageNum, int salt) {
+    memset(page, 0, PAGE_SIZE);
+    for (int r = 0; r < 16; ++r)
+        snprintf(page + r * 200, 64, "record %d/%d salt=%d status=active", pageNum, r, salt);
+}
+
+static unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Parse "N,N,..." into list; returns the count (0 on malformed input). */
+static int parse_list(const char *s, int *list) {
+    int n = 0;
+    while (*s != '\0' && n < MAX_LIST) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v <= 0) return 0;
+        list[n++] = (int)v;
+        s = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return 0;
+    }
+    return n;
+}
+
+/* --------------------------------------------------------------------------
+   Result rows
+   -------------------------------------------------------------------------- */
+
+typedef struct BenchRow {
+    const char *workload;
+    const char *layout;
+    int pages;          /* file size in pages */
+    int threads;
+    long ops;
+    double seconds;     /* wall clock for all threads */
+    double bytes;       /* payload moved (or grown) */
+    double p50, p99;    /* per-operation latency, seconds */
+} BenchRow;
+
+static int json_output;
+static int rows_printed;
+
+static void print_header(void) {
+    if (json_output)
+        printf("[\n");
+    else
+        printf("workload,layout,pages,threads,ops,seconds,mb_per_s,ops_per_s,p50_us,p99_us\n");
+}
+
+static void print_row(const BenchRow *r) {
+    double mbps = r->bytes / (1024.0 * 1024.0) / r->seconds;
+    double opss = (double)r->ops / r->seconds;
+    if (json_output) {
+        printf("%s  {\"workload\": \"%s\", \"layout\": \"%s\", \"pages\": %d, \"threads\": %d, "
+               "\"ops\": %ld, \"seconds\": %.6f, \"mb_per_s\": %.2f, \"ops_per_s\": %.1f, "
+               "\"p50_us\": %.3f, \"p99_us\": %.3f}",
+               rows_printed ? ",\n" : "", r->workload, r->layout, r->pages, r->threads,
+               r->ops, r->seconds, mbps, opss, r->p50 * 1e6, r->p99 * 1e6);
+    } else {
+        printf("%s,%s,%d,%d,%ld,%.6f,%.2f,%.1f,%.3f,%.3f\n",
+               r->workload, r->layout, r->pages, r->threads,
+               r->ops, r->seconds, mbps, opss, r->p50 * 1e6, r->p99 * 1e6);
+    }
+    rows_printed++;
+    fflush(stdout);
+}
+
+static void print_footer(void) {
+    if (json_output) printf("\n]\n");
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sort n latencies in place and fill in the row's percentiles. */
+static void set_percentiles(BenchRow *row, double *lat, long n) {
+    if (n == 0) return;
+    qsort(lat, (size_t)n, sizeof *lat, cmp_double);
+    row->p50 = lat[(n - 1) * 50 / 100];
+    row->p99 = lat[(n - 1) * 99 / 100];
+}
+
+/* --------------------------------------------------------------------------
+   File layouts
+   -------------------------------------------------------------------------- */
+
+typedef struct Layout {
+    const char *name;
+    int createFlags;
+    int openFlags;
+    int pageSize;
+} Layout;
+
+static const Layout layouts[] = {
+    {"plain",      0,                    0,              PAGE_SIZE},
+    {"direct",     0,                    SM_OPEN_DIRECT, PAGE_SIZE},
+    {"checksum",   SM_CREATE_CHECKSUM,   0,              PAGE_SIZE},
+    {"compressed", SM_CREATE_COMPRESSED, 0,              PAGE_SIZE},
+    {"plain_32k",  0,                    0,              32768},
+    {"plain_64k",  0,                    0,              65536},
+    {"writeback",  0,                    SM_OPEN_WRITEBACK, PAGE_SIZE},
+    {"latched",    0,                    SM_OPEN_LATCHED, PAGE_SIZE},
+};
+
+/* Create a file of `pages` pages (filled with records when `fill`). */
+static void prepare_file(const Layout *l, int pages, int fill, SM_FileHandle *fh) {
+    bench_check(createPageFileSized(BENCH_FILE, l->createFlags, l->pageSize), "createPageFileSized");
+    bench_check(openPageFileEx(BENCH_FILE, fh, l->openFlags), "openPageFileEx");
+    bench_check(ensureCapacity(pages, fh), "ensureCapacity");
+    if (!fill) return;
+    SM_PageHandle page = allocatePageHandleSized(l->pageSize);
+    if (page == NULL) bench_check(RC_WRITE_FAILED, "allocatePageHandle");
+    for (int p = 0; p < pages; ++p) {
+        fill_page(page, p, 0);
+        bench_check(writeBlock(p, fh, page), "writeBlock");
+    }
+    freePageHandle(page);
+}
+
+static void drop_file(SM_FileHandle *fh) {
+    bench_check(closePageFile(fh), "closePageFile");
+    bench_check(destroyPageFile(BENCH_FILE), "destroyPageFile");
+}
+
+/* A layout the filesystem cannot provide (O_DIRECT on tmpfs) is skipped. */
+static int layout_available(const Layout *l) {
+    SM_FileHandle fh;
+    bench_check(createPageFileSized(BENCH_FILE, l->createFlags, l->pageSize), "createPageFileSized");
+    RC rc = openPageFileEx(BENCH_FILE, &fh, l->openFlags);
+    if (rc != RC_OK)
+        fprintf(stderr, "bench: skipping layout %s: %s\n", l->name, lastErrorMessage());
+    else
+        closePageFile(&fh);
+    destroyPageFile(BENCH_FILE);
+    return rc == RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Page I/O workloads (shared handle, one worker per thread)
+   -------------------------------------------------------------------------- */
+
+typedef enum Workload { SEQ_READ, RAND_READ, SEQ_WRITE, RAND_WRITE } Workload;
+
+static const char *workload_names[] = {"seq_read", "rand_read", "seq_write", "rand_write"};
+
+typedef struct Worker {
+    SM_FileHandle *fh;
+    Workload kind;
+    int first, count;   /* sequential: own slice; random: number of ops */
+    int pages;          /* file size, for random page choice */
+    unsigned seed;
+    double *lat;        /* one entry per op */
+} Worker;
+
+static void *run_worker(void *arg) {
+    Worker *w = (Worker *)arg;
+    SM_PageHandle page = allocatePageHandleSized(getPageSize(w->fh));
+    if (page == NULL) bench_check(RC_WRITE_FAILED, "allocatePageHandle");
+
+    for (int i = 0; i < w->count; ++i) {
+        int p = (w->kind == SEQ_READ || w->kind == SEQ_WRITE)
+                    ? w->first + i : (int)(next_random(&w->seed) % (unsigned)w->pages);
+        int writing = (w->kind == SEQ_WRITE || w->kind == RAND_WRITE);
+        if (writing) fill_page(page, p, i + 1);
+
+        double t0 = now_sec();
+        RC rc = writing ? writeBlock(p, w->fh, page) : readBlock(p, w->fh, page);
+        w->lat[i] = now_sec() - t0;
+        bench_check(rc, writing ? "writeBlock" : "readBlock");
+    }
+    freePageHandle(page);
+    return NULL;
+}
+
+static void bench_page_io(const Layout *l, Workload kind, int pages, int threads) {
+    SM_FileHandle fh;
+    prepare_file(l, pages, 1, &fh);
+
+    Worker *w = (Worker *)bench_alloc((size_t)threads * sizeof *w);
+    pthread_t *tid = (pthread_t *)bench_alloc((size_t)threads * sizeof *tid);
+    double *lat = (double *)bench_alloc((size_t)pages * sizeof *lat);
+    int per = pages / threads;
+    for (int t = 0; t < threads; ++t) {
+        w[t].fh = &fh;
+        w[t].kind = kind;
+        w[t].first = t * per;
+        w[t].count = (t == threads - 1) ? pages - t * per : per;
+        w[t].pages = pages;
+        w[t].seed = 2463534242u + (unsigned)t * 7919u;
+        w[t].lat = lat + t * per;
+    }
+
+    double t0 = now_sec();
+    for (int t = 0; t < threads; ++t)
+        pthread_create(&tid[t], NULL, run_worker, &w[t]);
+    for (int t = 0; t < threads; ++t)
+        pthread_join(tid[t], NULL);
+    /* buffered writes count only once they have reached the file */
+    if ((l->openFlags & SM_OPEN_WRITEBACK) && (kind == SEQ_WRITE || kind == RAND_WRITE))
+        bench_check(syncPageFile(&fh), "syncPageFile");
+    double t1 = now_sec();
+
+    BenchRow row = {workload_names[kind], l->name, pages, threads, pages,
+                    t1 - t0, (double)pages * l->pageSize, 0, 0};
+    set_percentiles(&row, lat, pages);
+    print_row(&row);
+    free(lat);
+    free(tid);
+    free(w);
+    drop_file(&fh);
+}
+
+/* --------------------------------------------------------------------------
+   Parallel scans with CPU-bound per-page work (scanPageFile)
+   -------------------------------------------------------------------------- */
+
+typedef struct ScanWork {
+    int pageSize;
+    uint32_t sink;
+} ScanWork;
+
+static RC scan_work(int pageNum, SM_PageHandle page, void *ctx) {
+    ScanWork *w = (ScanWork *)ctx;
+    uint32_t crc = (uint32_t)pageNum;
+    for (int i = 0; i < SCAN_WORK_PASSES; ++i)
+        crc = crc32c(crc, page, (size_t)w->pageSize);
+    __atomic_fetch_xor(&w->sink, crc, __ATOMIC_RELAXED);
+    return RC_OK;
+}
+
+static void bench_scan(const Layout *l, int pages, int threads) {
+    SM_FileHandle fh;
+    prepare_file(l, pages, 1, &fh);
+    ScanWork work = {l->pageSize, 0};
+
+    double t0 = now_sec();
+    bench_check(scanPageFile(&fh, 0, pages, scan_work, &work, threads), "scanPageFile");
+    double t1 = now_sec();
+
+    BenchRow row = {"scan", l->name, pages, threads, pages, t1 - t0,
+                    (double)pages * l->pageSize, 0, 0};
+    print_row(&row);
+    drop_file(&fh);
+}
+
+/* --------------------------------------------------------------------------
+   File growth: page-by-page appendEmptyBlock vs. one ensureCapacity call
+   (both need the handle exclusively, so they run single-threaded)
+   -------------------------------------------------------------------------- */
+
+static void bench_growth(const Layout *l, int pages, int stepwise) {
+    SM_FileHandle fh;
+    prepare_file(l, 1, 0, &fh);
+
+    long ops = stepwise ? pages - 1 : 1;
+    double *lat = (double *)bench_alloc((size_t)(ops > 0 ? ops : 1) * sizeof *lat);
+
+    double t0 = now_sec();
+    for (long i = 0; i < ops; ++i) {
+        double s = now_sec();
+        RC rc = stepwise ? appendEmptyBlock(&fh) : ensureCapacity(pages, &fh);
+        lat[i] = now_sec() - s;
+        bench_check(rc, stepwise ? "appendEmptyBlock" : "ensureCapacity");
+    }
+    double t1 = now_sec();
+
+    BenchRow row = {stepwise ? "append" : "ensure_capacity", l->name, pages, 1, ops,
+                    t1 - t0, (double)(pages - 1) * l->pageSize, 0, 0};
+    set_percentiles(&row, lat, ops);
+    print_row(&row);
+    free(lat);
+    drop_file(&fh);
+}
+
+/* --------------------------------------------------------------------------
+   Durable multi-page updates: in-place writes plus syncPageFile per update
+   vs. one write-ahead log commit per update
+   -------------------------------------------------------------------------- */
+
+static void bench_updates(const Layout *l, int pages, int logged) {
+    SM_FileHandle fh;
+    prepare_file(l, pages, 1, &fh);
+    SM_PageHandle page = allocatePageHandleSized(l->pageSize);
+    if (page == NULL) bench_check(RC_WRITE_FAILED, "allocatePageHandle");
+    double *lat = (double *)bench_alloc(UPDATE_COUNT * sizeof *lat);
+    unsigned seed = 88172645u;
+
+    double t0 = now_sec();
+    for (int i = 0; i < UPDATE_COUNT; ++i) {
+        double s = now_sec();
+        SM_Tx *tx = NULL;
+        if (logged) bench_check(beginTx(&fh, &tx), "beginTx");
+        for (int k = 0; k < UPDATE_PAGES; ++k) {
+            int p = (int)(next_random(&seed) % (unsigned)pages);
+            fill_page(page, p, i + 1);
+            if (logged) bench_check(logPageWrite(tx, p, page), "logPageWrite");
+            else        bench_check(writeBlock(p, &fh, page), "writeBlock");
+        }
+        bench_check(logged ? commitTx(tx) : syncPageFile(&fh), logged ? "commitTx" : "syncPageFile");
+        lat[i] = now_sec() - s;
+    }
+    double t1 = now_sec();
+
+    BenchRow row = {logged ? "wal_update" : "sync_update", l->name, pages, 1, UPDATE_COUNT,
+                    t1 - t0, (double)UPDATE_COUNT * UPDATE_PAGES * l->pageSize, 0, 0};
+    set_percentiles(&row, lat, UPDATE_COUNT);
+    print_row(&row);
+    free(lat);
+    freePageHandle(page);
+    drop_file(&fh);
+}
+
+/* --------------------------------------------------------------------------
+   Page checksum cost in memory, for comparison with the checksum layout
+   -------------------------------------------------------------------------- */
+
+static void bench_crc(const char *name, uint32_t (*fn)(uint32_t, const void *, size_t)) {
+    SM_PageHandle page = allocatePageHandle();
+    if (page == NULL) bench_check(RC_WRITE_FAILED, "allocatePageHandle");
+    fill_page(page, 0, 0);
+    double *lat = (double *)bench_alloc(CRC_PASSES * sizeof *lat);
+
+    volatile uint32_t sink = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < CRC_PASSES; ++i) {
+        double s = now_sec();
+        sink ^= fn(0, page, PAGE_SIZE);
+        lat[i] = now_sec() - s;
+    }
+    double t1 = now_sec();
+    (void)sink;
+
+    BenchRow row = {"crc32c", name, 1, 1, CRC_PASSES, t1 - t0,
+                    (double)CRC_PASSES * PAGE_SIZE, 0, 0};
+    set_percentiles(&row, lat, CRC_PASSES);
+    print_row(&row);
+    free(lat);
+    freePageHandle(page);
+}
+
+int main(int argc, char **argv) {
+    int pages[MAX_LIST], threads[MAX_LIST];
+    int nPages = (int)(sizeof default_pages / sizeof default_pages[0]);
+    int nThreads = (int)(sizeof default_threads / sizeof default_threads[0]);
+    memcpy(pages, default_pages, sizeof default_pages);
+    memcpy(threads, default_threads, sizeof default_threads);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--format=json") == 0) {
+            json_output = 1;
+        } else if (strcmp(argv[i], "--format=csv") == 0) {
+            json_output = 0;
+        } else if (strncmp(argv[i], "--pages=", 8) == 0 && (nPages = parse_list(argv[i] + 8, pages)) > 0) {
+            continue;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0 && (nThreads = parse_list(argv[i] + 10, threads)) > 0) {
+            continue;
+        } else {
+            fprintf(stderr, "usage: %s [--format=csv|json] [--pages=N,N,...] [--threads=N,N,...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    initStorageManager();
+    print_header();
+
+    if (crc32cHasHardware()) bench_crc("hardware", crc32c);
+    bench_crc("portable", crc32cPortable);
+
+    for (size_t l = 0; l < sizeof layouts / sizeof layouts[0]; ++l) {
+        if (!layout_available(&layouts[l])) continue;
+        for (int s = 0; s < nPages; ++s) {
+            /* same bytes as a PAGE_SIZE layout, in fewer larger pages */
+            int n = (int)((long)pages[s] * PAGE_SIZE / layouts[l].pageSize);
+            if (n < 2) n = 2;
+            for (int k = SEQ_READ; k <= RAND_WRITE; ++k)
+                for (int t = 0; t < nThreads; ++t)
+                    bench_page_io(&layouts[l], (Workload)k, n, threads[t]);
+            for (int t = 0; t < nThreads; ++t)
+                bench_scan(&layouts[l], n, threads[t]);
+            bench_growth(&layouts[l], n, 1);
+            bench_growth(&layouts[l], n, 0);
+            bench_updates(&layouts[l], n, 0);
+            bench_updates(&layouts[l], n, 1);
+        }
+        for (size_t g = 0; g < sizeof growth_pages / sizeof growth_pages[0]; ++g) {
+            int n = (int)((long)growth_pages[g] * PAGE_SIZE / layouts[l].pageSize);
+            if (n < 2) n = 2;
+            bench_growth(&layouts[l], n, 0);
+        }
+    }
+
+    print_footer();
+    return 0;
+}
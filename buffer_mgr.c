@@ -0,0 +1,459 @@
+#define _GNU_SOURCE     /* posix_memalign under -std=c11 */
+
+#include "buffer_mgr.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+   Internal bookkeeping kept in BM_BufferPool->mgmtData
+   -------------------------------------------------------------------------- */
+typedef struct BM_Frame {
+    PageNumber pageNum;         /* NO_PAGE when the frame is empty */
+    char *data;                 /* one page of the file inside BM_Pool.memory */
+    int fixCount;
+    bool dirty;
+    bool refBit;                /* CLOCK: second-chance bit */
+    unsigned long loadedAt;     /* FIFO: logical time the page was read in */
+    unsigned long *history;     /* last K access times, most recent first */
+    int histLen;                /* number of valid entries in history */
+    int hashNext;               /* next frame in the same hash bucket, -1 ends */
+} BM_Frame;
+
+typedef struct BM_Pool {
+    SM_FileHandle fh;
+    BM_Frame *frames;
+    char *memory;               /* one allocation backing all frames */
+    unsigned long *histories;   /* numPages * k access stamps */
+    int *buckets;               /* page number -> first frame, -1 if empty */
+    int bucketMask;             /* bucket count - 1 (count is a power of two) */
+    unsigned long clock;        /* logical time, bumped on every access */
+    int hand;                   /* CLOCK hand */
+    int k;                      /* history depth (1 for all but RS_LRU_K) */
+    int numReadIO;
+    int numWriteIO;
+} BM_Pool;
+
+/* --------------------------------------------------------------------------
+   Small utility helpers (file-local)
+   -------------------------------------------------------------------------- */
+
+/* Get the pool bookkeeping from a buffer pool, validating it. */
+static RC get_pool(BM_BufferPool *const bm, BM_Pool **out) {
+    if (bm == NULL || bm->mgmtData == NULL) {
+        RC_message = "buffer pool not initialized";
+        return RC_BM_POOL_NOT_INIT;
+    }
+    *out = (BM_Pool *)bm->mgmtData;
+    return RC_OK;
+}
+
+static int hash_page(const BM_Pool *pool, PageNumber pageNum) {
+    /* Fibonacci hashing spreads sequential page numbers across buckets. */
+    return (int)(((unsigned)pageNum * 2654435769u) >> 7) & pool->bucketMask;
+}
+
+/* Return the frame index holding pageNum, or -1 if it is not cached. */
+static int lookup_frame(const BM_Pool *pool, PageNumber pageNum) {
+    int i = pool->buckets[hash_page(pool, pageNum)];
+    while (i >= 0 && pool->frames[i].pageNum != pageNum)
+        i = pool->frames[i].hashNext;
+    return i;
+}
+
+static void hash_insert(BM_Pool *pool, int frame) {
+    int b = hash_page(pool, pool->frames[frame].pageNum);
+    pool->frames[frame].hashNext = pool->buckets[b];
+    pool->buckets[b] = frame;
+}
+
+static void hash_remove(BM_Pool *pool, int frame) {
+    int *link = &pool->buckets[hash_page(pool, pool->frames[frame].pageNum)];
+    while (*link >= 0 && *link != frame)
+        link = &pool->frames[*link].hashNext;
+    if (*link == frame)
+        *link = pool->frames[frame].hashNext;
+    pool->frames[frame].hashNext = -1;
+}
+
+/* Record an access to a frame for the replacement policies. */
+static void touch_frame(BM_Pool *pool, BM_Frame *f) {
+    unsigned long now = ++pool->clock;
+    int keep = (f->histLen < pool->k) ? f->histLen : pool->k - 1;
+    memmove(f->history + 1, f->history, (size_t)keep * sizeof *f->history);
+    f->history[0] = now;
+    f->histLen = keep + 1;
+    f->refBit = true;
+}
+
+/* FIFO: evict the unpinned page that was read in first. */
+static int pick_fifo(BM_Pool *pool, int n) {
+    int victim = -1;
+    for (int i = 0; i < n; ++i) {
+        BM_Frame *f = &pool->frames[i];
+        if (f->fixCount == 0 &&
+            (victim < 0 || f->loadedAt < pool->frames[victim].loadedAt))
+            victim = i;
+    }
+    return victim;
+}
+
+/* LRU: evict the unpinned page whose last access is oldest. */
+static int pick_lru(BM_Pool *pool, int n) {
+    int victim = -1;
+    for (int i = 0; i < n; ++i) {
+        BM_Frame *f = &pool->frames[i];
+        if (f->fixCount == 0 &&
+            (victim < 0 || f->history[0] < pool->frames[victim].history[0]))
+            victim = i;
+    }
+    return victim;
+}
+
+/* CLOCK: sweep the hand, clearing reference bits, until an unreferenced
+   unpinned frame is found. Two full sweeps without a hit mean all pinned. */
+static int pick_clock(BM_Pool *pool, int n) {
+    for (int step = 0; step < 2 * n; ++step) {
+        BM_Frame *f = &pool->frames[pool->hand];
+        int here = pool->hand;
+        pool->hand = (pool->hand + 1) % n;
+        if (f->fixCount > 0) continue;
+        if (f->refBit) {
+            f->refBit = false;
+            continue;
+        }
+        return here;
+    }
+    return -1;
+}
+
+/* LRU-K: evict the page with the largest backward K-distance. Pages seen
+   fewer than K times have infinite distance and go first (LRU among them).
+   History is dropped on eviction (no retained-information period). */
+static int pick_lru_k(BM_Pool *pool, int n) {
+    int victim = -1;
+    bool victimInf = false;
+    for (int i = 0; i < n; ++i) {
+        BM_Frame *f = &pool->frames[i];
+        if (f->fixCount > 0) continue;
+        bool inf = f->histLen < pool->k;
+        if (victim < 0) {
+            victim = i;
+            victimInf = inf;
+            continue;
+        }
+        BM_Frame *v = &pool->frames[victim];
+        if (inf != victimInf) {
+            if (inf) {
+                victim = i;
+                victimInf = true;
+            }
+        } else if (inf ? f->history[0] < v->history[0]
+                       : f->history[pool->k - 1] < v->history[pool->k - 1]) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* Choose a frame for a new page: an empty one if any, else a policy victim. */
+static int pick_victim(BM_BufferPool *const bm, BM_Pool *pool) {
+    for (int i = 0; i < bm->numPages; ++i)
+        if (pool->frames[i].pageNum == NO_PAGE)
+            return i;
+
+    switch (bm->strategy) {
+    case RS_FIFO:  return pick_fifo(pool, bm->numPages);
+    case RS_LRU:   return pick_lru(pool, bm->numPages);
+    case RS_CLOCK: return pick_clock(pool, bm->numPages);
+    case RS_LRU_K: return pick_lru_k(pool, bm->numPages);
+    }
+    return -1;
+}
+
+/* Write a frame back to disk and clear its dirty flag. */
+static RC write_frame(BM_Pool *pool, BM_Frame *f) {
+    RC rc = writeBlock(f->pageNum, &pool->fh, f->data);
+    if (rc != RC_OK) return rc;
+    pool->numWriteIO++;
+    f->dirty = false;
+    return RC_OK;
+}
+
+/* Find the frame caching page->pageNum or fail with RC_BM_PAGE_NOT_IN_POOL. */
+static RC find_frame(BM_BufferPool *const bm, BM_PageHandle *const page,
+                     BM_Pool **poolOut, BM_Frame **out) {
+    BM_Pool *pool;
+    RC rc = get_pool(bm, &pool);
+    if (rc != RC_OK) return rc;
+    if (page == NULL) {
+        RC_message = "page handle is NULL";
+        return RC_BM_PAGE_NOT_IN_POOL;
+    }
+    int i = lookup_frame(pool, page->pageNum);
+    if (i < 0) {
+        RC_message = "page is not cached in the buffer pool";
+        return RC_BM_PAGE_NOT_IN_POOL;
+    }
+    *poolOut = pool;
+    *out = &pool->frames[i];
+    return RC_OK;
+}
+
+static void free_pool(BM_Pool *pool) {
+    free(pool->buckets);
+    free(pool->histories);
+    free(pool->memory);
+    free(pool->frames);
+    free(pool);
+}
+
+/* --------------------------------------------------------------------------
+   Pool handling
+   -------------------------------------------------------------------------- */
+
+/* Create a pool of numPages frames caching pages of an existing page file. */
+RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
+                  const int numPages, ReplacementStrategy strategy,
+                  void *stratData) {
+    if (bm == NULL || pageFileName == NULL || numPages <= 0) {
+        RC_message = "invalid arguments to initBufferPool";
+        return RC_BM_POOL_NOT_INIT;
+    }
+    if (strategy != RS_FIFO && strategy != RS_LRU &&
+        strategy != RS_CLOCK && strategy != RS_LRU_K) {
+        RC_message = "unsupported replacement strategy";
+        return RC_BM_INVALID_STRATEGY;
+    }
+    int k = 1;
+    if (strategy == RS_LRU_K)
+        k = (stratData != NULL) ? *(int *)stratData : BM_DEFAULT_LRU_K;
+    if (k < 1) {
+        RC_message = "LRU-K needs K >= 1";
+        return RC_BM_INVALID_STRATEGY;
+    }
+
+    BM_Pool *pool = (BM_Pool *)calloc(1, sizeof *pool);
+    if (pool == NULL) {
+        RC_message = "out of memory for buffer pool";
+        return RC_BM_POOL_NOT_INIT;
+    }
+    /* opened first: frames are as large as the file's pages */
+    RC rc = openPageFile((char *)pageFileName, &pool->fh);
+    if (rc != RC_OK) {
+        free_pool(pool);
+        return rc;
+    }
+    size_t frameSize = (size_t)getPageSize(&pool->fh);
+    int nb = 1;
+    while (nb < 2 * numPages) nb <<= 1;
+
+    pool->frames    = (BM_Frame *)calloc((size_t)numPages, sizeof *pool->frames);
+    /* frames are PAGE_SIZE-aligned so they also suit direct I/O */
+    if (posix_memalign((void **)&pool->memory, PAGE_SIZE, (size_t)numPages * frameSize) == 0)
+        memset(pool->memory, 0, (size_t)numPages * frameSize);
+    else
+        pool->memory = NULL;
+    pool->histories = (unsigned long *)calloc((size_t)numPages * (size_t)k,
+                                              sizeof *pool->histories);
+    pool->buckets   = (int *)malloc((size_t)nb * sizeof *pool->buckets);
+    if (!pool->frames || !pool->memory || !pool->histories || !pool->buckets) {
+        closePageFile(&pool->fh);
+        free_pool(pool);
+        RC_message = "out of memory for buffer frames";
+        return RC_BM_POOL_NOT_INIT;
+    }
+    memset(pool->buckets, -1, (size_t)nb * sizeof *pool->buckets);
+    pool->bucketMask = nb - 1;
+    pool->k = k;
+
+    for (int i = 0; i < numPages; ++i) {
+        pool->frames[i].pageNum  = NO_PAGE;
+        pool->frames[i].data     = pool->memory + (size_t)i * frameSize;
+        pool->frames[i].history  = pool->histories + (size_t)i * (size_t)k;
+        pool->frames[i].hashNext = -1;
+    }
+
+    bm->pageFile = (char *)pageFileName;
+    bm->numPages = numPages;
+    bm->strategy = strategy;
+    bm->mgmtData = pool;
+    return RC_OK;
+}
+
+/* Flush dirty pages and release the pool; fails if any page is pinned. */
+RC shutdownBufferPool(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    RC rc = get_pool(bm, &pool);
+    if (rc != RC_OK) return rc;
+
+    for (int i = 0; i < bm->numPages; ++i) {
+        if (pool->frames[i].fixCount > 0) {
+            RC_message = "cannot shut down a pool with pinned pages";
+            return RC_BM_POOL_HAS_PINNED_PAGES;
+        }
+    }
+    rc = forceFlushPool(bm);
+    if (rc != RC_OK) return rc;
+
+    rc = closePageFile(&pool->fh);
+    free_pool(pool);
+    bm->mgmtData = NULL;
+    return rc;
+}
+
+/* Write every dirty, unpinned page back to disk. */
+RC forceFlushPool(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    RC rc = get_pool(bm, &pool);
+    if (rc != RC_OK) return rc;
+
+    for (int i = 0; i < bm->numPages; ++i) {
+        BM_Frame *f = &pool->frames[i];
+        if (f->pageNum != NO_PAGE && f->dirty && f->fixCount == 0) {
+            rc = write_frame(pool, f);
+            if (rc != RC_OK) return rc;
+        }
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Page access
+   -------------------------------------------------------------------------- */
+
+RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_Pool *pool;
+    BM_Frame *f;
+    RC rc = find_frame(bm, page, &pool, &f);
+    if (rc != RC_OK) return rc;
+    f->dirty = true;
+    return RC_OK;
+}
+
+RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_Pool *pool;
+    BM_Frame *f;
+    RC rc = find_frame(bm, page, &pool, &f);
+    if (rc != RC_OK) return rc;
+    if (f->fixCount <= 0) {
+        RC_message = "unpinning a page that is not pinned";
+        return RC_BM_PAGE_NOT_PINNED;
+    }
+    f->fixCount--;
+    return RC_OK;
+}
+
+/* Write the page back to disk now, whether or not it is dirty. */
+RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_Pool *pool;
+    BM_Frame *f;
+    RC rc = find_frame(bm, page, &pool, &f);
+    if (rc != RC_OK) return rc;
+    return write_frame(pool, f);
+}
+
+/* Pin pageNum, reading it in (and growing the file) if it is not cached. */
+RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
+           const PageNumber pageNum) {
+    BM_Pool *pool;
+    RC rc = get_pool(bm, &pool);
+    if (rc != RC_OK) return rc;
+    if (page == NULL || pageNum < 0) {
+        RC_message = "invalid arguments to pinPage";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+
+    /* Hit: no I/O at all. */
+    int i = lookup_frame(pool, pageNum);
+    if (i >= 0) {
+        BM_Frame *f = &pool->frames[i];
+        f->fixCount++;
+        touch_frame(pool, f);
+        page->pageNum = pageNum;
+        page->data = f->data;
+        return RC_OK;
+    }
+
+    i = pick_victim(bm, pool);
+    if (i < 0) {
+        RC_message = "all frames are pinned";
+        return RC_BM_NO_FREE_FRAME;
+    }
+    BM_Frame *f = &pool->frames[i];
+    if (f->pageNum != NO_PAGE) {
+        if (f->dirty) {
+            rc = write_frame(pool, f);
+            if (rc != RC_OK) return rc;
+        }
+        hash_remove(pool, i);
+        f->pageNum = NO_PAGE;
+    }
+
+    rc = ensureCapacity(pageNum + 1, &pool->fh);
+    if (rc != RC_OK) return rc;
+    rc = readBlock(pageNum, &pool->fh, f->data);
+    if (rc != RC_OK) return rc;
+    pool->numReadIO++;
+
+    f->pageNum = pageNum;
+    f->dirty = false;
+    f->fixCount = 1;
+    f->histLen = 0;
+    touch_frame(pool, f);
+    f->loadedAt = pool->clock;
+    hash_insert(pool, i);
+
+    page->pageNum = pageNum;
+    page->data = f->data;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Statistics
+   -------------------------------------------------------------------------- */
+
+PageNumber *getFrameContents(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    if (get_pool(bm, &pool) != RC_OK) return NULL;
+    PageNumber *out = (PageNumber *)malloc((size_t)bm->numPages * sizeof *out);
+    if (out == NULL) return NULL;
+    for (int i = 0; i < bm->numPages; ++i)
+        out[i] = pool->frames[i].pageNum;
+    return out;
+}
+
+bool *getDirtyFlags(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    if (get_pool(bm, &pool) != RC_OK) return NULL;
+    bool *out = (bool *)malloc((size_t)bm->numPages * sizeof *out);
+    if (out == NULL) return NULL;
+    for (int i = 0; i < bm->numPages; ++i)
+        out[i] = pool->frames[i].dirty;
+    return out;
+}
+
+int *getFixCounts(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    if (get_pool(bm, &pool) != RC_OK) return NULL;
+    int *out = (int *)malloc((size_t)bm->numPages * sizeof *out);
+    if (out == NULL) return NULL;
+    for (int i = 0; i < bm->numPages; ++i)
+        out[i] = pool->frames[i].fixCount;
+    return out;
+}
+
+int getNumReadIO(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    if (get_pool(bm, &pool) != RC_OK) return 0;
+    return pool->numReadIO;
+}
+
+int getNumWriteIO(BM_BufferPool *const bm) {
+    BM_Pool *pool;
+    if (get_pool(bm, &pool) != RC_OK) return 0;
+    return pool->numWriteIO;
+}
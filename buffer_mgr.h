@@ -0,0 +1,68 @@
+#ifndef BUFFER_MANAGER_H
+#define BUFFER_MANAGER_H
+
+// Include return codes and methods for logging errors
+#include "dberror.h"
+
+// Include bool DT
+#include <stdbool.h>
+
+// Replacement Strategies
+typedef enum ReplacementStrategy {
+	RS_FIFO = 0,
+	RS_LRU = 1,
+	RS_CLOCK = 2,
+	RS_LRU_K = 4
+} ReplacementStrategy;
+
+// Data Types and Structures
+typedef int PageNumber;
+#define NO_PAGE -1
+
+typedef struct BM_BufferPool {
+	char *pageFile;
+	int numPages;
+	ReplacementStrategy strategy;
+	void *mgmtData; // use this one to store the bookkeeping info your buffer
+	// manager needs for a buffer pool
+} BM_BufferPool;
+
+typedef struct BM_PageHandle {
+	PageNumber pageNum;
+	char *data;
+} BM_PageHandle;
+
+// convenience macros
+#define MAKE_POOL()					\
+		((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
+
+#define MAKE_PAGE_HANDLE()				\
+		((BM_PageHandle *) malloc (sizeof(BM_PageHandle)))
+
+/* default K used by RS_LRU_K when stratData is NULL */
+#define BM_DEFAULT_LRU_K 2
+
+// Buffer Manager Interface Pool Handling
+/* a pool is not internally synchronized: use it from one thread at a time */
+/* stratData: for RS_LRU_K a pointer to an int holding K, otherwise ignored */
+RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
+		const int numPages, ReplacementStrategy strategy,
+		void *stratData);
+RC shutdownBufferPool(BM_BufferPool *const bm);
+RC forceFlushPool(BM_BufferPool *const bm);
+
+// Buffer Manager Interface Access Pages
+RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum);
+
+// Statistics Interface (returned arrays are malloc'ed; the caller frees them)
+PageNumber *getFrameContents (BM_BufferPool *const bm);
+bool *getDirtyFlags (BM_BufferPool *const bm);
+int *getFixCounts (BM_BufferPool *const bm);
+int getNumReadIO (BM_BufferPool *const bm);
+int getNumWriteIO (BM_BufferPool *const bm);
+
+#endif
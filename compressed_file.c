@@ -0,0 +1,368 @@
+#define _GNU_SOURCE     /* pread/pwrite and fdatasync under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "page_compress.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* --------------------------------------------------------------------------
+   On-disk format
+
+   Data file: behind the header page, each non-zero page lives in a slot of
+   whole SM_PTT_UNIT-byte units, compressed, or raw when compressing would
+   not save a unit.
+   <fileName>.ptt: one PTT_Entry per logical page. An all-zero entry is a
+   zero page with no slot, which is what ftruncate produces when the table
+   grows.
+
+   A rewrite fills a fresh slot and then swaps the entry. The slot it
+   replaces is only retired: the table on disk may still point at it until
+   the next sm_ptt_sync (data file first, then table) has made the swap
+   durable, and only then does it go back on the free lists. So a crash
+   never finds a page that was durable at the last sync overwritten by
+   later data; like any page write, a rewrite since the last sync may be
+   lost.
+   -------------------------------------------------------------------------- */
+
+#define SM_PTT_UNIT 256
+#define PTT_MAX_UNITS (PAGE_SIZE / SM_PTT_UNIT)
+/* Retired slots that make a write sync the file itself, so that a handle
+   that never syncs does not grow the data file without bound. */
+#define PTT_RETIRE_LIMIT 1024
+
+typedef struct PTT_Entry {
+    uint32_t unit;      /* first unit of the slot in the data file */
+    uint32_t len;       /* stored bytes: 0 = zero page, PAGE_SIZE = raw */
+} PTT_Entry;
+
+typedef struct UnitList {
+    uint32_t *units;
+    int n, cap;
+} UnitList;
+
+struct SM_PageTable {
+    int fd;                     /* <fileName>.ptt */
+    /* readers hold it shared across entry lookup and slot read; writers take
+       it exclusively to allocate a slot and to swap an entry, so a slot is
+       never reused while someone may still be reading it */
+    pthread_rwlock_t lock;
+    PTT_Entry *entries;
+    int cap;
+    int pages;
+    uint32_t end;               /* first unit past every slot handed out */
+    UnitList free[PTT_MAX_UNITS + 1];   /* free slots, indexed by size in units */
+    /* slots replaced since the last sync, reusable once it completes */
+    PTT_Entry *retired;
+    int numRetired, retiredCap;
+};
+
+/* --------------------------------------------------------------------------
+   Slot allocation (caller holds the lock exclusively)
+   -------------------------------------------------------------------------- */
+
+static off_t unit_offset(uint32_t unit) {
+    return (off_t)SM_HEADER_SIZE + (off_t)unit * SM_PTT_UNIT;
+}
+
+static int slot_units(uint32_t len) {
+    return (int)((len + SM_PTT_UNIT - 1) / SM_PTT_UNIT);
+}
+
+/* Put a slot on its free list; on allocation failure it just leaks. */
+static void release_slot(SM_PageTable *t, uint32_t unit, int units) {
+    UnitList *l = &t->free[units];
+    if (l->n == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        uint32_t *grown = (uint32_t *)realloc(l->units, (size_t)cap * sizeof *grown);
+        if (grown == NULL) return;
+        l->units = grown;
+        l->cap = cap;
+    }
+    l->units[l->n++] = unit;
+}
+
+/* Hold a replaced slot back until the table no longer names it on disk;
+   on allocation failure it just leaks. */
+static void retire_slot(SM_PageTable *t, PTT_Entry old) {
+    if (t->numRetired == t->retiredCap) {
+        int cap = t->retiredCap ? t->retiredCap * 2 : 16;
+        PTT_Entry *grown = (PTT_Entry *)realloc(t->retired, (size_t)cap * sizeof *grown);
+        if (grown == NULL) return;
+        t->retired = grown;
+        t->retiredCap = cap;
+    }
+    t->retired[t->numRetired++] = old;
+}
+
+/* Free a gap of any length as slots no larger than a page. */
+static void release_gap(SM_PageTable *t, uint32_t unit, uint32_t units) {
+    while (units > 0) {
+        int k = (units < PTT_MAX_UNITS) ? (int)units : PTT_MAX_UNITS;
+        release_slot(t, unit, k);
+        unit += (uint32_t)k;
+        units -= (uint32_t)k;
+    }
+}
+
+/* Exact fit first, then split the smallest larger slot, then append. */
+static uint32_t take_slot(SM_PageTable *t, int units) {
+    for (int k = units; k <= PTT_MAX_UNITS; ++k) {
+        UnitList *l = &t->free[k];
+        if (l->n == 0) continue;
+        uint32_t unit = l->units[--l->n];
+        if (k > units) release_slot(t, unit + (uint32_t)units, k - units);
+        return unit;
+    }
+    uint32_t unit = t->end;
+    t->end += (uint32_t)units;
+    return unit;
+}
+
+static int cmp_unit(const void *a, const void *b) {
+    uint32_t x = ((const PTT_Entry *)a)->unit, y = ((const PTT_Entry *)b)->unit;
+    return (x > y) - (x < y);
+}
+
+/* Everything in the data file not referenced by an entry is free: slots
+   released before the last close, or written by a writer that never got to
+   publish its entry. */
+static RC rebuild_free_lists(SM_PageTable *t) {
+    PTT_Entry *used = (PTT_Entry *)malloc(((size_t)t->pages + 1) * sizeof *used);
+    if (used == NULL) {
+        RC_message = "out of memory for page table";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    int n = 0;
+    for (int i = 0; i < t->pages; ++i)
+        if (t->entries[i].len != 0) used[n++] = t->entries[i];
+    qsort(used, (size_t)n, sizeof *used, cmp_unit);
+
+    uint32_t at = 0;
+    for (int i = 0; i < n; ++i) {
+        if (used[i].unit > at) release_gap(t, at, used[i].unit - at);
+        uint32_t end = used[i].unit + (uint32_t)slot_units(used[i].len);
+        if (end > at) at = end;
+    }
+    t->end = at;
+    free(used);
+    return RC_OK;
+}
+
+/* Make room for `pages` entries in memory (new ones zero). */
+static RC ensure_entries(SM_PageTable *t, int pages) {
+    if (pages <= t->cap) return RC_OK;
+    int cap = (t->cap > 0) ? t->cap : 64;
+    while (cap < pages) cap *= 2;
+    PTT_Entry *grown = (PTT_Entry *)realloc(t->entries, (size_t)cap * sizeof *grown);
+    if (grown == NULL) {
+        RC_message = "out of memory for page table";
+        return RC_WRITE_FAILED;
+    }
+    memset(grown + t->cap, 0, (size_t)(cap - t->cap) * sizeof *grown);
+    t->entries = grown;
+    t->cap = cap;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c (declared in storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_ptt_create(const char *fileName) {
+    char *name = sm_side_file_name(fileName, SM_PTT_SUFFIX);
+    int fd = (name != NULL) ? open(name, O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+    free(name);
+    if (fd < 0) {
+        RC_message = "unable to create page table";
+        return RC_WRITE_FAILED;
+    }
+    /* one zero entry: the new file's single zero-filled page */
+    int ok = ftruncate(fd, (off_t)sizeof(PTT_Entry)) == 0;
+    if (close(fd) != 0 || !ok) {
+        RC_message = "unable to create page table";
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
+
+RC sm_ptt_open(SM_Internal *meta, const char *fileName, int pages) {
+    char *name = sm_side_file_name(fileName, SM_PTT_SUFFIX);
+    if (name == NULL) {
+        RC_message = "out of memory for page table";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    int fd = open(name, O_RDWR);
+    free(name);
+    if (fd < 0) {
+        RC_message = "page table of compressed file is missing";
+        return RC_FILE_NOT_FOUND;
+    }
+
+    SM_PageTable *t = (SM_PageTable *)calloc(1, sizeof *t);
+    if (t == NULL) {
+        close(fd);
+        RC_message = "out of memory for page table";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    t->fd = fd;
+    pthread_rwlock_init(&t->lock, NULL);
+    meta->ptt = t;                  /* sm_ptt_close cleans up from here on */
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        RC_message = "fstat failed";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    /* the header's page count wins; entries past the table are zero pages */
+    int stored = (int)(st.st_size / (off_t)sizeof(PTT_Entry));
+    t->pages = pages;
+    if (ensure_entries(t, pages) != RC_OK) return RC_FILE_HANDLE_NOT_INIT;
+    size_t len = (size_t)(stored < pages ? stored : pages) * sizeof(PTT_Entry);
+    if (sm_pread_full(fd, t->entries, len, 0) != len) {
+        RC_message = "reading page table failed";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    return rebuild_free_lists(t);
+}
+
+void sm_ptt_close(SM_Internal *meta) {
+    SM_PageTable *t = meta->ptt;
+    if (t == NULL) return;
+    close(t->fd);
+    pthread_rwlock_destroy(&t->lock);
+    for (int k = 0; k <= PTT_MAX_UNITS; ++k) free(t->free[k].units);
+    free(t->retired);
+    free(t->entries);
+    free(t);
+    meta->ptt = NULL;
+}
+
+RC sm_ptt_read(SM_Internal *meta, int pageNum, char *page) {
+    SM_PageTable *t = meta->ptt;
+    unsigned char packed[PAGE_SIZE];
+
+    pthread_rwlock_rdlock(&t->lock);
+    PTT_Entry e = t->entries[pageNum];
+    size_t got = 0;
+    if (e.len != 0)
+        got = sm_pread_full(meta->fd, (e.len == PAGE_SIZE) ? (void *)page : (void *)packed,
+                            e.len, unit_offset(e.unit));
+    pthread_rwlock_unlock(&t->lock);
+
+    if (e.len == 0) {
+        memset(page, 0, PAGE_SIZE);
+        return RC_OK;
+    }
+    if (got != e.len) {
+        RC_message = "incomplete compressed page read";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    if (e.len != PAGE_SIZE && pageDecompress(packed, e.len, page, PAGE_SIZE) != PAGE_SIZE) {
+        RC_message = "compressed page does not decode (corrupted page)";
+        return RC_PAGE_CHECKSUM_MISMATCH;
+    }
+    return RC_OK;
+}
+
+/* Pages are written out of place: the new slot is filled first and only then
+   published by swapping the entry, so readers see either the old or the new
+   page, never a half-written slot. The old slot is retired, not freed (see
+   the format notes above). */
+RC sm_ptt_write(SM_Internal *meta, int pageNum, const char *page) {
+    SM_PageTable *t = meta->ptt;
+    unsigned char packed[PAGE_SIZE];
+    PTT_Entry e = { 0, 0 };
+
+    if (!sm_is_zero_page(page, PAGE_SIZE)) {
+        size_t n = pageCompress(page, PAGE_SIZE, packed, PAGE_SIZE - SM_PTT_UNIT);
+        e.len = (n > 0) ? (uint32_t)n : PAGE_SIZE;
+
+        pthread_rwlock_wrlock(&t->lock);
+        e.unit = take_slot(t, slot_units(e.len));
+        pthread_rwlock_unlock(&t->lock);
+
+        const void *src = (n > 0) ? (const void *)packed : (const void *)page;
+        if (sm_pwrite_full(meta->fd, src, e.len, unit_offset(e.unit)) != e.len) {
+            pthread_rwlock_wrlock(&t->lock);
+            release_slot(t, e.unit, slot_units(e.len));
+            pthread_rwlock_unlock(&t->lock);
+            RC_message = "incomplete compressed page write";
+            return RC_WRITE_FAILED;
+        }
+    }
+
+    pthread_rwlock_wrlock(&t->lock);
+    PTT_Entry old = t->entries[pageNum];
+    off_t at = (off_t)pageNum * (off_t)sizeof e;
+    if (sm_pwrite_full(t->fd, &e, sizeof e, at) != sizeof e) {
+        if (e.len != 0) release_slot(t, e.unit, slot_units(e.len));
+        pthread_rwlock_unlock(&t->lock);
+        RC_message = "writing page table entry failed";
+        return RC_WRITE_FAILED;
+    }
+    t->entries[pageNum] = e;
+    if (old.len != 0) retire_slot(t, old);
+    int crowded = t->numRetired >= PTT_RETIRE_LIMIT;
+    pthread_rwlock_unlock(&t->lock);
+
+    if (crowded) {
+        if (fdatasync(meta->fd) != 0) {
+            RC_message = "fdatasync failed";
+            return RC_WRITE_FAILED;
+        }
+        return sm_ptt_sync(meta);
+    }
+    return RC_OK;
+}
+
+/* New pages are zero entries: the table grows, the data file does not. */
+RC sm_ptt_grow(SM_Internal *meta, int pages) {
+    SM_PageTable *t = meta->ptt;
+    RC rc = RC_OK;
+
+    pthread_rwlock_wrlock(&t->lock);
+    if (pages > t->pages) {
+        rc = ensure_entries(t, pages);
+        if (rc == RC_OK && ftruncate(t->fd, (off_t)pages * (off_t)sizeof(PTT_Entry)) != 0) {
+            RC_message = "extending page table failed";
+            rc = RC_WRITE_FAILED;
+        }
+        if (rc == RC_OK) t->pages = pages;
+    }
+    pthread_rwlock_unlock(&t->lock);
+    return rc;
+}
+
+/* The caller has synced the data file. Slots retired before the table is
+   synced are no longer named by it once the sync completes; those retired
+   meanwhile wait for the next one. After a failed sync they stay out of
+   use until the file is reopened and its free space rebuilt. */
+RC sm_ptt_sync(SM_Internal *meta) {
+    SM_PageTable *t = meta->ptt;
+    pthread_rwlock_wrlock(&t->lock);
+    PTT_Entry *retired = t->retired;
+    int n = t->numRetired;
+    t->retired = NULL;
+    t->numRetired = t->retiredCap = 0;
+    pthread_rwlock_unlock(&t->lock);
+
+    RC rc = RC_OK;
+    if (fdatasync(t->fd) != 0) {
+        RC_message = "fdatasync of page table failed";
+        rc = RC_WRITE_FAILED;
+    } else if (n > 0) {
+        pthread_rwlock_wrlock(&t->lock);
+        for (int i = 0; i < n; ++i)
+            release_slot(t, retired[i].unit, slot_units(retired[i].len));
+        pthread_rwlock_unlock(&t->lock);
+    }
+    free(retired);
+    return rc;
+}
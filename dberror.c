@@ -4,7 +4,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-char *RC_message;
+_Thread_local char *RC_message;
 
 /* print a message to standard out describing the error */
 void 
@@ -34,3 +34,23 @@ errorMessage (RC error)
 
 	return message;
 }
+
+char *
+formatErrorMessage (RC error, char *buf, size_t bufLen)
+{
+	if (buf == NULL || bufLen == 0)
+		return buf;
+
+	if (RC_message != NULL)
+		snprintf(buf, bufLen, "EC (%i), \"%s\"\n", error, RC_message);
+	else
+		snprintf(buf, bufLen, "EC (%i)\n", error);
+
+	return buf;
+}
+
+const char *
+lastErrorMessage (void)
+{
+	return RC_message;
+}
@@ -14,6 +14,21 @@ typedef int RC;
 #define RC_FILE_HANDLE_NOT_INIT 2
 #define RC_WRITE_FAILED 3
 #define RC_READ_NON_EXISTING_PAGE 4
+#define RC_FILE_MAP_FAILED 5
+#define RC_IO_QUEUE_FULL 6
+#define RC_IO_QUEUE_NOT_INIT 7
+#define RC_PAGE_NOT_ALIGNED 8
+#define RC_PAGE_CHECKSUM_MISMATCH 9
+#define RC_FILE_HEADER_INVALID 10
+#define RC_PAGE_ALREADY_FREE 11
+#define RC_PAGE_NOT_LATCHED 12
+
+#define RC_BM_POOL_NOT_INIT 100
+#define RC_BM_NO_FREE_FRAME 101
+#define RC_BM_PAGE_NOT_IN_POOL 102
+#define RC_BM_PAGE_NOT_PINNED 103
+#define RC_BM_POOL_HAS_PINNED_PAGES 104
+#define RC_BM_INVALID_STRATEGY 105
 
 #define RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE 200
 #define RC_RM_EXPR_RESULT_IS_NOT_BOOLEAN 201
@@ -27,12 +42,18 @@ typedef int RC;
 #define RC_IM_N_TO_LAGE 302
 #define RC_IM_NO_MORE_ENTRIES 303
 
-/* holder for error messages */
-extern char *RC_message;
+/* holder for error messages; each thread has its own, so concurrent
+   failures never overwrite one another's context */
+extern _Thread_local char *RC_message;
 
 /* print a message to standard out describing the error */
 extern void printError (RC error);
+/* caller frees the result */
 extern char *errorMessage (RC error);
+/* non-allocating variant: formats into buf (truncating) and returns buf */
+extern char *formatErrorMessage (RC error, char *buf, size_t bufLen);
+/* this thread's most recent error context, or NULL */
+extern const char *lastErrorMessage (void);
 
 #define THROW(rc,message) \
 		do {			  \
@@ -0,0 +1,179 @@
+#define _GNU_SOURCE     /* stat/fstat under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* --------------------------------------------------------------------------
+   Open-file registry
+
+   Every page file open in the process has one SM_SharedFile, found by the
+   device and inode of the file, so handles opened under different paths
+   (links, relative and absolute names) still meet. A handle takes a
+   reference at open and drops it at close; snapshots hold one too. The
+   last reference closes the descriptors and frees the entry.
+
+   An open first looks the path up with stat(); when the file is already
+   open the shared descriptor is reused and open() is skipped. Otherwise
+   the file is opened and keyed by fstat() of the new descriptor, so a
+   file replaced between the two calls is never mistaken for the old one.
+   Buffered and SM_OPEN_DIRECT handles need different descriptors; each is
+   opened the first time a handle needs it.
+   -------------------------------------------------------------------------- */
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static SM_SharedFile *registry;         /* under registry_lock */
+
+static SM_SharedFile *find(dev_t dev, ino_t ino) {
+    for (SM_SharedFile *sf = registry; sf != NULL; sf = sf->next)
+        if (sf->dev == dev && sf->ino == ino) return sf;
+    return NULL;
+}
+
+static int *fd_slot(SM_SharedFile *sf, int openFlags) {
+    return (openFlags & SM_OPEN_DIRECT) ? &sf->directFd : &sf->fd;
+}
+
+/* A reference to an entry that already has the descriptor openFlags
+   needs, or NULL. Called with registry_lock held. */
+static SM_SharedFile *take_open(dev_t dev, ino_t ino, int openFlags) {
+    SM_SharedFile *sf = find(dev, ino);
+    if (sf == NULL || *fd_slot(sf, openFlags) < 0) return NULL;
+    sf->refs++;
+    return sf;
+}
+
+/* Entry for a file just opened on fd, which it takes over; its header is
+   read and validated first. Called with registry_lock held. */
+static RC add_entry(int fd, const struct stat *st, int openFlags, SM_SharedFile **out) {
+    SM_SharedFile *sf = (SM_SharedFile *)calloc(1, sizeof *sf);
+    if (sf == NULL) {
+        RC_message = "out of memory for open-file registry";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    RC rc = sm_read_header(fd, &sf->header);
+    if (rc != RC_OK) {
+        free(sf);
+        return rc;
+    }
+    sf->dev = st->st_dev;
+    sf->ino = st->st_ino;
+    sf->refs = 1;
+    sf->fd = sf->directFd = sf->crcFd = -1;
+    *fd_slot(sf, openFlags) = fd;
+    sf->pageCount = (int)sf->header.pageCount;
+    pthread_mutex_init(&sf->headerLock, NULL);
+    pthread_mutex_init(&sf->openLock, NULL);
+    pthread_rwlock_init(&sf->crcLock, NULL);
+    pthread_rwlock_init(&sf->snapLock, NULL);
+    sf->next = registry;
+    registry = sf;
+    *out = sf;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c (storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_file_acquire(const char *fileName, int openFlags, SM_SharedFile **out) {
+    struct stat st;
+    if (stat(fileName, &st) == 0) {
+        pthread_mutex_lock(&registry_lock);
+        SM_SharedFile *sf = take_open(st.st_dev, st.st_ino, openFlags);
+        pthread_mutex_unlock(&registry_lock);
+        if (sf != NULL) {
+            *out = sf;
+            return RC_OK;
+        }
+    }
+
+    int fd = sm_open_data_fd(fileName, openFlags);  /* must be readable & writable */
+    if (fd < 0) {
+        if (errno == EINVAL && (openFlags & SM_OPEN_DIRECT)) {
+            RC_message = "filesystem does not support direct I/O";
+            return RC_FILE_HANDLE_NOT_INIT;
+        }
+        RC_message = "file not found";
+        return RC_FILE_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        RC_message = "fstat failed";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+
+    /* another thread may have opened the file meanwhile */
+    pthread_mutex_lock(&registry_lock);
+    RC rc = RC_OK;
+    SM_SharedFile *sf = find(st.st_dev, st.st_ino);
+    if (sf == NULL) {
+        rc = add_entry(fd, &st, openFlags, &sf);
+        if (rc == RC_OK) fd = -1;
+    } else if (*fd_slot(sf, openFlags) < 0) {
+        *fd_slot(sf, openFlags) = fd;
+        sf->refs++;
+        fd = -1;
+    } else {
+        sf->refs++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    if (fd >= 0) close(fd);
+    if (rc != RC_OK) return rc;
+    *out = sf;
+    return RC_OK;
+}
+
+void sm_file_retain(SM_SharedFile *sf) {
+    pthread_mutex_lock(&registry_lock);
+    sf->refs++;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+int sm_file_release(SM_SharedFile *sf) {
+    if (sf == NULL) return 0;
+    pthread_mutex_lock(&registry_lock);
+    int last = (--sf->refs == 0);
+    if (last) {
+        SM_SharedFile **link = &registry;
+        while (*link != sf) link = &(*link)->next;
+        *link = sf->next;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    if (!last) return 0;
+
+    sm_wal_close(sf);
+    sm_fsm_close(sf);
+    sm_checksum_close(sf);
+    sm_latch_free(sf);
+    int rc = 0;
+    if (sf->fd >= 0 && close(sf->fd) != 0) rc = -1;
+    if (sf->directFd >= 0 && close(sf->directFd) != 0) rc = -1;
+    pthread_mutex_destroy(&sf->headerLock);
+    pthread_mutex_destroy(&sf->openLock);
+    pthread_rwlock_destroy(&sf->crcLock);
+    pthread_rwlock_destroy(&sf->snapLock);
+    free(sf);
+    return rc;
+}
+
+int sm_file_refs(SM_SharedFile *sf) {
+    pthread_mutex_lock(&registry_lock);
+    int refs = sf->refs;
+    pthread_mutex_unlock(&registry_lock);
+    return refs;
+}
+
+int sm_file_is_open(const char *fileName) {
+    struct stat st;
+    if (stat(fileName, &st) != 0) return 0;
+    pthread_mutex_lock(&registry_lock);
+    int open = find(st.st_dev, st.st_ino) != NULL;
+    pthread_mutex_unlock(&registry_lock);
+    return open;
+}
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE     /* pread/pwrite and fdatasync under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* --------------------------------------------------------------------------
+   Free-space map
+
+   <fileName>.fsm is an array of 64-bit words; bit n (bit n % 64 of word
+   n / 64) is set while data page n is free. Pages past the end of the map
+   are in use, so the map only needs to exist once something is freed. The
+   whole map is kept in memory and each change writes back its one word.
+
+   The map belongs to the file, not to a handle: it hangs off the shared
+   registry entry, so a page freed through one handle can be allocated
+   through any other. Everything but sm_fsm_close and sm_fsm_sync runs
+   under the entry's headerLock, which also orders the free-page hint.
+   -------------------------------------------------------------------------- */
+
+#define FSM_WORD_BITS 64
+
+struct SM_FreeMap {
+    int fd;             /* <fileName>.fsm */
+    uint64_t *words;
+    int cap;            /* words allocated */
+    int used;           /* words covered by the map file */
+    int freePages;      /* bits set */
+};
+
+static RC ensure_words(SM_FreeMap *m, int words) {
+    if (words <= m->cap) return RC_OK;
+    int cap = (m->cap > 0) ? m->cap : 16;
+    while (cap < words) cap *= 2;
+    uint64_t *grown = (uint64_t *)realloc(m->words, (size_t)cap * sizeof *grown);
+    if (grown == NULL) {
+        RC_message = "out of memory for free-space map";
+        return RC_WRITE_FAILED;
+    }
+    memset(grown + m->cap, 0, (size_t)(cap - m->cap) * sizeof *grown);
+    m->words = grown;
+    m->cap = cap;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c (declared in storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+/* The map's state, freed again on a failed open. */
+static void free_map(SM_FreeMap *m) {
+    close(m->fd);
+    free(m->words);
+    free(m);
+}
+
+RC sm_fsm_open(SM_SharedFile *sf, const char *fileName, int create) {
+    if (sf->fsm != NULL) return RC_OK;     /* another handle got there first */
+    char *name = sm_side_file_name(fileName, SM_FSM_SUFFIX);
+    if (name == NULL) {
+        RC_message = "out of memory for free-space map";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    int fd = open(name, create ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    free(name);
+    if (fd < 0) {
+        RC_message = create ? "unable to create free-space map" : "free-space map is missing";
+        return create ? RC_WRITE_FAILED : RC_FILE_NOT_FOUND;
+    }
+
+    SM_FreeMap *m = (SM_FreeMap *)calloc(1, sizeof *m);
+    if (m == NULL) {
+        close(fd);
+        RC_message = "out of memory for free-space map";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    m->fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        free_map(m);
+        RC_message = "fstat failed";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    m->used = (int)(st.st_size / (off_t)sizeof(uint64_t));
+    size_t len = (size_t)m->used * sizeof(uint64_t);
+    if (ensure_words(m, m->used) != RC_OK) {
+        free_map(m);
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (sm_pread_full(fd, m->words, len, 0) != len) {
+        free_map(m);
+        RC_message = "reading free-space map failed";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    for (int i = 0; i < m->used; ++i)
+        m->freePages += __builtin_popcountll(m->words[i]);
+    sf->fsm = m;
+    return RC_OK;
+}
+
+void sm_fsm_close(SM_SharedFile *sf) {
+    if (sf->fsm == NULL) return;
+    free_map(sf->fsm);
+    sf->fsm = NULL;
+}
+
+int sm_fsm_is_free(const SM_SharedFile *sf, int pageNum) {
+    const SM_FreeMap *m = sf->fsm;
+    int w = pageNum / FSM_WORD_BITS;
+    if (m == NULL || w >= m->used) return 0;
+    return (int)((m->words[w] >> (pageNum % FSM_WORD_BITS)) & 1);
+}
+
+/* First free page >= from, or -1. Scans a word (64 pages) at a time and
+   skips four empty words per test, so a mostly-full map costs about one
+   load per 256 pages. */
+int sm_fsm_find(const SM_SharedFile *sf, int from) {
+    const SM_FreeMap *m = sf->fsm;
+    if (m == NULL || m->freePages == 0 || from < 0) return -1;
+
+    int w = from / FSM_WORD_BITS;
+    if (w >= m->used) return -1;
+    uint64_t bits = m->words[w] & (~0ull << (from % FSM_WORD_BITS));
+    while (bits == 0) {
+        if (++w >= m->used) return -1;
+        while (w + 4 <= m->used &&
+               (m->words[w] | m->words[w + 1] | m->words[w + 2] | m->words[w + 3]) == 0)
+            w += 4;
+        if (w >= m->used) return -1;
+        bits = m->words[w];
+    }
+    return w * FSM_WORD_BITS + __builtin_ctzll(bits);
+}
+
+/* Mark pageNum free or in use and write its word back. */
+RC sm_fsm_set(SM_SharedFile *sf, int pageNum, int isFree) {
+    SM_FreeMap *m = sf->fsm;
+    int w = pageNum / FSM_WORD_BITS;
+    uint64_t bit = 1ull << (pageNum % FSM_WORD_BITS);
+
+    if (w >= m->used) {
+        if (!isFree) return RC_OK;          /* beyond the map: already in use */
+        RC rc = ensure_words(m, w + 1);
+        if (rc != RC_OK) return rc;
+    }
+    uint64_t word = isFree ? (m->words[w] | bit) : (m->words[w] & ~bit);
+    if (word == m->words[w]) return RC_OK;
+
+    if (sm_pwrite_full(m->fd, &word, sizeof word, (off_t)w * (off_t)sizeof word) != sizeof word) {
+        RC_message = "writing free-space map failed";
+        return RC_WRITE_FAILED;
+    }
+    m->words[w] = word;
+    if (w >= m->used) m->used = w + 1;      /* the pwrite zero-filled any gap */
+    m->freePages += isFree ? 1 : -1;
+    return RC_OK;
+}
+
+/* The descriptor is read under the lock; the map lives until the last
+   reference goes, which the caller's handle holds. */
+RC sm_fsm_sync(SM_SharedFile *sf) {
+    pthread_mutex_lock(&sf->headerLock);
+    int fd = (sf->fsm != NULL) ? sf->fsm->fd : -1;
+    pthread_mutex_unlock(&sf->headerLock);
+    if (fd >= 0 && fdatasync(fd) != 0) {
+        RC_message = "fdatasync of free-space map failed";
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
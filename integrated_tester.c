@@ -1,7 +1,13 @@
 // all_tests.c
 // Extended runner for Storage Manager — unique structure & helpers
 
+#define _GNU_SOURCE     /* fork/truncate under -std=c11 */
+
 #include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "async_io.h"
+#include "wal.h"
+#include "page_checksum.h"
 #include "dberror.h"
 #include "test_helper.h"
 
@@ -10,6 +16,11 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <dirent.h>
 
 /* --------------------------------------------------------------------------
    Bring in the original assignment tests, but treat their main as a function.
@@ -134,6 +145,2046 @@ static void test_append_growth_and_random_access(void) {
     TEST_DONE();
 }
 
+/* Pin pages 0,1,2 (page 0 twice) into a 3-frame pool, then pin page 3 and
+   return the page number that was evicted to make room for it. */
+static PageNumber evicted_by_policy(const char *fname, ReplacementStrategy rs, void *strat) {
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    const PageNumber order[] = {0, 1, 2, 0};
+
+    TEST_CHECK(initBufferPool(&bm, fname, 3, rs, strat));
+    for (int i = 0; i < 4; ++i) {
+        TEST_CHECK(pinPage(&bm, &h, order[i]));
+        TEST_CHECK(unpinPage(&bm, &h));
+    }
+    ASSERT_TRUE(getNumReadIO(&bm) == 3, "C: re-pinning a cached page does no I/O");
+
+    PageNumber *before = getFrameContents(&bm);
+    TEST_CHECK(pinPage(&bm, &h, 3));
+    TEST_CHECK(unpinPage(&bm, &h));
+    PageNumber *after = getFrameContents(&bm);
+
+    PageNumber victim = NO_PAGE;
+    for (int i = 0; i < bm.numPages; ++i)
+        if (after[i] == 3) victim = before[i];
+
+    free(before);
+    free(after);
+    TEST_CHECK(shutdownBufferPool(&bm));
+    return victim;
+}
+
+/* Test C: buffer pool replacement policies and dirty write-back */
+static void test_buffer_pool_policies(void) {
+    const char *fname = "sm_ext_C.bin";
+    int k = 2;
+
+    testName = "C: buffer pool replacement policies + write-back";
+    SM_PageHandle page = alloc_page_or_die("C: buffer alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+
+    ASSERT_TRUE(evicted_by_policy(fname, RS_FIFO, NULL) == 0, "C: FIFO evicts the first page read in");
+    ASSERT_TRUE(evicted_by_policy(fname, RS_LRU, NULL) == 1, "C: LRU evicts the least recently used page");
+    ASSERT_TRUE(evicted_by_policy(fname, RS_CLOCK, NULL) == 0, "C: CLOCK evicts after one full sweep");
+    ASSERT_TRUE(evicted_by_policy(fname, RS_LRU_K, &k) == 1, "C: LRU-2 evicts a once-referenced page");
+
+    /* Dirty pages reach disk on eviction and on shutdown */
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    TEST_CHECK(initBufferPool(&bm, fname, 1, RS_LRU, NULL));
+    TEST_CHECK(pinPage(&bm, &h, 1));
+    stamp_pattern(h.data, (unsigned char)'b', 7);
+    TEST_CHECK(markDirty(&bm, &h));
+    ASSERT_TRUE(pinPage(&bm, &h, 2) == RC_BM_NO_FREE_FRAME, "C: pinned frame is never evicted");
+    TEST_CHECK(unpinPage(&bm, &h));
+    TEST_CHECK(pinPage(&bm, &h, 2));
+    stamp_pattern(h.data, (unsigned char)'c', 9);
+    TEST_CHECK(markDirty(&bm, &h));
+    TEST_CHECK(unpinPage(&bm, &h));
+    ASSERT_TRUE(getNumWriteIO(&bm) == 1, "C: eviction wrote the dirty page");
+    TEST_CHECK(shutdownBufferPool(&bm));
+
+    SM_FileHandle fh;
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(readBlock(1, &fh, page));
+    assert_pattern(page, (unsigned char)'b', 7, "C: evicted page persisted");
+    TEST_CHECK(readBlock(2, &fh, page));
+    assert_pattern(page, (unsigned char)'c', 9, "C: shutdown flushed dirty page");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(page);
+
+    TEST_DONE();
+}
+
+/* Worker for test D: re-read every page of a shared handle and count mismatches */
+typedef struct ReaderArgs {
+    SM_FileHandle *fh;
+    int pages;
+    int rounds;
+    int mismatches;
+} ReaderArgs;
+
+static void *concurrent_reader(void *arg) {
+    ReaderArgs *a = (ReaderArgs *)arg;
+    char buf[PAGE_SIZE];
+    for (int r = 0; r < a->rounds; ++r) {
+        for (int p = 0; p < a->pages; ++p) {
+            if (readBlock(p, a->fh, buf) != RC_OK || buf[0] != (char)('a' + p) ||
+                buf[PAGE_SIZE - 1] != (char)('a' + p))
+                a->mismatches++;
+        }
+    }
+    return NULL;
+}
+
+/* Test D: several threads read through one handle with positional I/O */
+static void test_concurrent_positional_reads(void) {
+    const char *fname = "sm_ext_D.bin";
+    const int   pages = 8;
+    enum { THREADS = 4 };
+    SM_FileHandle fh;
+    pthread_t tid[THREADS];
+    ReaderArgs args[THREADS];
+
+    testName = "D: concurrent readers on one handle";
+    SM_PageHandle page = alloc_page_or_die("D: buffer alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(pages, &fh));
+    for (int p = 0; p < pages; ++p) {
+        memset(page, 'a' + p, PAGE_SIZE);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+
+    for (int t = 0; t < THREADS; ++t) {
+        args[t] = (ReaderArgs){ &fh, pages, 200, 0 };
+        ASSERT_TRUE(pthread_create(&tid[t], NULL, concurrent_reader, &args[t]) == 0, "D: reader started");
+    }
+    int mismatches = 0;
+    for (int t = 0; t < THREADS; ++t) {
+        pthread_join(tid[t], NULL);
+        mismatches += args[t].mismatches;
+    }
+    ASSERT_TRUE(mismatches == 0, "D: every concurrent read returned its own page");
+
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(page);
+
+    TEST_DONE();
+}
+
+/* Test E: mapped handle, zero-copy writes through getPagePtr, remap on growth */
+static void test_mapped_page_access(void) {
+    const char *fname = "sm_ext_E.bin";
+    const int   grow_to = 40;   /* past the initial mapping, forces a remap */
+    SM_FileHandle fh;
+    SM_PageHandle ptr = NULL;
+
+    testName = "E: mmap mode + getPagePtr";
+    SM_PageHandle page = alloc_page_or_die("E: buffer alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_MMAP));
+    ASSERT_TRUE(getPagePtr(1, &fh, &ptr) != RC_OK, "E: pointer past EOF refused");
+
+    TEST_CHECK(ensureCapacity(grow_to, &fh));
+    TEST_CHECK(getPagePtr(grow_to - 1, &fh, &ptr));
+    stamp_pattern(ptr, (unsigned char)'m', 17);
+
+    /* readBlock on the same handle sees the store without any write call */
+    TEST_CHECK(readBlock(grow_to - 1, &fh, page));
+    assert_pattern(page, (unsigned char)'m', 17, "E: store through mapping visible to readBlock");
+
+    stamp_pattern(page, (unsigned char)'w', 3);
+    TEST_CHECK(writeBlock(2, &fh, page));
+    TEST_CHECK(syncPageFile(&fh));
+    TEST_CHECK(closePageFile(&fh));
+
+    /* A plain handle reads back what went through the mapping */
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(fh.totalNumPages == grow_to, "E: file grew to requested size");
+    ASSERT_TRUE(getPagePtr(0, &fh, &ptr) != RC_OK, "E: getPagePtr needs a mapped handle");
+    TEST_CHECK(readBlock(grow_to - 1, &fh, page));
+    assert_pattern(page, (unsigned char)'m', 17, "E: mapped store persisted");
+    TEST_CHECK(readBlock(2, &fh, page));
+    assert_pattern(page, (unsigned char)'w', 3, "E: mapped writeBlock persisted");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(page);
+
+    TEST_DONE();
+}
+
+/* Test F: vectored multi-page writes and reads, including a clipped range */
+static void test_vectored_page_ranges(void) {
+    const char *fname = "sm_ext_F.bin";
+    enum { PAGES = 300 };   /* more than one iovec batch */
+    SM_FileHandle fh;
+    SM_PageHandle pages[PAGES];
+    int moved = -1;
+
+    testName = "F: readBlocks/writeBlocks over a page range";
+    char *extent = (char *)calloc(PAGES, PAGE_SIZE);
+    ASSERT_TRUE(extent != NULL, "F: extent alloc");
+    for (int i = 0; i < PAGES; ++i) {
+        pages[i] = extent + (size_t)i * PAGE_SIZE;
+        stamp_pattern(pages[i], (unsigned char)i, 31);
+    }
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(PAGES + 1, &fh));
+
+    TEST_CHECK(writeBlocks(1, PAGES, &fh, pages, &moved));
+    ASSERT_TRUE(moved == PAGES, "F: all pages written");
+
+    memset(extent, 0, (size_t)PAGES * PAGE_SIZE);
+    TEST_CHECK(readBlocks(1, PAGES, &fh, pages, &moved));
+    ASSERT_TRUE(moved == PAGES, "F: all pages read");
+    ASSERT_TRUE(getBlockPos(&fh) == PAGES, "F: cursor on last page read");
+    assert_pattern(pages[0], 0, 31, "F: first page of extent ok");
+    assert_pattern(pages[PAGES - 1], (unsigned char)(PAGES - 1), 31, "F: last page of extent ok");
+
+    ASSERT_TRUE(readBlocks(PAGES - 4, 10, &fh, pages, &moved) == RC_READ_NON_EXISTING_PAGE,
+                "F: range past EOF reported");
+    ASSERT_TRUE(moved == 5, "F: clipped range still transferred the pages that exist");
+    ASSERT_TRUE(writeBlocks(fh.totalNumPages, 1, &fh, pages, &moved) == RC_WRITE_FAILED && moved == 0,
+                "F: write past EOF transfers nothing");
+
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(extent);
+
+    TEST_DONE();
+}
+
+/* Push `pages` page I/Os through a queue of depth 8, reaping whenever it
+   fills up; returns how many completions reported an error. */
+static int run_async_pass(SM_IOQueue *q, SM_FileHandle *fh, char *extent, int pages, int writing) {
+    SM_IOCompletion ev[8];
+    int errors = 0, reaped = 0, n;
+
+    for (int p = 0; p < pages; ++p) {
+        SM_PageHandle buf = extent + (size_t)p * PAGE_SIZE;
+        RC rc = writing ? submitWrite(q, fh, p, buf, NULL) : submitRead(q, fh, p, buf, NULL);
+        if (rc == RC_IO_QUEUE_FULL) {
+            TEST_CHECK(waitCompletions(q, ev, 1, 8, &n));
+            for (int i = 0; i < n; ++i) errors += (ev[i].rc != RC_OK);
+            reaped += n;
+            --p;
+            continue;
+        }
+        TEST_CHECK(rc);
+    }
+    while (reaped < pages) {
+        TEST_CHECK(waitCompletions(q, ev, 1, 8, &n));
+        for (int i = 0; i < n; ++i) errors += (ev[i].rc != RC_OK);
+        reaped += n;
+    }
+    return errors;
+}
+
+/* Test G: asynchronous submit/complete on io_uring (if available) and threads */
+static void test_async_queue(void) {
+    const char *fname = "sm_ext_G.bin";
+    enum { PAGES = 32 };
+    const int backends[] = { SM_AIO_AUTO, SM_AIO_THREADS };
+    SM_FileHandle fh;
+
+    testName = "G: async I/O queue";
+    char *extent = (char *)calloc(PAGES, PAGE_SIZE);
+    ASSERT_TRUE(extent != NULL, "G: extent alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(PAGES, &fh));
+
+    for (int b = 0; b < 2; ++b) {
+        SM_IOQueue q;
+        SM_IOCompletion ev[1];
+        int n = -1;
+        unsigned char seed = (unsigned char)('p' + b);
+
+        TEST_CHECK(initIOQueue(&q, 8, backends[b]));
+        ASSERT_TRUE(pollCompletions(&q, ev, 1, &n) == RC_OK && n == 0, "G: idle queue has no completions");
+
+        for (int p = 0; p < PAGES; ++p)
+            stamp_pattern(extent + (size_t)p * PAGE_SIZE, (unsigned char)(seed + p), 19);
+        ASSERT_TRUE(run_async_pass(&q, &fh, extent, PAGES, 1) == 0, "G: async writes completed");
+
+        memset(extent, 0, (size_t)PAGES * PAGE_SIZE);
+        ASSERT_TRUE(run_async_pass(&q, &fh, extent, PAGES, 0) == 0, "G: async reads completed");
+        assert_pattern(extent, seed, 19, "G: first page read back");
+        assert_pattern(extent + (size_t)(PAGES - 1) * PAGE_SIZE, (unsigned char)(seed + PAGES - 1), 19,
+                       "G: last page read back");
+
+        ASSERT_TRUE(submitRead(&q, &fh, PAGES, extent, NULL) == RC_READ_NON_EXISTING_PAGE,
+                    "G: out-of-range submit rejected up front");
+        TEST_CHECK(shutdownIOQueue(&q));
+    }
+
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(extent);
+
+    TEST_DONE();
+}
+
+/* Test H: O_DIRECT handles accept aligned buffers and reject unaligned ones */
+static void test_direct_io(void) {
+    const char *fname = "sm_ext_H.bin";
+    SM_FileHandle fh;
+
+    testName = "H: direct I/O + aligned page buffers";
+    SM_PageHandle page = allocatePageHandle();
+    SM_PageHandle wide = allocatePageHandle();
+    ASSERT_TRUE(page != NULL && ((size_t)page % PAGE_SIZE) == 0, "H: allocatePageHandle is PAGE_SIZE-aligned");
+    ASSERT_TRUE(page[0] == 0 && page[PAGE_SIZE - 1] == 0, "H: allocatePageHandle zero-fills");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    ASSERT_TRUE(openPageFileEx((char*)fname, &fh, SM_OPEN_DIRECT | SM_OPEN_MMAP) != RC_OK,
+                "H: direct + mmap rejected");
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_DIRECT));
+    TEST_CHECK(ensureCapacity(4, &fh));
+
+    stamp_pattern(page, (unsigned char)'d', 21);
+    TEST_CHECK(writeBlock(3, &fh, page));
+    memset(page, 0, PAGE_SIZE);
+    TEST_CHECK(readBlock(3, &fh, page));
+    assert_pattern(page, (unsigned char)'d', 21, "H: direct round trip");
+
+    /* An offset into a buffer is never PAGE_SIZE-aligned */
+    char *odd = (char *)malloc(2 * PAGE_SIZE);
+    char *unaligned = odd + (((size_t)odd % PAGE_SIZE) == 8 ? 16 : 8);
+    ASSERT_TRUE(readBlock(3, &fh, unaligned) == RC_PAGE_NOT_ALIGNED, "H: unaligned read rejected");
+    ASSERT_TRUE(writeBlock(3, &fh, unaligned) == RC_PAGE_NOT_ALIGNED, "H: unaligned write rejected");
+
+    SM_PageHandle pair[2] = { page, wide };
+    TEST_CHECK(readBlocks(2, 2, &fh, pair, NULL));
+    assert_pattern(wide, (unsigned char)'d', 21, "H: direct vectored read");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(odd);
+    freePageHandle(wide);
+    freePageHandle(page);
+
+    TEST_DONE();
+}
+
+/* Worker for test I: write own page then sync, repeatedly */
+typedef struct CommitArgs {
+    SM_FileHandle *fh;
+    int page;
+    int rounds;
+    int failures;
+} CommitArgs;
+
+static void *committing_writer(void *arg) {
+    CommitArgs *a = (CommitArgs *)arg;
+    SM_PageHandle buf = allocatePageHandle();
+    for (int r = 0; r < a->rounds; ++r) {
+        memset(buf, 'A' + a->page, PAGE_SIZE);
+        buf[0] = (char)r;
+        if (writeBlock(a->page, a->fh, buf) != RC_OK || syncPageFile(a->fh) != RC_OK)
+            a->failures++;
+    }
+    freePageHandle(buf);
+    return NULL;
+}
+
+/* Test I: durability modes, with concurrent group-committed writers */
+static void test_durability_modes(void) {
+    const char *fname = "sm_ext_I.bin";
+    enum { THREADS = 4, ROUNDS = 25 };
+    SM_FileHandle fh;
+    pthread_t tid[THREADS];
+    CommitArgs args[THREADS];
+
+    testName = "I: durability modes + group commit";
+    SM_PageHandle page = alloc_page_or_die("I: buffer alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(THREADS + 1, &fh));
+    ASSERT_TRUE(setDurabilityMode(&fh, (SM_Durability)7) != RC_OK, "I: unknown mode rejected");
+
+    TEST_CHECK(setDurabilityMode(&fh, SM_DURABILITY_GROUP_COMMIT));
+    for (int t = 0; t < THREADS; ++t) {
+        args[t] = (CommitArgs){ &fh, t, ROUNDS, 0 };
+        ASSERT_TRUE(pthread_create(&tid[t], NULL, committing_writer, &args[t]) == 0, "I: writer started");
+    }
+    int failures = 0;
+    for (int t = 0; t < THREADS; ++t) {
+        pthread_join(tid[t], NULL);
+        failures += args[t].failures;
+    }
+    ASSERT_TRUE(failures == 0, "I: every group-committed write and sync succeeded");
+
+    /* NONE: sync is a no-op, the flush happens at close */
+    TEST_CHECK(setDurabilityMode(&fh, SM_DURABILITY_NONE));
+    stamp_pattern(page, (unsigned char)'n', 6);
+    TEST_CHECK(writeBlock(THREADS, &fh, page));
+    TEST_CHECK(syncPageFile(&fh));
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(readBlock(THREADS - 1, &fh, page));
+    ASSERT_TRUE(page[1] == 'A' + THREADS - 1 && page[0] == ROUNDS - 1, "I: last committed round persisted");
+    TEST_CHECK(readBlock(THREADS, &fh, page));
+    assert_pattern(page, (unsigned char)'n', 6, "I: deferred write persisted at close");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(page);
+
+    TEST_DONE();
+}
+
+/* Worker for test J: provoke one kind of error and check this thread's context */
+typedef struct ErrorArgs {
+    SM_FileHandle *fh;      /* NULL: fail by opening a missing file instead */
+    const char *expect;
+    int mismatches;
+} ErrorArgs;
+
+static void *error_reporter(void *arg) {
+    ErrorArgs *a = (ErrorArgs *)arg;
+    char buf[PAGE_SIZE];
+    SM_FileHandle scratch;
+    for (int i = 0; i < 2000; ++i) {
+        RC rc = (a->fh != NULL) ? readBlock(-1, a->fh, buf)
+                                : openPageFile("sm_ext_J_missing.bin", &scratch);
+        const char *msg = lastErrorMessage();
+        if (rc == RC_OK || msg == NULL || strcmp(msg, a->expect) != 0)
+            a->mismatches++;
+    }
+    return NULL;
+}
+
+/* Test J: error context is per thread; non-allocating message formatting */
+static void test_thread_local_errors(void) {
+    const char *fname = "sm_ext_J.bin";
+    SM_FileHandle fh;
+    pthread_t tid[2];
+    char text[64];
+
+    testName = "J: thread-local error reporting";
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+
+    ErrorArgs args[2] = {
+        { &fh, "page number out of range", 0 },
+        { NULL, "file not found", 0 },
+    };
+    for (int t = 0; t < 2; ++t)
+        ASSERT_TRUE(pthread_create(&tid[t], NULL, error_reporter, &args[t]) == 0, "J: thread started");
+    for (int t = 0; t < 2; ++t)
+        pthread_join(tid[t], NULL);
+    ASSERT_TRUE(args[0].mismatches == 0 && args[1].mismatches == 0, "J: each thread kept its own error message");
+
+    ASSERT_TRUE(readBlock(5, &fh, text) == RC_READ_NON_EXISTING_PAGE, "J: main thread error");
+    ASSERT_TRUE(strcmp(formatErrorMessage(RC_READ_NON_EXISTING_PAGE, text, sizeof text),
+                       "EC (4), \"page number out of range\"\n") == 0, "J: formatErrorMessage into caller buffer");
+    ASSERT_TRUE(strlen(formatErrorMessage(RC_READ_NON_EXISTING_PAGE, text, 8)) == 7, "J: formatErrorMessage truncates");
+
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    TEST_DONE();
+}
+
+/* Test K: cursor scans with read-ahead, forwards and backwards, seeing
+   in-window writes made through the handle and its I/O queue */
+static void test_readahead_scans(void) {
+    const char *fname = "sm_ext_K.bin";
+    enum { PAGES = 150 };
+    const int modes[] = { 0, SM_OPEN_READAHEAD, SM_OPEN_READAHEAD | SM_OPEN_DIRECT };
+    SM_FileHandle fh;
+
+    testName = "K: sequential read-ahead for cursor scans";
+    SM_PageHandle page = allocatePageHandle();
+    ASSERT_TRUE(page != NULL, "K: buffer alloc");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(PAGES, &fh));
+    for (int p = 0; p < PAGES; ++p) {
+        memset(page, (unsigned char)p, PAGE_SIZE);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    TEST_CHECK(closePageFile(&fh));
+
+    for (int m = 0; m < 3; ++m) {
+        int bad = 0;
+        TEST_CHECK(openPageFileEx((char*)fname, &fh, modes[m]));
+
+        TEST_CHECK(readFirstBlock(&fh, page));
+        for (int p = 1; p < PAGES; ++p) {
+            TEST_CHECK(readNextBlock(&fh, page));
+            bad += (page[0] != (char)p || page[PAGE_SIZE - 1] != (char)p);
+        }
+        ASSERT_TRUE(bad == 0 && getBlockPos(&fh) == PAGES - 1, "K: forward scan returned every page in order");
+
+        /* A write inside the buffered window must be visible to the scan */
+        memset(page, 0x7F, PAGE_SIZE);
+        TEST_CHECK(writeBlock(PAGES - 3, &fh, page));
+        TEST_CHECK(readLastBlock(&fh, page));
+        for (int p = PAGES - 2; p >= 0; --p) {
+            TEST_CHECK(readPreviousBlock(&fh, page));
+            char want = (p == PAGES - 3) ? 0x7F : (char)p;
+            bad += (page[0] != want || page[PAGE_SIZE - 1] != want);
+        }
+        ASSERT_TRUE(bad == 0 && getBlockPos(&fh) == 0, "K: backward scan saw the in-window write");
+        ASSERT_TRUE(readPreviousBlock(&fh, page) == RC_READ_NON_EXISTING_PAGE, "K: scan stops at page 0");
+
+        memset(page, (unsigned char)(PAGES - 3), PAGE_SIZE);
+        TEST_CHECK(writeBlock(PAGES - 3, &fh, page));
+
+        /* ... and so must an asynchronous write, once it has completed */
+        SM_IOQueue q;
+        SM_IOToken tok;
+        SM_IOCompletion ev;
+        int got = 0;
+        TEST_CHECK(readFirstBlock(&fh, page));
+        for (int p = 1; p <= 3; ++p) TEST_CHECK(readNextBlock(&fh, page));
+        TEST_CHECK(initIOQueue(&q, 4, SM_AIO_THREADS));
+        memset(page, 0x6E, PAGE_SIZE);
+        TEST_CHECK(submitWrite(&q, &fh, 5, page, &tok));
+        TEST_CHECK(waitCompletions(&q, &ev, 1, 1, &got));
+        TEST_CHECK(shutdownIOQueue(&q));
+        TEST_CHECK(readNextBlock(&fh, page));
+        TEST_CHECK(readNextBlock(&fh, page));
+        ASSERT_TRUE(got == 1 && ev.rc == RC_OK && page[0] == 0x6E && page[PAGE_SIZE - 1] == 0x6E,
+                    "K: scan saw the in-window asynchronous write");
+        memset(page, 5, PAGE_SIZE);
+        TEST_CHECK(writeBlock(5, &fh, page));
+        TEST_CHECK(closePageFile(&fh));
+    }
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    freePageHandle(page);
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   L) Page checksums: a page changed behind the manager's back is reported on
+      every read path, and rewriting it through the API heals it.
+   -------------------------------------------------------------------------- */
+static void test_page_checksums(void) {
+    const char *fname = "sm_ext_L.bin";
+    enum { PAGES = 24, BAD = 13 };
+    SM_FileHandle fh;
+    SM_PageHandle pages[PAGES];
+
+    testName = "L: CRC32C page checksums";
+    ASSERT_TRUE(crc32c(0, "123456789", 9) == 0xE3069283u, "L: CRC32C check value");
+    ASSERT_TRUE(crc32cPortable(0, "123456789", 9) == 0xE3069283u, "L: portable CRC32C check value");
+
+    for (int i = 0; i < PAGES; ++i) pages[i] = alloc_page_or_die("L: pages");
+
+    TEST_CHECK(createPageFileEx((char*)fname, SM_CREATE_CHECKSUM));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(PAGES + 4, &fh));
+    for (int i = 0; i < PAGES; ++i) stamp_pattern(pages[i], (unsigned char)i, 0);
+    int done = 0;
+    TEST_CHECK(writeBlocks(0, PAGES, &fh, pages, &done));
+    ASSERT_TRUE(openPageFileEx((char*)fname, &(SM_FileHandle){0}, SM_OPEN_MMAP) != RC_OK,
+                "L: mmap refused on a checksummed file");
+    TEST_CHECK(closePageFile(&fh));
+
+    /* Flip one byte of page BAD directly in the file (behind the header page) */
+    FILE *raw = fopen(fname, "r+b");
+    ASSERT_TRUE(raw != NULL, "L: raw open");
+    fseek(raw, (long)(BAD + 1) * PAGE_SIZE + 100, SEEK_SET);
+    fputc('~', raw);
+    fclose(raw);
+
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_READAHEAD));
+    TEST_CHECK(readBlock(BAD - 1, &fh, pages[0]));
+    TEST_CHECK(readBlock(PAGES + 2, &fh, pages[0]));     /* never written: zero page */
+    ASSERT_TRUE(readBlock(BAD, &fh, pages[0]) == RC_PAGE_CHECKSUM_MISMATCH, "L: readBlock detects corruption");
+    ASSERT_TRUE(readBlocks(0, PAGES, &fh, pages, &done) == RC_PAGE_CHECKSUM_MISMATCH && done == BAD,
+                "L: readBlocks stops at the corrupt page");
+
+    RC rc = readFirstBlock(&fh, pages[0]);
+    int scanned = 0;
+    while (rc == RC_OK && ++scanned < PAGES) rc = readNextBlock(&fh, pages[0]);
+    ASSERT_TRUE(rc == RC_PAGE_CHECKSUM_MISMATCH && scanned == BAD, "L: read-ahead scan reports the corrupt page");
+
+    SM_IOQueue q;
+    SM_IOToken tok;
+    SM_IOCompletion ev;
+    int n = 0;
+    TEST_CHECK(initIOQueue(&q, 4, SM_AIO_AUTO));
+    TEST_CHECK(submitRead(&q, &fh, BAD, pages[0], &tok));
+    TEST_CHECK(waitCompletions(&q, &ev, 1, 1, &n));
+    ASSERT_TRUE(n == 1 && ev.rc == RC_PAGE_CHECKSUM_MISMATCH, "L: async read completion reports corruption");
+
+    /* Rewriting the page through the API refreshes its checksum */
+    stamp_pattern(pages[0], (unsigned char)BAD, 7);
+    TEST_CHECK(submitWrite(&q, &fh, BAD, pages[0], &tok));
+    TEST_CHECK(waitCompletions(&q, &ev, 1, 1, &n));
+    ASSERT_TRUE(n == 1 && ev.rc == RC_OK, "L: async rewrite");
+    TEST_CHECK(shutdownIOQueue(&q));
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(readBlocks(0, PAGES, &fh, pages, &done));
+    assert_pattern(pages[BAD], (unsigned char)BAD, 7, "L: healed page");
+    assert_pattern(pages[0], 0, 0, "L: untouched page");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    raw = fopen("sm_ext_L.bin.crc", "rb");
+    ASSERT_TRUE(raw == NULL, "L: checksum table removed with the file");
+    for (int i = 0; i < PAGES; ++i) free(pages[i]);
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   M) Compressed page files: the API is unchanged, the data file is smaller,
+      and rewrites reuse freed slots instead of growing the file.
+   -------------------------------------------------------------------------- */
+static long file_bytes(const char *fname) {
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) return -1;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n;
+}
+
+/* Page contents for round `r`: repetitive, incompressible noise or zero */
+static void fill_mixed(SM_PageHandle page, int p, int r) {
+    if (p % 8 == 3) {
+        unsigned x = 2463534242u + (unsigned)(p * 31 + r);
+        for (int i = 0; i < PAGE_SIZE; ++i) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            page[i] = (char)x;
+        }
+    } else if (p % 8 == 5) {
+        memset(page, 0, PAGE_SIZE);
+    } else {
+        stamp_pattern(page, (unsigned char)(p + r), 5 + (p + r) % 11);
+    }
+}
+
+static void test_compressed_files(void) {
+    const char *fname = "sm_ext_M.bin";
+    enum { PAGES = 64, ROUNDS = 6 };
+    SM_FileHandle fh;
+    SM_PageHandle pages[PAGES];
+    SM_PageHandle check = alloc_page_or_die("M: check page");
+
+    testName = "M: compressed page files";
+    for (int i = 0; i < PAGES; ++i) pages[i] = alloc_page_or_die("M: pages");
+
+    TEST_CHECK(createPageFileEx((char*)fname, SM_CREATE_COMPRESSED | SM_CREATE_CHECKSUM));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(fh.totalNumPages == 1, "M: new compressed file has one page");
+    TEST_CHECK(readFirstBlock(&fh, check));
+    ASSERT_TRUE(check[0] == 0 && check[PAGE_SIZE - 1] == 0, "M: first page is zero");
+    ASSERT_TRUE(openPageFileEx((char*)fname, &(SM_FileHandle){0}, SM_OPEN_MMAP) != RC_OK,
+                "M: mmap refused on a compressed file");
+    TEST_CHECK(ensureCapacity(PAGES, &fh));
+
+    long peak = 0;
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (int p = 0; p < PAGES; ++p) fill_mixed(pages[p], p, r);
+        int done = 0;
+        if (r % 2 == 0) {
+            TEST_CHECK(writeBlocks(0, PAGES, &fh, pages, &done));
+        } else {
+            for (int p = PAGES - 1; p >= 0; --p) TEST_CHECK(writeBlock(p, &fh, pages[p]));
+        }
+        /* replaced slots are reused only once the table naming the new
+           ones is synced */
+        TEST_CHECK(syncPageFile(&fh));
+        long size = file_bytes(fname);
+        if (size > peak) peak = size;
+    }
+    TEST_CHECK(closePageFile(&fh));
+
+    long size = file_bytes(fname);
+    ASSERT_TRUE(size > 0 && size < (long)PAGES * PAGE_SIZE / 2, "M: data file smaller than the raw pages");
+    ASSERT_TRUE(peak < (long)PAGES * PAGE_SIZE, "M: rewrites reuse slots freed by a sync");
+
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_READAHEAD));
+    ASSERT_TRUE(fh.totalNumPages == PAGES, "M: page count survives reopen");
+    int bad = 0;
+    TEST_CHECK(readFirstBlock(&fh, check));
+    for (int p = 0; p < PAGES; ++p) {
+        if (p > 0) TEST_CHECK(readNextBlock(&fh, check));
+        bad += memcmp(check, pages[p], PAGE_SIZE) != 0;
+    }
+    ASSERT_TRUE(bad == 0, "M: scan after reopen returns every page");
+
+    /* After reopen the free slots are rebuilt from the table */
+    for (int p = 0; p < PAGES; ++p) {
+        fill_mixed(pages[p], p, ROUNDS);
+        TEST_CHECK(writeBlock(p, &fh, pages[p]));
+    }
+    int done = 0;
+    TEST_CHECK(readBlocks(0, PAGES, &fh, pages, &done));
+    fill_mixed(check, PAGES - 1, ROUNDS);
+    ASSERT_TRUE(done == PAGES && memcmp(check, pages[PAGES - 1], PAGE_SIZE) == 0, "M: readBlocks after rewrite");
+    ASSERT_TRUE(file_bytes(fname) <= peak, "M: reopened handle reuses free slots");
+
+    TEST_CHECK(appendEmptyBlock(&fh));
+    TEST_CHECK(readLastBlock(&fh, check));
+    ASSERT_TRUE(check[0] == 0 && getBlockPos(&fh) == PAGES, "M: appended page reads as zeros");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    ASSERT_TRUE(file_bytes("sm_ext_M.bin.ptt") < 0, "M: page table removed with the file");
+    for (int i = 0; i < PAGES; ++i) free(pages[i]);
+    free(check);
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   N) Per-handle statistics: counters follow the calls made on the handle and
+      every timed call lands in exactly one latency bucket.
+   -------------------------------------------------------------------------- */
+static unsigned long long histogram_total(const unsigned long long *hist) {
+    unsigned long long total = 0;
+    for (int b = 0; b < SM_STATS_BUCKETS; ++b) total += hist[b];
+    return total;
+}
+
+static void test_file_stats(void) {
+    const char *fname = "sm_ext_N.bin";
+    enum { PAGES = 8 };
+    SM_FileHandle fh;
+    SM_FileStats st;
+    SM_PageHandle pages[PAGES];
+
+    testName = "N: per-handle I/O statistics";
+    for (int i = 0; i < PAGES; ++i) pages[i] = alloc_page_or_die("N: pages");
+
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(getPageFileStats(&fh, &st));
+    ASSERT_TRUE(st.reads == 0 && st.writes == 0 && st.errors == 0, "N: fresh handle starts at zero");
+
+    TEST_CHECK(ensureCapacity(PAGES - 1, &fh));             /* +6 pages */
+    TEST_CHECK(appendEmptyBlock(&fh));                      /* +1 page */
+    for (int p = 0; p < PAGES; ++p) TEST_CHECK(writeBlock(p, &fh, pages[p]));
+    int done = 0;
+    TEST_CHECK(readBlocks(0, PAGES, &fh, pages, &done));
+    TEST_CHECK(readBlock(5, &fh, pages[0]));                /* not where the last transfer ended */
+    TEST_CHECK(readNextBlock(&fh, pages[0]));
+    ASSERT_TRUE(readBlock(PAGES, &fh, pages[0]) == RC_READ_NON_EXISTING_PAGE, "N: out-of-range read fails");
+    TEST_CHECK(syncPageFile(&fh));
+
+    TEST_CHECK(getPageFileStats(&fh, &st));
+#ifdef SM_NO_STATS
+    ASSERT_TRUE(st.reads == 0 && st.writes == 0 && histogram_total(st.readLatency) == 0,
+                "N: compiled out, counters stay zero");
+#else
+    ASSERT_TRUE(st.appends == PAGES - 1, "N: appended pages counted");
+    ASSERT_TRUE(st.writes == PAGES && st.bytesWritten == (unsigned long long)PAGES * PAGE_SIZE, "N: writes counted");
+    ASSERT_TRUE(st.reads == PAGES + 2 && st.bytesRead == (unsigned long long)(PAGES + 2) * PAGE_SIZE, "N: reads counted");
+    ASSERT_TRUE(st.seeks == 2, "N: seeks counted at the two jumps");
+    ASSERT_TRUE(st.errors == 1 && st.flushes == 1, "N: errors and flushes counted");
+    ASSERT_TRUE(histogram_total(st.writeLatency) == PAGES, "N: one write latency sample per writeBlock");
+    ASSERT_TRUE(histogram_total(st.readLatency) == 2, "N: read latency covers readBlock and cursor reads");
+#endif
+
+    FILE *out = tmpfile();
+    ASSERT_TRUE(out != NULL, "N: tmpfile");
+    TEST_CHECK(dumpPageFileStats(&fh, out));
+    ASSERT_TRUE(ftell(out) > 0, "N: dump wrote a report");
+    fclose(out);
+
+    TEST_CHECK(closePageFile(&fh));
+    ASSERT_TRUE(getPageFileStats(&fh, &st) == RC_FILE_HANDLE_NOT_INIT, "N: closed handle has no stats");
+    TEST_CHECK(destroyPageFile((char*)fname));
+    for (int i = 0; i < PAGES; ++i) free(pages[i]);
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   O) File header page: the page count comes from the header, survives
+      reopen, never goes backwards, and damaged or foreign files are refused.
+   -------------------------------------------------------------------------- */
+static void overwrite_bytes(const char *fname, long offset, const char *bytes, size_t len) {
+    FILE *raw = fopen(fname, "r+b");
+    ASSERT_TRUE(raw != NULL, "raw open");
+    fseek(raw, offset, SEEK_SET);
+    fwrite(bytes, 1, len, raw);
+    fclose(raw);
+}
+
+static void test_file_header(void) {
+    const char *fname = "sm_ext_O.bin";
+    const char *cname = "sm_ext_O_compressed.bin";
+    SM_FileHandle a, b;
+    char magic[8] = {0};
+
+    testName = "O: file header page";
+    TEST_CHECK(createPageFile((char*)fname));
+    ASSERT_TRUE(file_bytes(fname) == 2L * PAGE_SIZE, "O: new file is header + one data page");
+    FILE *raw = fopen(fname, "rb");
+    ASSERT_TRUE(raw != NULL && fread(magic, 1, sizeof magic, raw) == sizeof magic, "O: header readable");
+    fclose(raw);
+    ASSERT_TRUE(memcmp(magic, "CS525PF", 8) == 0, "O: header starts with the magic");
+
+    /* Two handles: the second appends behind the first's growth */
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    TEST_CHECK(openPageFile((char*)fname, &b));
+    TEST_CHECK(ensureCapacity(50, &a));
+    TEST_CHECK(appendEmptyBlock(&b));
+    ASSERT_TRUE(b.totalNumPages == 51, "O: second handle grew by one");
+    TEST_CHECK(closePageFile(&b));
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    ASSERT_TRUE(a.totalNumPages == 51, "O: page count read back from the header");
+    TEST_CHECK(closePageFile(&a));
+
+    /* A damaged header is refused, and the handle is left unopened */
+    overwrite_bytes(fname, 16, "\x07", 1);
+    ASSERT_TRUE(openPageFile((char*)fname, &a) == RC_FILE_HEADER_INVALID && a.mgmtInfo == NULL,
+                "O: corrupted header detected");
+    overwrite_bytes(fname, 0, "NOTAPAGE", 8);
+    ASSERT_TRUE(openPageFile((char*)fname, &a) == RC_FILE_HEADER_INVALID, "O: foreign file refused");
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    raw = fopen(fname, "wb");
+    fputs("hello", raw);
+    fclose(raw);
+    ASSERT_TRUE(openPageFile((char*)fname, &a) == RC_FILE_HEADER_INVALID, "O: short file refused");
+    remove(fname);
+
+    /* Compressed files keep their count and format flags in the header too */
+    TEST_CHECK(createPageFileEx((char*)cname, SM_CREATE_COMPRESSED));
+    ASSERT_TRUE(file_bytes(cname) == PAGE_SIZE, "O: compressed file starts as just the header");
+    TEST_CHECK(openPageFile((char*)cname, &a));
+    TEST_CHECK(ensureCapacity(300, &a));
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(openPageFile((char*)cname, &a));
+    ASSERT_TRUE(a.totalNumPages == 300, "O: compressed page count read back from the header");
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(destroyPageFile((char*)cname));
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   P) Free-space map: freed pages are handed out again lowest first before
+      the file grows, double frees are refused, and the map survives reopen.
+   -------------------------------------------------------------------------- */
+static void test_free_space_map(void) {
+    const char *fname = "sm_ext_P.bin";
+    SM_FileHandle fh;
+    int page = -1;
+
+    testName = "P: free-space map";
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+
+    /* Nothing freed yet: allocatePage appends */
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 1 && fh.totalNumPages == 2, "P: allocation with no free page appends");
+    TEST_CHECK(ensureCapacity(300, &fh));
+
+    /* Freed pages come back lowest first, spanning several bitmap words */
+    TEST_CHECK(freePage(&fh, 250));
+    TEST_CHECK(freePage(&fh, 7));
+    TEST_CHECK(freePage(&fh, 130));
+    ASSERT_TRUE(freePage(&fh, 130) == RC_PAGE_ALREADY_FREE, "P: double free refused");
+    ASSERT_TRUE(freePage(&fh, 300) == RC_READ_NON_EXISTING_PAGE, "P: free past EOF refused");
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 7, "P: lowest free page reused first");
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 130, "P: next free page found in a later word");
+    ASSERT_TRUE(fh.totalNumPages == 300, "P: reuse does not grow the file");
+
+    /* A page freed below the hint is still found */
+    TEST_CHECK(freePage(&fh, 3));
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 3, "P: page freed below the scan hint reused");
+
+    /* The map survives a reopen */
+    TEST_CHECK(freePage(&fh, 64));
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(freePage(&fh, 250) == RC_PAGE_ALREADY_FREE, "P: free bit persisted");
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 64, "P: free page found after reopen");
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 250, "P: last free page reused");
+    TEST_CHECK(allocatePage(&fh, &page));
+    ASSERT_TRUE(page == 300 && fh.totalNumPages == 301, "P: map exhausted, file grows again");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    ASSERT_TRUE(file_bytes("sm_ext_P.bin.fsm") < 0, "P: map removed with the file");
+
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   Q) Sparse files: growth allocates no blocks, zero writes and freed pages
+      become holes, and an SM_OPEN_SPARSE handle reads holes as zero pages.
+   -------------------------------------------------------------------------- */
+static long file_disk_bytes(const char *fname) {
+    struct stat st;
+    if (stat(fname, &st) != 0) return -1;
+    return (long)st.st_blocks * 512L;
+}
+
+static void test_sparse_pages(void) {
+    const char *fname = "sm_ext_Q.bin";
+    const int pages = 2048;
+    SM_FileHandle fh;
+
+    testName = "Q: sparse pages";
+    SM_PageHandle page = alloc_page_or_die("Q: buffer alloc");
+    SM_PageHandle zero = alloc_page_or_die("Q: zero buffer alloc");
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(pages, &fh));
+    ASSERT_TRUE(file_disk_bytes(fname) < 64L * PAGE_SIZE, "Q: 8 MiB of new pages allocate no blocks");
+
+    for (int p = 0; p < 64; ++p) {
+        stamp_pattern(page, (unsigned char)p, 1);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    TEST_CHECK(syncPageFile(&fh));
+    long written = file_disk_bytes(fname);
+    ASSERT_TRUE(written >= 64L * PAGE_SIZE, "Q: written pages take blocks");
+
+    /* All-zero writes and freePage both give the blocks back */
+    for (int p = 0; p < 32; ++p)
+        TEST_CHECK(writeBlock(p, &fh, zero));
+    for (int p = 32; p < 48; ++p)
+        TEST_CHECK(freePage(&fh, p));
+    TEST_CHECK(syncPageFile(&fh));
+    ASSERT_TRUE(file_disk_bytes(fname) <= written - 40L * PAGE_SIZE, "Q: zeroed pages punched out");
+    TEST_CHECK(readBlock(40, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: freed page reads as zeros");
+    TEST_CHECK(readBlock(50, &fh, page));
+    assert_pattern(page, 50, 1, "Q: neighbour of a hole untouched");
+
+    /* writeBlocks and write-back flushes punch their zero pages too */
+    SM_PageHandle mixed[32];
+    for (int p = 64; p < 128; ++p) {
+        stamp_pattern(page, (unsigned char)p, 1);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    TEST_CHECK(syncPageFile(&fh));
+    written = file_disk_bytes(fname);
+    stamp_pattern(page, 77, 3);
+    for (int i = 0; i < 32; ++i)
+        mixed[i] = (i % 2 == 0) ? zero : page;
+    TEST_CHECK(writeBlocks(64, 32, &fh, mixed, NULL));
+    TEST_CHECK(syncPageFile(&fh));
+    ASSERT_TRUE(file_disk_bytes(fname) <= written - 8L * PAGE_SIZE, "Q: writeBlocks punched its zero pages");
+    TEST_CHECK(readBlock(64, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: zero page of a vectored write reads as zeros");
+    TEST_CHECK(readBlock(65, &fh, page));
+    assert_pattern(page, 77, 3, "Q: data page of a vectored write");
+    TEST_CHECK(closePageFile(&fh));
+
+    written = file_disk_bytes(fname);
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_WRITEBACK));
+    for (int p = 96; p < 112; ++p)
+        TEST_CHECK(writeBlock(p, &fh, zero));
+    TEST_CHECK(closePageFile(&fh));
+    ASSERT_TRUE(file_disk_bytes(fname) <= written - 8L * PAGE_SIZE, "Q: write-back flush punched zero pages");
+
+    /* SM_OPEN_SPARSE: holes found at open, kept current by the handle's writes */
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_SPARSE));
+    TEST_CHECK(readBlock(10, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: punched page read as a hole");
+    TEST_CHECK(readBlock(pages - 1, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: never-written page read as a hole");
+    TEST_CHECK(readBlock(60, &fh, page));
+    assert_pattern(page, 60, 1, "Q: data page read from disk");
+
+    stamp_pattern(page, 10, 2);
+    TEST_CHECK(writeBlock(10, &fh, page));
+    SM_PageHandle range[2] = { page, page };
+    TEST_CHECK(writeBlocks(pages - 2, 2, &fh, range, NULL));
+    TEST_CHECK(readBlock(10, &fh, page));
+    assert_pattern(page, 10, 2, "Q: hole filled by writeBlock");
+    TEST_CHECK(readBlock(pages - 1, &fh, page));
+    assert_pattern(page, 10, 2, "Q: hole filled by writeBlocks");
+
+    TEST_CHECK(appendEmptyBlock(&fh));
+    TEST_CHECK(readBlock(pages, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: appended page read as a hole");
+    TEST_CHECK(writeBlock(60, &fh, zero));
+    TEST_CHECK(readBlock(60, &fh, page));
+    ASSERT_TRUE(memcmp(page, zero, PAGE_SIZE) == 0, "Q: zero write turns a page into a hole");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    free(page);
+    free(zero);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   R) Write-ahead log: commits apply atomically, aborts leave no trace, and
+      after a crash (a child exiting without closing) reopening replays
+      committed transactions but not one whose commit record was torn.
+   -------------------------------------------------------------------------- */
+static int crash_after_commits(const char *fname, const char *wname, SM_PageHandle page) {
+    SM_FileHandle c;
+    SM_Tx *tx;
+    int bad = 0;
+
+    bad |= openPageFile((char*)fname, &c);
+    bad |= beginTx(&c, &tx);
+    stamp_pattern(page, 1, 3);
+    bad |= logPageWrite(tx, 1, page);
+    stamp_pattern(page, 2, 3);
+    bad |= logPageWrite(tx, 2, page);
+    bad |= commitTx(tx);
+    bad |= beginTx(&c, &tx);
+    stamp_pattern(page, 4, 3);
+    bad |= logPageWrite(tx, 4, page);
+    bad |= commitTx(tx);
+
+    /* the in-place writes never reached the disk ... */
+    for (int p = 1; p <= 4; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        bad |= writeBlock(p, &c, page);
+    }
+    /* ... and the last commit record is torn */
+    bad |= truncate(wname, file_bytes(wname) - 8) != 0;
+    return bad;
+}
+
+static void test_write_ahead_log(void) {
+    const char *fname = "sm_ext_R.bin";
+    const char *wname = "sm_ext_R.bin.wal";
+    SM_FileHandle fh;
+    SM_Tx *tx;
+
+    testName = "R: write-ahead log";
+    SM_PageHandle page = alloc_page_or_die("R: buffer alloc");
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(16, &fh));
+    for (int p = 0; p < 16; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    TEST_CHECK(syncPageFile(&fh));
+
+    /* A commit applies every page; a later image of a page replaces the earlier */
+    TEST_CHECK(beginTx(&fh, &tx));
+    stamp_pattern(page, 3, 1);
+    TEST_CHECK(logPageWrite(tx, 3, page));
+    stamp_pattern(page, 9, 1);
+    TEST_CHECK(logPageWrite(tx, 9, page));
+    stamp_pattern(page, 3, 2);
+    TEST_CHECK(logPageWrite(tx, 3, page));
+    TEST_CHECK(commitTx(tx));
+    ASSERT_TRUE(file_bytes(wname) > 2L * PAGE_SIZE, "R: commit appended to the log");
+    TEST_CHECK(readBlock(3, &fh, page));
+    assert_pattern(page, 3, 2, "R: last image of a page applied");
+    TEST_CHECK(readBlock(9, &fh, page));
+    assert_pattern(page, 9, 1, "R: every page of the transaction applied");
+
+    /* An aborted transaction changes nothing */
+    TEST_CHECK(beginTx(&fh, &tx));
+    stamp_pattern(page, 5, 1);
+    TEST_CHECK(logPageWrite(tx, 5, page));
+    ASSERT_TRUE(logPageWrite(tx, 16, page) == RC_WRITE_FAILED, "R: page past EOF refused");
+    TEST_CHECK(abortTx(tx));
+    TEST_CHECK(readBlock(5, &fh, page));
+    assert_pattern(page, 5, 0, "R: aborted page untouched");
+
+    TEST_CHECK(checkpointPageFile(&fh));
+    ASSERT_TRUE(file_bytes(wname) == 0, "R: checkpoint empties the log");
+    TEST_CHECK(closePageFile(&fh));
+    ASSERT_TRUE(file_bytes(wname) < 0, "R: log removed on a clean close");
+
+    /* Crash: recovery redoes the lost in-place writes of intact commits only */
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(crash_after_commits(fname, wname, page) ? 1 : 0);
+    int status = -1;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0, "R: crashing child ran");
+    ASSERT_TRUE(file_bytes(wname) > 0, "R: crash left the log behind");
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(readBlock(1, &fh, page));
+    assert_pattern(page, 1, 3, "R: committed page replayed");
+    TEST_CHECK(readBlock(2, &fh, page));
+    assert_pattern(page, 2, 3, "R: whole transaction replayed");
+    TEST_CHECK(readBlock(4, &fh, page));
+    assert_pattern(page, 4, 0, "R: torn transaction not replayed");
+    ASSERT_TRUE(file_bytes(wname) == 0, "R: log emptied after recovery");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    free(page);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   S) Snapshots: a snapshot keeps reading the file as it was while the live
+      handle is rewritten, freed into and grown, even by a concurrent writer
+      or through another handle on the file, and it refuses every call that
+      would modify the file.
+   -------------------------------------------------------------------------- */
+typedef struct SnapWriter {
+    SM_FileHandle *fh;
+    int pages, rounds;
+    int failures;
+} SnapWriter;
+
+static void *snapshot_writer(void *arg) {
+    SnapWriter *w = (SnapWriter *)arg;
+    SM_PageHandle page = allocatePageHandle();
+    for (int r = 0; r < w->rounds; ++r) {
+        for (int p = 0; p < w->pages; ++p) {
+            stamp_pattern(page, (unsigned char)p, 10 + r);
+            if (writeBlock(p, w->fh, page) != RC_OK) w->failures++;
+        }
+    }
+    freePageHandle(page);
+    return NULL;
+}
+
+static void test_snapshots(void) {
+    const char *fname = "sm_ext_S.bin";
+    const int pages = 64;
+    SM_FileHandle fh, a, b;
+
+    testName = "S: copy-on-write snapshots";
+    SM_PageHandle page = alloc_page_or_die("S: buffer alloc");
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(pages, &fh));
+    for (int p = 0; p < pages; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+
+    /* A concurrent writer rewrites every page while the snapshot is scanned */
+    TEST_CHECK(createSnapshot(&fh, &a));
+    SnapWriter w = {&fh, pages, 8, 0};
+    pthread_t tid;
+    pthread_create(&tid, NULL, snapshot_writer, &w);
+    int stale = 0;
+    for (int scan = 0; scan < 8; ++scan) {
+        TEST_CHECK(readFirstBlock(&a, page));
+        for (int p = 0; p < pages; ++p) {
+            unsigned char expect[PAGE_SIZE];
+            stamp_pattern((SM_PageHandle)expect, (unsigned char)p, 0);
+            if (memcmp(page, expect, PAGE_SIZE) != 0) stale++;
+            if (p + 1 < pages && readNextBlock(&a, page) != RC_OK) stale++;
+        }
+    }
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(w.failures == 0, "S: writer never blocked or failed");
+    ASSERT_TRUE(stale == 0, "S: snapshot scans unaffected by the concurrent writer");
+
+    /* Frees, vectored writes and growth are invisible to the snapshot */
+    TEST_CHECK(freePage(&fh, 20));
+    SM_PageHandle range[2] = { page, page };
+    stamp_pattern(page, 30, 1);
+    TEST_CHECK(writeBlocks(30, 2, &fh, range, NULL));
+    TEST_CHECK(appendEmptyBlock(&fh));
+    TEST_CHECK(readBlock(20, &a, page));
+    assert_pattern(page, 20, 0, "S: freed page still readable in the snapshot");
+    SM_PageHandle two[2] = { alloc_page_or_die("S: range alloc"), alloc_page_or_die("S: range alloc") };
+    TEST_CHECK(readBlocks(30, 2, &a, two, NULL));
+    assert_pattern(two[0], 30, 0, "S: readBlocks through the snapshot");
+    ASSERT_TRUE(a.totalNumPages == pages && readBlock(pages, &a, page) == RC_READ_NON_EXISTING_PAGE,
+                "S: snapshot keeps its page count");
+
+    /* A second snapshot sees the later state; each keeps its own view */
+    TEST_CHECK(createSnapshot(&fh, &b));
+    stamp_pattern(page, 5, 2);
+    TEST_CHECK(writeBlock(5, &fh, page));
+    TEST_CHECK(readBlock(5, &a, page));
+    assert_pattern(page, 5, 0, "S: oldest snapshot view");
+    TEST_CHECK(readBlock(5, &b, page));
+    assert_pattern(page, 5, 17, "S: newer snapshot view");
+    TEST_CHECK(readBlock(5, &fh, page));
+    assert_pattern(page, 5, 2, "S: live view");
+
+    ASSERT_TRUE(writeBlock(5, &a, page) == RC_WRITE_FAILED, "S: snapshot refuses writeBlock");
+    ASSERT_TRUE(appendEmptyBlock(&a) == RC_WRITE_FAILED, "S: snapshot refuses growth");
+    ASSERT_TRUE(freePage(&a, 1) == RC_WRITE_FAILED, "S: snapshot refuses freePage");
+    ASSERT_TRUE(closePageFile(&fh) == RC_FILE_HANDLE_NOT_INIT, "S: live handle outlives its snapshots");
+
+    /* writes through another handle on the file are preserved too, and
+       that handle may close while the snapshots stay */
+    SM_FileHandle other;
+    TEST_CHECK(openPageFile((char*)fname, &other));
+    stamp_pattern(page, 6, 3);
+    TEST_CHECK(writeBlock(6, &other, page));
+    TEST_CHECK(closePageFile(&other));
+    TEST_CHECK(readBlock(6, &b, page));
+    assert_pattern(page, 6, 17, "S: snapshot keeps a page rewritten through another handle");
+    TEST_CHECK(readBlock(6, &fh, page));
+    assert_pattern(page, 6, 3, "S: live handle sees the other handle's write");
+
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(closePageFile(&b));
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    free(two[0]);
+    free(two[1]);
+    free(page);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   T) Page size per file: the size chosen at creation is kept in the header,
+      every byte of a large page round-trips through the plain, vectored,
+      checksummed, logged, snapshot and buffer-pool paths, and unsupported
+      sizes are refused.
+   -------------------------------------------------------------------------- */
+static void stamp_sized(SM_PageHandle buf, int size, int seed) {
+    for (int i = 0; i < size; ++i)
+        buf[i] = (char)((seed * 7 + i) % 251);
+}
+
+static int sized_matches(const SM_PageHandle buf, int size, int seed) {
+    for (int i = 0; i < size; ++i)
+        if (buf[i] != (char)((seed * 7 + i) % 251)) return 0;
+    return 1;
+}
+
+static void test_page_sizes(void) {
+    const char *fname = "sm_ext_T.bin";
+    const int big = 65536, mid = 16384, small = 8192;
+    SM_FileHandle fh, snap;
+    SM_Tx *tx;
+
+    testName = "T: configurable page size";
+    ASSERT_TRUE(createPageFileSized((char*)fname, 0, 2048) == RC_WRITE_FAILED, "T: size below minimum refused");
+    ASSERT_TRUE(createPageFileSized((char*)fname, 0, 12288) == RC_WRITE_FAILED, "T: non power of two refused");
+    ASSERT_TRUE(createPageFileSized((char*)fname, 0, 2 * big) == RC_WRITE_FAILED, "T: size above maximum refused");
+    ASSERT_TRUE(createPageFileSized((char*)fname, SM_CREATE_COMPRESSED, mid) == RC_WRITE_FAILED,
+                "T: compressed files keep PAGE_SIZE pages");
+
+    /* 64 KiB pages: layout, single and vectored I/O, persistence */
+    SM_PageHandle pages[4];
+    for (int i = 0; i < 4; ++i) {
+        pages[i] = allocatePageHandleSized(big);
+        ASSERT_TRUE(pages[i] != NULL, "T: buffer alloc");
+    }
+    TEST_CHECK(createPageFileSized((char*)fname, 0, big));
+    ASSERT_TRUE(file_bytes(fname) == PAGE_SIZE + big, "T: header + one 64 KiB page");
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(getPageSize(&fh) == big, "T: page size reported");
+    TEST_CHECK(ensureCapacity(10, &fh));
+    ASSERT_TRUE(file_bytes(fname) == PAGE_SIZE + 10L * big, "T: growth in 64 KiB pages");
+    stamp_sized(pages[0], big, 3);
+    TEST_CHECK(writeBlock(3, &fh, pages[0]));
+    for (int i = 0; i < 4; ++i) stamp_sized(pages[i], big, 5 + i);
+    TEST_CHECK(writeBlocks(5, 4, &fh, pages, NULL));
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(getPageSize(&fh) == big && fh.totalNumPages == 10, "T: size and count survive reopen");
+    TEST_CHECK(readBlock(3, &fh, pages[0]));
+    ASSERT_TRUE(sized_matches(pages[0], big, 3), "T: whole 64 KiB page read back");
+    TEST_CHECK(readBlocks(5, 4, &fh, pages, NULL));
+    int same = 1;
+    for (int i = 0; i < 4; ++i) same &= sized_matches(pages[i], big, 5 + i);
+    ASSERT_TRUE(same, "T: vectored 64 KiB pages read back");
+    SM_PageHandle mapped = NULL;
+    TEST_CHECK(openPageFileEx((char*)fname, &snap, SM_OPEN_MMAP));
+    TEST_CHECK(getPagePtr(8, &snap, &mapped));
+    ASSERT_TRUE(sized_matches(mapped, big, 8), "T: mapped 64 KiB page at the right offset");
+    TEST_CHECK(closePageFile(&snap));
+
+    /* a logged update of a large page, and a snapshot keeping the old image */
+    TEST_CHECK(createSnapshot(&fh, &snap));
+    stamp_sized(pages[0], big, 40);
+    TEST_CHECK(beginTx(&fh, &tx));
+    TEST_CHECK(logPageWrite(tx, 3, pages[0]));
+    TEST_CHECK(commitTx(tx));
+    TEST_CHECK(readBlock(3, &snap, pages[1]));
+    ASSERT_TRUE(sized_matches(pages[1], big, 3), "T: snapshot keeps the old 64 KiB image");
+    TEST_CHECK(closePageFile(&snap));
+    TEST_CHECK(readBlock(3, &fh, pages[1]));
+    ASSERT_TRUE(sized_matches(pages[1], big, 40), "T: committed 64 KiB page applied");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    /* 16 KiB checksummed pages: damage past the first 4 KiB is caught */
+    TEST_CHECK(createPageFileSized((char*)fname, SM_CREATE_CHECKSUM, mid));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(4, &fh));
+    stamp_sized(pages[0], mid, 9);
+    TEST_CHECK(writeBlock(2, &fh, pages[0]));
+    TEST_CHECK(readBlock(1, &fh, pages[1]));   /* never written: a zero page */
+    TEST_CHECK(closePageFile(&fh));
+    overwrite_bytes(fname, PAGE_SIZE + 2L * mid + mid - 1, "\x55", 1);
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(readBlock(2, &fh, pages[0]) == RC_PAGE_CHECKSUM_MISMATCH, "T: damage at the end of a 16 KiB page detected");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    /* 8 KiB pages through the buffer pool: frames are a whole page */
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    TEST_CHECK(createPageFileSized((char*)fname, 0, small));
+    TEST_CHECK(initBufferPool(&bm, fname, 3, RS_LRU, NULL));
+    for (int p = 0; p < 6; ++p) {
+        TEST_CHECK(pinPage(&bm, &h, p));
+        stamp_sized(h.data, small, 20 + p);
+        TEST_CHECK(markDirty(&bm, &h));
+        TEST_CHECK(unpinPage(&bm, &h));
+    }
+    TEST_CHECK(shutdownBufferPool(&bm));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    same = getPageSize(&fh) == small && fh.totalNumPages == 6;
+    for (int p = 0; p < 6; ++p) {
+        TEST_CHECK(readBlock(p, &fh, pages[0]));
+        same &= sized_matches(pages[0], small, 20 + p);
+    }
+    ASSERT_TRUE(same, "T: 8 KiB frames written back in full");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    for (int i = 0; i < 4; ++i) freePageHandle(pages[i]);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   U) Parallel scans: every page in the range is visited exactly once with
+      its contents, on every kind of handle; a worker stuck in a callback
+      has its remaining pages taken by another; callback and read errors
+      stop the scan and are returned.
+   -------------------------------------------------------------------------- */
+typedef struct ScanCheck {
+    int visits[512];
+    int wrong;              /* pages whose contents did not match */
+    int firstFresh;         /* pages >= this still hold their original image */
+    int failAt;             /* page whose callback fails, or -1 */
+    int blockAt;            /* page whose callback waits for stolenFrom.. */
+    int stolenFrom, stolenTo;
+    int stolenSeen;         /* pages of that range visited so far */
+    int stole;              /* the wait ended because they were all visited */
+} ScanCheck;
+
+static RC scan_check_page(int pageNum, SM_PageHandle page, void *ctx) {
+    ScanCheck *c = (ScanCheck *)ctx;
+    __atomic_fetch_add(&c->visits[pageNum], 1, __ATOMIC_RELAXED);
+    unsigned char expect[PAGE_SIZE];
+    stamp_pattern((SM_PageHandle)expect, (unsigned char)pageNum, 0);
+    if (pageNum < c->firstFresh) expect[0] ^= 0xFF;
+    if (memcmp(page, expect, PAGE_SIZE) != 0)
+        __atomic_fetch_add(&c->wrong, 1, __ATOMIC_RELAXED);
+    if (pageNum >= c->stolenFrom && pageNum < c->stolenTo)
+        __atomic_fetch_add(&c->stolenSeen, 1, __ATOMIC_RELEASE);
+
+    if (pageNum == c->blockAt) {
+        struct timespec pause = {0, 1000000};
+        for (int waited = 0; waited < 5000; ++waited) {
+            if (__atomic_load_n(&c->stolenSeen, __ATOMIC_ACQUIRE) == c->stolenTo - c->stolenFrom) {
+                c->stole = 1;
+                break;
+            }
+            nanosleep(&pause, NULL);
+        }
+    }
+    return (pageNum == c->failAt) ? RC_WRITE_FAILED : RC_OK;
+}
+
+static int scan_all_once(const ScanCheck *c, int from, int to) {
+    for (int p = 0; p < 512; ++p)
+        if (c->visits[p] != (p >= from && p < to)) return 0;
+    return c->wrong == 0;
+}
+
+static void scan_check_reset(ScanCheck *c) {
+    memset(c, 0, sizeof *c);
+    c->failAt = c->blockAt = -1;
+}
+
+static void fill_scan_file(const char *fname, int flags, int pages, SM_PageHandle page) {
+    SM_FileHandle fh;
+    TEST_CHECK(createPageFileEx((char*)fname, flags));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(pages, &fh));
+    for (int p = 0; p < pages; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    TEST_CHECK(closePageFile(&fh));
+}
+
+static void test_parallel_scans(void) {
+    const char *fname = "sm_ext_U.bin";
+    const int pages = 500;
+    SM_FileHandle fh, snap;
+    ScanCheck c;
+
+    testName = "U: parallel page scans";
+    SM_PageHandle page = alloc_page_or_die("U: buffer alloc");
+    fill_scan_file(fname, SM_CREATE_CHECKSUM, pages, page);
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&fh, 0, pages, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, pages), "U: whole file, each page once with its contents");
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&fh, 37, 300, scan_check_page, &c, 0));
+    ASSERT_TRUE(scan_all_once(&c, 37, 300), "U: sub-range on one thread per CPU");
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&fh, 10, 10, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, 0), "U: empty range visits nothing");
+    ASSERT_TRUE(scanPageFile(&fh, 0, pages + 1, scan_check_page, &c, 4) == RC_READ_NON_EXISTING_PAGE,
+                "U: range past the end refused");
+
+    /* Two workers, four chunks: the one holding page 0 waits in its callback
+       until its second chunk has been visited, which only a thief can do */
+    scan_check_reset(&c);
+    c.blockAt = 0;
+    c.stolenFrom = 32;
+    c.stolenTo = 64;
+    TEST_CHECK(scanPageFile(&fh, 0, 128, scan_check_page, &c, 2));
+    ASSERT_TRUE(c.stole && scan_all_once(&c, 0, 128), "U: idle worker steals from a stuck one");
+
+    /* A failing callback stops the scan with its code */
+    scan_check_reset(&c);
+    c.failAt = 77;
+    ASSERT_TRUE(scanPageFile(&fh, 0, pages, scan_check_page, &c, 3) == RC_WRITE_FAILED,
+                "U: callback error returned");
+
+    /* A snapshot scan sees the file as it was */
+    TEST_CHECK(createSnapshot(&fh, &snap));
+    for (int p = 0; p < 100; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        page[0] ^= (char)0xFF;
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&snap, 0, pages, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, pages), "U: snapshot scanned as of its creation");
+    TEST_CHECK(closePageFile(&snap));
+    scan_check_reset(&c);
+    c.firstFresh = 100;
+    TEST_CHECK(scanPageFile(&fh, 0, pages, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, pages), "U: live handle scanned with the new pages");
+    TEST_CHECK(closePageFile(&fh));
+
+    /* A damaged page is reported by the scan */
+    overwrite_bytes(fname, PAGE_SIZE + 321L * PAGE_SIZE + 5, "\x01", 1);
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    scan_check_reset(&c);
+    ASSERT_TRUE(scanPageFile(&fh, 0, pages, scan_check_page, &c, 4) == RC_PAGE_CHECKSUM_MISMATCH,
+                "U: checksum failure returned");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    /* Mapped and compressed handles */
+    fill_scan_file(fname, 0, pages, page);
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_MMAP));
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&fh, 0, pages, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, pages), "U: mapped file scanned");
+    TEST_CHECK(closePageFile(&fh));
+    fill_scan_file(fname, SM_CREATE_COMPRESSED, pages, page);
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    scan_check_reset(&c);
+    TEST_CHECK(scanPageFile(&fh, 0, pages, scan_check_page, &c, 4));
+    ASSERT_TRUE(scan_all_once(&c, 0, pages), "U: compressed file scanned");
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+
+    free(page);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   V) Striped files: pages land round-robin, stripe unit by stripe unit, in
+      the member files; single-page, vectored, logged, snapshot, async and
+      checksummed I/O all follow the layout, which survives reopen; invalid
+      layouts and unsupported open modes are refused.
+   -------------------------------------------------------------------------- */
+/* Does PAGE_SIZE block `index` of a file, read past the storage manager,
+   hold the pattern for seed? */
+static int raw_page_matches(const char *fname, long index, unsigned char seed) {
+    unsigned char buf[PAGE_SIZE], expect[PAGE_SIZE];
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) return 0;
+    int ok = fseek(f, index * PAGE_SIZE, SEEK_SET) == 0 && fread(buf, 1, PAGE_SIZE, f) == PAGE_SIZE;
+    fclose(f);
+    stamp_pattern((SM_PageHandle)expect, seed, 0);
+    return ok && memcmp(buf, expect, PAGE_SIZE) == 0;
+}
+
+static void test_striped_files(void) {
+    const char *fname = "sm_ext_V.bin";
+    char *members[] = {"sm_ext_V.m0", "sm_ext_V.m1", "sm_ext_V.m2"};
+    char *twice[] = {"sm_ext_V.m0", "sm_ext_V.m0"};
+    enum { PAGES = 50, UNIT = 4 };
+    SM_FileHandle fh, snap;
+    SM_Tx *tx;
+
+    testName = "V: striped page files";
+    ASSERT_TRUE(createPageFileStriped((char*)fname, 0, PAGE_SIZE, twice, 2, UNIT) == RC_WRITE_FAILED,
+                "V: duplicate member refused");
+    ASSERT_TRUE(createPageFileStriped((char*)fname, SM_CREATE_COMPRESSED, PAGE_SIZE, members, 3, UNIT)
+                == RC_WRITE_FAILED, "V: compressed striped file refused");
+    ASSERT_TRUE(createPageFileStriped((char*)fname, 0, PAGE_SIZE, members, 3, 0) == RC_WRITE_FAILED,
+                "V: empty stripe unit refused");
+
+    char *extent = (char *)calloc(PAGES, PAGE_SIZE);
+    SM_PageHandle slots[PAGES];
+    ASSERT_TRUE(extent != NULL, "V: extent alloc");
+    for (int p = 0; p < PAGES; ++p) slots[p] = extent + (size_t)p * PAGE_SIZE;
+
+    TEST_CHECK(createPageFileStriped((char*)fname, SM_CREATE_CHECKSUM, PAGE_SIZE, members, 3, UNIT));
+    ASSERT_TRUE(file_bytes(fname) == PAGE_SIZE, "V: page file holds only the header");
+    ASSERT_TRUE(openPageFileEx((char*)fname, &fh, SM_OPEN_MMAP) == RC_FILE_HANDLE_NOT_INIT,
+                "V: SM_OPEN_MMAP refused");
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(ensureCapacity(PAGES, &fh));
+    /* 50 pages = 12 units + 2: members hold 5+4, 4 and 4 units */
+    ASSERT_TRUE(file_bytes(members[0]) == 18L * PAGE_SIZE && file_bytes(members[1]) == 16L * PAGE_SIZE &&
+                file_bytes(members[2]) == 16L * PAGE_SIZE, "V: growth split over the members");
+
+    /* one vectored write of everything, then single-page rewrites */
+    for (int p = 0; p < PAGES; ++p) stamp_pattern(slots[p], (unsigned char)p, 0);
+    int moved = 0;
+    TEST_CHECK(writeBlocks(0, PAGES, &fh, slots, &moved));
+    ASSERT_TRUE(moved == PAGES, "V: vectored write over all members");
+    for (int p = 1; p < PAGES; p += 7) {
+        stamp_pattern(slots[p], (unsigned char)(p + 100), 0);
+        TEST_CHECK(writeBlock(p, &fh, slots[p]));
+    }
+    /* page 13: unit 3 -> member 0, its unit 1, local page 4 + 1 */
+    ASSERT_TRUE(raw_page_matches(members[0], 5, 13), "V: page 13 in member 0 at local page 5");
+    /* page 22 (rewritten): unit 5 -> member 2, its unit 1, local page 4 + 2 */
+    ASSERT_TRUE(raw_page_matches(members[2], 6, 122), "V: page 22 in member 2 at local page 6");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(fh.totalNumPages == PAGES, "V: page count survives reopen");
+    memset(extent, 0, (size_t)PAGES * PAGE_SIZE);
+    TEST_CHECK(readBlocks(0, PAGES, &fh, slots, &moved));
+    int same = moved == PAGES;
+    for (int p = 0; p < PAGES; ++p) {
+        unsigned char expect[PAGE_SIZE];
+        stamp_pattern((SM_PageHandle)expect, (unsigned char)(p % 7 == 1 ? p + 100 : p), 0);
+        same &= memcmp(slots[p], expect, PAGE_SIZE) == 0;
+    }
+    ASSERT_TRUE(same, "V: vectored read reassembles the pages");
+    TEST_CHECK(readBlock(37, &fh, slots[0]));
+    assert_pattern(slots[0], 37, 0, "V: single page read from its member");
+
+    /* a snapshot, then a logged update spanning members */
+    TEST_CHECK(createSnapshot(&fh, &snap));
+    TEST_CHECK(beginTx(&fh, &tx));
+    for (int p = 2; p < 12; p += 3) {
+        stamp_pattern(slots[p], (unsigned char)(p + 50), 0);
+        TEST_CHECK(logPageWrite(tx, p, slots[p]));
+    }
+    TEST_CHECK(commitTx(tx));
+    TEST_CHECK(readBlock(5, &fh, slots[0]));
+    assert_pattern(slots[0], 55, 0, "V: committed page applied");
+    TEST_CHECK(readBlock(5, &snap, slots[0]));
+    assert_pattern(slots[0], 5, 0, "V: snapshot keeps the old page");
+    TEST_CHECK(closePageFile(&snap));
+
+    /* asynchronous I/O goes to the right member too */
+    SM_IOQueue q;
+    TEST_CHECK(initIOQueue(&q, 8, SM_AIO_AUTO));
+    for (int p = 0; p < 16; ++p) stamp_pattern(slots[p], (unsigned char)(p + 200), 19);
+    ASSERT_TRUE(run_async_pass(&q, &fh, extent, 16, 1) == 0, "V: async writes completed");
+    TEST_CHECK(shutdownIOQueue(&q));
+    TEST_CHECK(readBlock(9, &fh, slots[0]));
+    assert_pattern(slots[0], 209, 19, "V: async write read back through readBlock");
+    TEST_CHECK(closePageFile(&fh));
+
+    /* damage inside a member is caught by the checksums */
+    overwrite_bytes(members[1], 3L * PAGE_SIZE + 9, "\x42", 1);
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(readBlock(7, &fh, slots[0]) == RC_PAGE_CHECKSUM_MISMATCH, "V: damaged member page detected");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    ASSERT_TRUE(file_bytes(members[0]) < 0 && file_bytes(members[2]) < 0 &&
+                file_bytes("sm_ext_V.bin.stripe") < 0, "V: members and layout removed with the file");
+    free(extent);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   W) Write-back: writes through an SM_OPEN_WRITEBACK handle stay in its
+      dirty table, readable through every read path, until a sync, a
+      half-full table, the age limit or a call that needs the file writes
+      them out; a burst of neighbouring pages goes out as one write.
+   -------------------------------------------------------------------------- */
+/* Wait (up to 2 s) for data page pageNum of fname to hold seed's pattern. */
+static int disk_page_settles(const char *fname, int pageNum, unsigned char seed) {
+    struct timespec pause = {0, 1000000};
+    for (int waited = 0; waited < 2000; ++waited) {
+        if (raw_page_matches(fname, pageNum + 1L, seed)) return 1;
+        nanosleep(&pause, NULL);
+    }
+    return 0;
+}
+
+static void test_write_back(void) {
+    const char *fname = "sm_ext_W.bin";
+    enum { PAGES = 64 };
+    SM_FileHandle fh, snap;
+    SM_FileStats st;
+    SM_Tx *tx;
+    SM_PageHandle page = allocatePageHandle();
+    char *extent = (char *)calloc(PAGES, PAGE_SIZE);
+    SM_PageHandle slots[PAGES];
+
+    testName = "W: write-back";
+    ASSERT_TRUE(page != NULL && extent != NULL, "W: buffers");
+    for (int p = 0; p < PAGES; ++p) slots[p] = extent + (size_t)p * PAGE_SIZE;
+    TEST_CHECK(createPageFileEx((char*)fname, SM_CREATE_CHECKSUM));
+    ASSERT_TRUE(openPageFileEx((char*)fname, &fh, SM_OPEN_MMAP | SM_OPEN_WRITEBACK) == RC_FILE_HANDLE_NOT_INIT,
+                "W: SM_OPEN_MMAP refused");
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(setWriteBackLimits(&fh, 8, 10) == RC_FILE_HANDLE_NOT_INIT, "W: limits need a write-back handle");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_WRITEBACK | SM_OPEN_READAHEAD));
+    TEST_CHECK(ensureCapacity(PAGES, &fh));
+    ASSERT_TRUE(setWriteBackLimits(&fh, 0, 10) == RC_FILE_HANDLE_NOT_INIT, "W: empty table refused");
+    TEST_CHECK(setWriteBackLimits(&fh, 4 * PAGES, 60000));     /* only a sync writes */
+
+    /* a burst over every page, out of order, ten of them written twice */
+    for (int k = 0; k < PAGES; ++k) {
+        int p = (k * 37) % PAGES;
+        stamp_pattern(page, (unsigned char)p, 0);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    for (int p = 10; p < 20; ++p) stamp_pattern(slots[p], (unsigned char)(p + 100), 0);
+    TEST_CHECK(writeBlocks(10, 10, &fh, slots + 10, NULL));
+    ASSERT_TRUE(!raw_page_matches(fname, 1 + 30, 30), "W: nothing on disk before the flush");
+
+    TEST_CHECK(readBlock(15, &fh, page));
+    assert_pattern(page, 115, 0, "W: readBlock sees the buffered page");
+    memset(extent, 0, (size_t)PAGES * PAGE_SIZE);
+    TEST_CHECK(readBlocks(0, PAGES, &fh, slots, NULL));
+    int same = 1;
+    TEST_CHECK(readFirstBlock(&fh, page));
+    for (int p = 0; p < PAGES; ++p) {
+        unsigned char seed = (unsigned char)((p >= 10 && p < 20) ? p + 100 : p);
+        unsigned char expect[PAGE_SIZE];
+        stamp_pattern((SM_PageHandle)expect, seed, 0);
+        same &= memcmp(slots[p], expect, PAGE_SIZE) == 0;
+        if (p > 0) TEST_CHECK(readNextBlock(&fh, page));
+        same &= memcmp(page, expect, PAGE_SIZE) == 0;
+    }
+    ASSERT_TRUE(same, "W: vectored and cursor reads see the buffered pages");
+
+    TEST_CHECK(syncPageFile(&fh));
+    ASSERT_TRUE(raw_page_matches(fname, 1 + 16, 116) && raw_page_matches(fname, 1 + 63, 63),
+                "W: sync writes the pages out");
+    TEST_CHECK(getPageFileStats(&fh, &st));
+#ifndef SM_NO_STATS
+    ASSERT_TRUE(st.writebackPages == PAGES && st.writebackRuns == 1,
+                "W: the whole burst goes out as one vectored write");
+#endif
+
+    /* size threshold: an 8-page table writes itself out */
+    TEST_CHECK(setWriteBackLimits(&fh, 8, 60000));
+    for (int p = 0; p < 32; ++p) {
+        stamp_pattern(page, (unsigned char)(p + 1), 0);
+        TEST_CHECK(writeBlock(p, &fh, page));
+    }
+    ASSERT_TRUE(disk_page_settles(fname, 0, 1), "W: a half-full table is written without a sync");
+
+    /* age limit */
+    TEST_CHECK(setWriteBackLimits(&fh, 64, 20));
+    stamp_pattern(page, 77, 0);
+    TEST_CHECK(writeBlock(40, &fh, page));
+    ASSERT_TRUE(disk_page_settles(fname, 40, 77), "W: an old page is written out by age");
+
+    /* calls that reach the file another way see buffered writes first */
+    TEST_CHECK(setWriteBackLimits(&fh, 64, 60000));
+    stamp_pattern(page, 200, 0);
+    TEST_CHECK(writeBlock(3, &fh, page));
+    TEST_CHECK(createSnapshot(&fh, &snap));
+    TEST_CHECK(readBlock(3, &snap, page));
+    assert_pattern(page, 200, 0, "W: snapshot includes a buffered write");
+    TEST_CHECK(closePageFile(&snap));
+
+    stamp_pattern(page, 201, 0);
+    TEST_CHECK(writeBlock(4, &fh, page));
+    TEST_CHECK(beginTx(&fh, &tx));
+    stamp_pattern(page, 202, 0);
+    TEST_CHECK(logPageWrite(tx, 5, page));
+    TEST_CHECK(commitTx(tx));
+    stamp_pattern(page, 203, 0);
+    TEST_CHECK(writeBlock(6, &fh, page));
+    TEST_CHECK(freePage(&fh, 6));
+    stamp_pattern(page, 204, 0);
+    TEST_CHECK(writeBlock(7, &fh, page));
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    TEST_CHECK(readBlocks(0, PAGES, &fh, slots, NULL));
+    assert_pattern(slots[4], 201, 0, "W: buffered write survives a transaction");
+    assert_pattern(slots[5], 202, 0, "W: committed page applied");
+    ASSERT_TRUE(slots[6][0] == 0 && memcmp(slots[6], slots[6] + 1, PAGE_SIZE - 1) == 0,
+                "W: a freed page is not overwritten by its buffered write");
+    assert_pattern(slots[7], 204, 0, "W: close writes the table out");
+    assert_pattern(slots[40], 77, 0, "W: aged page kept");
+    TEST_CHECK(closePageFile(&fh));
+
+    TEST_CHECK(destroyPageFile((char*)fname));
+    freePageHandle(page);
+    free(extent);
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   X) Page latches: an exclusive latch holds off every other latch of its
+      page, shared ones coexist, other pages stay free, and latches taken
+      through one handle hold off the file's other handles; on an
+      SM_OPEN_LATCHED handle reads never see a half-written page and
+      appendEmptyBlock runs alongside reads and writes.
+   -------------------------------------------------------------------------- */
+typedef struct LatchProbe {
+    SM_FileHandle *fh;
+    int page;
+    SM_LatchMode mode;
+    int viaCall;            /* 1: readBlock (shared) or writeBlock (exclusive),
+                               2: readNextBlock, on a latched handle instead
+                               of latchPage */
+    int got;                /* set once the latch (or the read) went through */
+} LatchProbe;
+
+static void *latch_probe(void *arg) {
+    LatchProbe *p = (LatchProbe *)arg;
+    SM_PageHandle page = allocatePageHandle();
+    RC rc = !p->viaCall ? latchPage(p->fh, p->page, p->mode)
+          : (p->viaCall == 2) ? readNextBlock(p->fh, page)
+          : (p->mode == SM_LATCH_EXCLUSIVE) ? writeBlock(p->page, p->fh, page)
+          : readBlock(p->page, p->fh, page);
+    if (rc == RC_OK) __atomic_store_n(&p->got, 1, __ATOMIC_RELEASE);
+    if (rc == RC_OK && !p->viaCall) unlatchPage(p->fh, p->page, p->mode);
+    freePageHandle(page);
+    return NULL;
+}
+
+/* Start a probe and report whether it got through within 20 ms. */
+static int probe_passes(LatchProbe *p, pthread_t *tid) {
+    struct timespec pause = {0, 20000000};
+    pthread_create(tid, NULL, latch_probe, p);
+    nanosleep(&pause, NULL);
+    return __atomic_load_n(&p->got, __ATOMIC_ACQUIRE);
+}
+
+typedef struct LatchWorker {
+    SM_FileHandle *fh;
+    int id;                 /* 0, 1: writers; 2, 3: readers; 4: appends */
+    int torn;
+    RC rc;
+} LatchWorker;
+
+static void *latch_worker(void *arg) {
+    LatchWorker *w = (LatchWorker *)arg;
+    SM_PageHandle page = allocatePageHandle();
+    for (int i = 0; i < 400 && w->rc == RC_OK; ++i) {
+        if (w->id < 2) {
+            memset(page, w->id * 64 + i % 64, PAGE_SIZE);
+            w->rc = writeBlock(i % 4, w->fh, page);
+        } else if (w->id < 4) {
+            w->rc = readBlock(i % 4, w->fh, page);
+            if (memcmp(page, page + 1, PAGE_SIZE - 1) != 0) w->torn++;
+        } else if (i % 8 == 0) {
+            w->rc = appendEmptyBlock(w->fh);
+        }
+    }
+    freePageHandle(page);
+    return NULL;
+}
+
+static void test_page_latches(void) {
+    const char *fname = "sm_ext_X.bin";
+    SM_FileHandle fh;
+    pthread_t tid;
+
+    testName = "X: page latches";
+    TEST_CHECK(createPageFile((char*)fname));
+    TEST_CHECK(openPageFile((char*)fname, &fh));
+    ASSERT_TRUE(unlatchPage(&fh, 5, SM_LATCH_SHARED) == RC_PAGE_NOT_LATCHED, "X: unlatching a free latch refused");
+    ASSERT_TRUE(latchPage(&fh, -1, SM_LATCH_SHARED) == RC_FILE_HANDLE_NOT_INIT, "X: negative page refused");
+
+    TEST_CHECK(latchPage(&fh, 5, SM_LATCH_EXCLUSIVE));
+    ASSERT_TRUE(unlatchPage(&fh, 5, SM_LATCH_SHARED) == RC_PAGE_NOT_LATCHED, "X: wrong mode refused");
+    LatchProbe blocked = {&fh, 5, SM_LATCH_SHARED, 0, 0};
+    ASSERT_TRUE(!probe_passes(&blocked, &tid), "X: shared latch waits for the exclusive holder");
+    LatchProbe other = {&fh, 6, SM_LATCH_EXCLUSIVE, 0, 0};
+    pthread_t tid2;
+    ASSERT_TRUE(probe_passes(&other, &tid2), "X: the next page is not held up");
+    pthread_join(tid2, NULL);
+    TEST_CHECK(unlatchPage(&fh, 5, SM_LATCH_EXCLUSIVE));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(blocked.got, "X: waiter proceeds after unlatch");
+
+    TEST_CHECK(latchPage(&fh, 7, SM_LATCH_SHARED));
+    LatchProbe sharer = {&fh, 7, SM_LATCH_SHARED, 0, 0};
+    ASSERT_TRUE(probe_passes(&sharer, &tid), "X: shared latches coexist");
+    pthread_join(tid, NULL);
+    LatchProbe writer = {&fh, 7, SM_LATCH_EXCLUSIVE, 0, 0};
+    ASSERT_TRUE(!probe_passes(&writer, &tid), "X: exclusive latch waits for readers");
+    TEST_CHECK(unlatchPage(&fh, 7, SM_LATCH_SHARED));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(writer.got, "X: writer proceeds after the last reader");
+    TEST_CHECK(closePageFile(&fh));
+
+    /* automatic latching */
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_LATCHED));
+    TEST_CHECK(ensureCapacity(4, &fh));
+    TEST_CHECK(latchPage(&fh, 2, SM_LATCH_EXCLUSIVE));
+    LatchProbe reader = {&fh, 2, SM_LATCH_SHARED, 1, 0};
+    ASSERT_TRUE(!probe_passes(&reader, &tid), "X: readBlock waits for a latchPage holder");
+    TEST_CHECK(unlatchPage(&fh, 2, SM_LATCH_EXCLUSIVE));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(reader.got, "X: readBlock proceeds after unlatch");
+
+    /* the latches are the file's: a latch taken through another handle
+       holds off this one's writes */
+    SM_FileHandle second;
+    TEST_CHECK(openPageFile((char*)fname, &second));
+    TEST_CHECK(latchPage(&second, 3, SM_LATCH_EXCLUSIVE));
+    LatchProbe writer2 = {&fh, 3, SM_LATCH_EXCLUSIVE, 1, 0};
+    ASSERT_TRUE(!probe_passes(&writer2, &tid), "X: writeBlock waits for another handle's latch");
+    TEST_CHECK(unlatchPage(&second, 3, SM_LATCH_EXCLUSIVE));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(writer2.got, "X: writeBlock proceeds after the other handle unlatches");
+    TEST_CHECK(closePageFile(&second));
+
+    LatchWorker w[5];
+    pthread_t tids[5];
+    for (int i = 0; i < 5; ++i) {
+        w[i] = (LatchWorker){&fh, i, 0, RC_OK};
+        pthread_create(&tids[i], NULL, latch_worker, &w[i]);
+    }
+    int torn = 0, failed = 0;
+    for (int i = 0; i < 5; ++i) {
+        pthread_join(tids[i], NULL);
+        torn += w[i].torn;
+        failed |= w[i].rc != RC_OK;
+    }
+    ASSERT_TRUE(!failed, "X: concurrent reads, writes and appends succeed");
+    ASSERT_TRUE(torn == 0, "X: no read saw a half-written page");
+    ASSERT_TRUE(fh.totalNumPages == 4 + 50, "X: every append counted");
+    TEST_CHECK(closePageFile(&fh));
+
+    /* cursor reads served from the read-ahead buffer latch too */
+    TEST_CHECK(openPageFileEx((char*)fname, &fh, SM_OPEN_LATCHED | SM_OPEN_READAHEAD));
+    SM_PageHandle buf = allocatePageHandle();
+    TEST_CHECK(readFirstBlock(&fh, buf));
+    TEST_CHECK(readNextBlock(&fh, buf));
+    TEST_CHECK(readNextBlock(&fh, buf));        /* page 2: buffer refilled */
+    TEST_CHECK(latchPage(&fh, 3, SM_LATCH_EXCLUSIVE));
+    LatchProbe cursor = {&fh, 3, SM_LATCH_SHARED, 2, 0};
+    ASSERT_TRUE(!probe_passes(&cursor, &tid), "X: buffered cursor read waits for the page latch");
+    TEST_CHECK(unlatchPage(&fh, 3, SM_LATCH_EXCLUSIVE));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(cursor.got, "X: buffered cursor read proceeds after unlatch");
+    /* a new scan from page 20: its second step refills from page 22 on */
+    TEST_CHECK(readBlock(20, &fh, buf));
+    TEST_CHECK(readNextBlock(&fh, buf));
+    TEST_CHECK(latchPage(&fh, 25, SM_LATCH_EXCLUSIVE));
+    LatchProbe refill = {&fh, 22, SM_LATCH_SHARED, 2, 0};
+    ASSERT_TRUE(!probe_passes(&refill, &tid), "X: refill waits for a latched page it reads");
+    TEST_CHECK(unlatchPage(&fh, 25, SM_LATCH_EXCLUSIVE));
+    pthread_join(tid, NULL);
+    ASSERT_TRUE(refill.got && fh.curPagePos == 22, "X: refill proceeds after unlatch");
+    freePageHandle(buf);
+    TEST_CHECK(closePageFile(&fh));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    TEST_DONE();
+}
+
+/* --------------------------------------------------------------------------
+   Y) Shared open files: handles on one file (under any path) share its
+      descriptor, page count and statistics; the descriptor closes with
+      the last handle, and an open file cannot be re-created. Commits
+      through two handles go to one log, and recovery replays all of them.
+   -------------------------------------------------------------------------- */
+/* Descriptors open in the process, -1 where /proc is unavailable. */
+static int open_fds(void) {
+    DIR *d = opendir("/proc/self/fd");
+    if (d == NULL) return -1;
+    int n = 0;
+    while (readdir(d) != NULL) n++;
+    closedir(d);
+    return n;
+}
+
+/* Commit through two handles on one file, lose the in-place writes and exit
+   without closing; returns nonzero if a call failed. */
+static int crash_after_shared_commits(const char *fname, const char *wname, SM_PageHandle page) {
+    SM_FileHandle a, b;
+    SM_Tx *tx;
+    int bad = 0;
+
+    bad |= openPageFile((char*)fname, &a);
+    bad |= beginTx(&a, &tx);
+    stamp_pattern(page, 1, 5);
+    bad |= logPageWrite(tx, 1, page);
+    bad |= commitTx(tx);
+
+    /* the second open finds the log live: it must neither replay nor empty it */
+    long logged = file_bytes(wname);
+    bad |= openPageFile((char*)fname, &b);
+    bad |= file_bytes(wname) != logged;
+    bad |= beginTx(&b, &tx);
+    stamp_pattern(page, 2, 5);
+    bad |= logPageWrite(tx, 2, page);
+    bad |= commitTx(tx);
+    bad |= beginTx(&a, &tx);
+    stamp_pattern(page, 3, 5);
+    bad |= logPageWrite(tx, 3, page);
+    bad |= commitTx(tx);
+
+    for (int p = 1; p <= 3; ++p) {
+        stamp_pattern(page, (unsigned char)p, 0);
+        bad |= writeBlock(p, &b, page);
+    }
+    return bad;
+}
+
+static void test_shared_open_files(void) {
+    const char *fname = "sm_ext_Y.bin";
+    const char *alias = "./sm_ext_Y.bin";
+    const char *wname = "sm_ext_Y.bin.wal";
+    SM_FileHandle a, b, c;
+    SM_FileStats st;
+    SM_PageHandle page = allocatePageHandle();
+
+    testName = "Y: shared open files";
+    TEST_CHECK(createPageFile((char*)fname));
+    int before = open_fds();
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    int one = open_fds();
+    TEST_CHECK(openPageFile((char*)alias, &b));
+    TEST_CHECK(openPageFile((char*)fname, &c));
+    ASSERT_TRUE(before < 0 || (one == before + 1 && open_fds() == one),
+                "Y: three handles, one descriptor");
+
+    /* growth through one handle is seen by the others at their next call */
+    TEST_CHECK(ensureCapacity(10, &a));
+    memset(page, 'y', PAGE_SIZE);
+    TEST_CHECK(writeBlock(9, &a, page));
+    memset(page, 0, PAGE_SIZE);
+    TEST_CHECK(readBlock(9, &b, page));
+    ASSERT_TRUE(page[0] == 'y' && page[PAGE_SIZE - 1] == 'y', "Y: other handle reads the new page");
+    ASSERT_TRUE(b.totalNumPages == 10, "Y: other handle follows the page count");
+    TEST_CHECK(appendEmptyBlock(&c));
+    ASSERT_TRUE(c.totalNumPages == 11, "Y: append lands after the other handle's growth");
+    TEST_CHECK(readLastBlock(&a, page));
+    ASSERT_TRUE(a.totalNumPages == 11 && a.curPagePos == 10, "Y: first handle sees the append");
+
+    /* statistics are per file */
+#ifndef SM_NO_STATS
+    TEST_CHECK(getPageFileStats(&c, &st));
+    ASSERT_TRUE(st.writes == 1 && st.reads == 2 && st.appends == 10,
+                "Y: counters gather every handle's calls");
+#endif
+
+    ASSERT_TRUE(createPageFile((char*)fname) == RC_WRITE_FAILED, "Y: open file not re-created");
+
+    /* the descriptor outlives all but the last handle */
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(closePageFile(&c));
+    ASSERT_TRUE(before < 0 || open_fds() == one, "Y: descriptor kept for the last handle");
+    TEST_CHECK(readBlock(9, &b, page));
+    ASSERT_TRUE(page[0] == 'y', "Y: last handle still reads");
+    TEST_CHECK(closePageFile(&b));
+    ASSERT_TRUE(before < 0 || open_fds() == before, "Y: descriptor closed with the last handle");
+
+    /* a fresh open reads the count back, and the counters start over */
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    ASSERT_TRUE(a.totalNumPages == 11, "Y: page count persisted");
+    TEST_CHECK(getPageFileStats(&a, &st));
+    ASSERT_TRUE(st.reads == 0 && st.writes == 0, "Y: counters start with the first open");
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(createPageFile((char*)fname));
+
+    /* one log for both handles: every commit survives a crash */
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    TEST_CHECK(ensureCapacity(4, &a));
+    TEST_CHECK(closePageFile(&a));
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(crash_after_shared_commits(fname, wname, page) ? 1 : 0);
+    int status = -1;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Y: both handles committed");
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    for (int p = 1; p <= 3; ++p) {
+        TEST_CHECK(readBlock(p, &a, page));
+        assert_pattern(page, (unsigned char)p, 5, "Y: commits of both handles replayed");
+    }
+
+    /* one free-space map: a page freed through one handle is reused by another */
+    TEST_CHECK(openPageFile((char*)alias, &b));
+    TEST_CHECK(freePage(&a, 2));
+    ASSERT_TRUE(freePage(&b, 2) == RC_PAGE_ALREADY_FREE, "Y: free seen by the other handle");
+    int got = -1;
+    TEST_CHECK(allocatePage(&b, &got));
+    ASSERT_TRUE(got == 2, "Y: other handle reuses the freed page");
+    TEST_CHECK(allocatePage(&a, &got));
+    ASSERT_TRUE(got == 4 && a.totalNumPages == 5, "Y: reused page not handed out twice");
+    TEST_CHECK(freePage(&b, 3));
+    TEST_CHECK(closePageFile(&b));
+    TEST_CHECK(allocatePage(&a, &got));
+    ASSERT_TRUE(got == 3, "Y: page freed through a closed handle still reused");
+    TEST_CHECK(closePageFile(&a));
+
+    /* one checksum table: pages written or added through one handle verify
+       through the other */
+    TEST_CHECK(createPageFileEx((char*)fname, SM_CREATE_CHECKSUM));
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    TEST_CHECK(ensureCapacity(4, &a));
+    TEST_CHECK(openPageFile((char*)alias, &b));
+    memset(page, 'c', PAGE_SIZE);
+    TEST_CHECK(writeBlock(1, &a, page));
+    TEST_CHECK(readBlock(1, &b, page));
+    ASSERT_TRUE(page[0] == 'c', "Y: rewritten page verifies through the other handle");
+    TEST_CHECK(ensureCapacity(40, &b));
+    TEST_CHECK(writeBlock(39, &b, page));
+    TEST_CHECK(readBlock(39, &a, page));
+    ASSERT_TRUE(page[0] == 'c', "Y: page past the first handle's growth verifies");
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(closePageFile(&b));
+
+    /* a compressed file's slot allocator is the handle's own */
+    TEST_CHECK(createPageFileEx((char*)fname, SM_CREATE_COMPRESSED));
+    TEST_CHECK(openPageFile((char*)fname, &a));
+    ASSERT_TRUE(openPageFile((char*)alias, &b) == RC_FILE_HANDLE_NOT_INIT,
+                "Y: second handle on a compressed file refused");
+    TEST_CHECK(closePageFile(&a));
+    TEST_CHECK(openPageFile((char*)alias, &b));
+    TEST_CHECK(closePageFile(&b));
+    TEST_CHECK(destroyPageFile((char*)fname));
+    freePageHandle(page);
+    TEST_DONE();
+}
+
 /* --------------------------------------------------------------------------
    Simple runner
    -------------------------------------------------------------------------- */
@@ -147,6 +2198,29 @@ static int run_extended_suites(void) {
     /* Execute our distinct tests */
     test_capacity_jump_and_tail_io();
     test_append_growth_and_random_access();
+    test_buffer_pool_policies();
+    test_concurrent_positional_reads();
+    test_mapped_page_access();
+    test_vectored_page_ranges();
+    test_async_queue();
+    test_direct_io();
+    test_durability_modes();
+    test_thread_local_errors();
+    test_readahead_scans();
+    test_page_checksums();
+    test_compressed_files();
+    test_file_stats();
+    test_file_header();
+    test_free_space_map();
+    test_sparse_pages();
+    test_write_ahead_log();
+    test_snapshots();
+    test_page_sizes();
+    test_parallel_scans();
+    test_striped_files();
+    test_write_back();
+    test_page_latches();
+    test_shared_open_files();
     return 0;
 }
 
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE     /* syscall() under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* --------------------------------------------------------------------------
+   Page latches
+
+   Page n is guarded by latch n % SM_LATCH_STRIPES of its file, so
+   neighbouring pages never share one. The table hangs off the shared
+   registry entry: a latch taken through one handle holds off every other
+   handle on the file. Each latch is one 32-bit word on a
+   cache line of its own: a reader count, a bit for the writer holding it,
+   a bit asking new readers to hold back while a writer waits, and a bit
+   saying someone sleeps on the word. Waiters spin for a while and then
+   sleep on the word (a futex on Linux, short naps elsewhere); a release
+   that sees the sleeper bit clears it and wakes everyone to try again.
+   -------------------------------------------------------------------------- */
+
+#define LATCH_WRITER    0x80000000u
+#define LATCH_WANTED    0x40000000u     /* a writer is waiting */
+#define LATCH_SLEEPERS  0x20000000u
+#define LATCH_READERS   0x1FFFFFFFu
+
+/* Failed attempts before a waiter goes to sleep. */
+#define LATCH_SPINS 128
+
+typedef struct SM_Latch {
+    _Alignas(64) uint32_t state;
+} SM_Latch;
+
+struct SM_LatchTable {
+    SM_Latch latch[SM_LATCH_STRIPES];
+};
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Sleep while the word still reads `seen`. */
+static void latch_sleep(uint32_t *word, uint32_t seen) {
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+#else
+    (void)word; (void)seen;
+    struct timespec nap = {0, 50000};
+    nanosleep(&nap, NULL);
+#endif
+}
+
+static void latch_wake(uint32_t *word) {
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+/* One unsuccessful round: spin a little, and eventually sleep on the word
+   after announcing it. Returns the updated spin count. */
+static int latch_wait(uint32_t *word, uint32_t seen, int spins) {
+    if (spins < LATCH_SPINS) {
+        cpu_relax();
+        return spins + 1;
+    }
+    if (!(seen & LATCH_SLEEPERS)) {
+        if (!__atomic_compare_exchange_n(word, &seen, seen | LATCH_SLEEPERS, 0,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return spins;       /* changed under us: look again */
+        seen |= LATCH_SLEEPERS;
+    }
+    latch_sleep(word, seen);
+    return 0;
+}
+
+static void acquire_shared(SM_Latch *l) {
+    int spins = 0;
+    for (;;) {
+        uint32_t s = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+        if (!(s & (LATCH_WRITER | LATCH_WANTED))) {
+            if (__atomic_compare_exchange_n(&l->state, &s, s + 1, 1,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        spins = latch_wait(&l->state, s, spins);
+    }
+}
+
+static void acquire_exclusive(SM_Latch *l) {
+    int spins = 0;
+    for (;;) {
+        uint32_t s = __atomic_load_n(&l->state, __ATOMIC_RELAXED);
+        if (!(s & (LATCH_WRITER | LATCH_READERS))) {
+            /* clears WANTED: other waiting writers set it again */
+            if (__atomic_compare_exchange_n(&l->state, &s, (s & LATCH_SLEEPERS) | LATCH_WRITER, 1,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        if (!(s & LATCH_WANTED)) {
+            __atomic_fetch_or(&l->state, LATCH_WANTED, __ATOMIC_RELAXED);
+            continue;
+        }
+        spins = latch_wait(&l->state, s, spins);
+    }
+}
+
+static void release_shared(SM_Latch *l) {
+    uint32_t s = __atomic_sub_fetch(&l->state, 1, __ATOMIC_RELEASE);
+    if ((s & LATCH_READERS) == 0 && (s & LATCH_SLEEPERS) &&
+        (__atomic_fetch_and(&l->state, ~LATCH_SLEEPERS, __ATOMIC_RELAXED) & LATCH_SLEEPERS))
+        latch_wake(&l->state);
+}
+
+static void release_exclusive(SM_Latch *l) {
+    uint32_t s = __atomic_fetch_and(&l->state, ~(LATCH_WRITER | LATCH_SLEEPERS), __ATOMIC_RELEASE);
+    if (s & LATCH_SLEEPERS)
+        latch_wake(&l->state);
+}
+
+/* The table of a file, created by whichever thread needs it first. */
+static SM_LatchTable *table_of(SM_Internal *meta) {
+    SM_SharedFile *sf = meta->shared;
+    SM_LatchTable *t = __atomic_load_n(&sf->latches, __ATOMIC_ACQUIRE);
+    if (t != NULL) return t;
+    SM_LatchTable *fresh;
+    if (posix_memalign((void **)&fresh, 64, sizeof *fresh) != 0) return NULL;
+    memset(fresh, 0, sizeof *fresh);
+    if (!__atomic_compare_exchange_n(&sf->latches, &t, fresh, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(fresh);
+        return t;
+    }
+    return fresh;
+}
+
+static SM_Latch *latch_of(SM_LatchTable *t, int pageNum) {
+    return &t->latch[(unsigned)pageNum % SM_LATCH_STRIPES];
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c (storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_latch_page(SM_Internal *meta, int pageNum, int exclusive) {
+    SM_LatchTable *t = table_of(meta);
+    if (t == NULL) {
+        RC_message = "out of memory for page latches";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (exclusive) acquire_exclusive(latch_of(t, pageNum));
+    else           acquire_shared(latch_of(t, pageNum));
+    return RC_OK;
+}
+
+RC sm_unlatch_page(SM_Internal *meta, int pageNum, int exclusive) {
+    SM_LatchTable *t = __atomic_load_n(&meta->shared->latches, __ATOMIC_ACQUIRE);
+    SM_Latch *l = (t != NULL) ? latch_of(t, pageNum) : NULL;
+    uint32_t s = (l != NULL) ? __atomic_load_n(&l->state, __ATOMIC_RELAXED) : 0;
+    if (exclusive ? !(s & LATCH_WRITER) : (s & LATCH_READERS) == 0) {
+        RC_message = "page is not latched in that mode";
+        return RC_PAGE_NOT_LATCHED;
+    }
+    if (exclusive) release_exclusive(l);
+    else           release_shared(l);
+    return RC_OK;
+}
+
+/* Latches covering pages [first, first+count), each once and in table
+   order, so that callers latching overlapping ranges cannot deadlock. */
+static void range_stripes(int first, int count, uint64_t *bits) {
+    memset(bits, 0, SM_LATCH_STRIPES / 8);
+    if (count > SM_LATCH_STRIPES) count = SM_LATCH_STRIPES;
+    for (int i = 0; i < count; ++i) {
+        unsigned k = (unsigned)(first + i) % SM_LATCH_STRIPES;
+        bits[k / 64] |= 1ull << (k % 64);
+    }
+}
+
+RC sm_latch_range(SM_Internal *meta, int first, int count, int exclusive) {
+    SM_LatchTable *t = table_of(meta);
+    if (t == NULL) {
+        RC_message = "out of memory for page latches";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (count == 1) {
+        if (exclusive) acquire_exclusive(latch_of(t, first));
+        else           acquire_shared(latch_of(t, first));
+        return RC_OK;
+    }
+    uint64_t bits[SM_LATCH_STRIPES / 64];
+    range_stripes(first, count, bits);
+    for (int w = 0; w < SM_LATCH_STRIPES / 64; ++w) {
+        for (uint64_t b = bits[w]; b != 0; b &= b - 1) {
+            SM_Latch *l = &t->latch[w * 64 + __builtin_ctzll(b)];
+            if (exclusive) acquire_exclusive(l);
+            else           acquire_shared(l);
+        }
+    }
+    return RC_OK;
+}
+
+void sm_unlatch_range(SM_Internal *meta, int first, int count, int exclusive) {
+    SM_LatchTable *t = meta->shared->latches;
+    if (count == 1) {
+        if (exclusive) release_exclusive(latch_of(t, first));
+        else           release_shared(latch_of(t, first));
+        return;
+    }
+    uint64_t bits[SM_LATCH_STRIPES / 64];
+    range_stripes(first, count, bits);
+    for (int w = 0; w < SM_LATCH_STRIPES / 64; ++w) {
+        for (uint64_t b = bits[w]; b != 0; b &= b - 1) {
+            SM_Latch *l = &t->latch[w * 64 + __builtin_ctzll(b)];
+            if (exclusive) release_exclusive(l);
+            else           release_shared(l);
+        }
+    }
+}
+
+void sm_latch_free(SM_SharedFile *sf) {
+    free(sf->latches);
+    sf->latches = NULL;
+}
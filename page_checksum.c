@@ -0,0 +1,123 @@
+#include "page_checksum.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC_HAVE_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC_HAVE_ARMV8 1
+#endif
+
+/* Reflected CRC32C polynomial. */
+#define CRC32C_POLY 0x82F63B78u
+
+/* --------------------------------------------------------------------------
+   Slicing-by-8 tables (built once)
+   -------------------------------------------------------------------------- */
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void build_tables(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+        for (int t = 1; t < 8; ++t)
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xFF];
+}
+
+uint32_t crc32cPortable(uint32_t crc, const void *buf, size_t len) {
+    pthread_once(&crc_table_once, build_tables);
+    const unsigned char *p = (const unsigned char *)buf;
+    crc = ~crc;
+
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);          /* assumes a little-endian host */
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+/* --------------------------------------------------------------------------
+   Hardware paths
+   -------------------------------------------------------------------------- */
+#if defined(CRC_HAVE_SSE42)
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return ~c32;
+}
+
+int crc32cHasHardware(void) {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(CRC_HAVE_ARMV8)
+
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        c = __crc32cb(c, *p++);
+    return ~c;
+}
+
+int crc32cHasHardware(void) {
+    return 1;
+}
+
+#else
+
+int crc32cHasHardware(void) {
+    return 0;
+}
+
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+#if defined(CRC_HAVE_SSE42) || defined(CRC_HAVE_ARMV8)
+    static int hw = -1;
+    int use = __atomic_load_n(&hw, __ATOMIC_RELAXED);
+    if (use < 0) {
+        use = crc32cHasHardware();
+        __atomic_store_n(&hw, use, __ATOMIC_RELAXED);
+    }
+    if (use) return crc32c_hw(crc, buf, len);
+#endif
+    return crc32cPortable(crc, buf, len);
+}
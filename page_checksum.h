@@ -0,0 +1,21 @@
+#ifndef PAGE_CHECKSUM_H
+#define PAGE_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* CRC32C (Castagnoli). Pass 0 as crc to start; feed the result back in to
+   continue over more data. Uses the SSE4.2 / ARMv8 CRC instruction when the
+   CPU has it, slicing-by-8 tables otherwise. */
+extern uint32_t crc32c (uint32_t crc, const void *buf, size_t len);
+
+/* the table-driven path, always available (for comparison and tests) */
+extern uint32_t crc32cPortable (uint32_t crc, const void *buf, size_t len);
+
+/* non-zero when crc32c runs on a hardware CRC instruction */
+extern int crc32cHasHardware (void);
+
+#endif
@@ -0,0 +1,156 @@
+#include "page_compress.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------------
+   Format
+
+   A compressed block is a run of sequences:
+     token      high nibble: literal count, low nibble: match length - 4
+                (15 in either means "more length bytes follow", each adding
+                0..255, a byte below 255 ending the run)
+     literals
+     offset     2 bytes little-endian, 1..65535 bytes back
+     match length bytes (if the low nibble was 15)
+   The last sequence stops after its literals.
+   -------------------------------------------------------------------------- */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static unsigned hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Append the 255-continued tail of a length; NULL when out of room. */
+static unsigned char *put_length(unsigned char *op, const unsigned char *oend, size_t len) {
+    for (;;) {
+        if (op >= oend) return NULL;
+        if (len < 255) {
+            *op++ = (unsigned char)len;
+            return op;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+}
+
+/* Emit one sequence; matchLen 0 emits the final literals-only one. */
+static unsigned char *emit(unsigned char *op, const unsigned char *oend,
+                           const unsigned char *lit, size_t litLen,
+                           size_t offset, size_t matchLen) {
+    size_t ml = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+    if (op >= oend) return NULL;
+    unsigned char *token = op++;
+    *token = (unsigned char)(((litLen < 15 ? litLen : 15) << 4) | (ml < 15 ? ml : 15));
+
+    if (litLen >= 15 && (op = put_length(op, oend, litLen - 15)) == NULL) return NULL;
+    if ((size_t)(oend - op) < litLen) return NULL;
+    memcpy(op, lit, litLen);
+    op += litLen;
+    if (matchLen == 0) return op;
+
+    if (oend - op < 2) return NULL;
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+    if (ml >= 15 && (op = put_length(op, oend, ml - 15)) == NULL) return NULL;
+    return op;
+}
+
+/* Read the 255-continued tail of a length; 0 on truncated input. */
+static int get_length(const unsigned char **ip, const unsigned char *iend, size_t *len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return 0;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+/* --------------------------------------------------------------------------
+   Public API
+   -------------------------------------------------------------------------- */
+
+size_t pageCompress(const void *src, size_t srcLen, void *dst, size_t dstCap) {
+    const unsigned char *in = (const unsigned char *)src;
+    const unsigned char *iend = in + srcLen;
+    const unsigned char *ip = in, *anchor = in;
+    unsigned char *op = (unsigned char *)dst;
+    const unsigned char *oend = op + dstCap;
+
+    /* positions are candidates only; every hit is re-checked, so stale or
+       zero-initialized entries cost a compare, never a wrong match */
+    uint32_t table[1u << LZ_HASH_BITS];
+    memset(table, 0, sizeof table);
+
+    while (srcLen >= LZ_MIN_MATCH && ip <= iend - LZ_MIN_MATCH) {
+        uint32_t v = read32(ip);
+        unsigned h = hash4(v);
+        const unsigned char *ref = in + table[h];
+        table[h] = (uint32_t)(ip - in);
+
+        if (ref >= ip || (size_t)(ip - ref) > LZ_MAX_OFFSET || read32(ref) != v) {
+            ip += 1 + ((size_t)(ip - anchor) >> 6);     /* skip faster over noise */
+            continue;
+        }
+        const unsigned char *mp = ip + LZ_MIN_MATCH;
+        const unsigned char *rp = ref + LZ_MIN_MATCH;
+        while (mp < iend && *mp == *rp) {
+            mp++;
+            rp++;
+        }
+        op = emit(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), (size_t)(mp - ip));
+        if (op == NULL) return 0;
+        ip = anchor = mp;
+    }
+
+    op = emit(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    return (op == NULL) ? 0 : (size_t)(op - (unsigned char *)dst);
+}
+
+size_t pageDecompress(const void *src, size_t srcLen, void *dst, size_t dstCap) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + srcLen;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    const unsigned char *oend = out + dstCap;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && !get_length(&ip, iend, &lit)) return (size_t)-1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return (size_t)-1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break;                      /* final sequence */
+
+        if (iend - ip < 2) return (size_t)-1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t ml = token & 15;
+        if (ml == 15 && !get_length(&ip, iend, &ml)) return (size_t)-1;
+        ml += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || ml > (size_t)(oend - op))
+            return (size_t)-1;
+
+        const unsigned char *m = op - offset;
+        if (offset >= ml) {
+            memcpy(op, m, ml);
+            op += ml;
+        } else {
+            while (ml--) *op++ = *m++;              /* overlapping run */
+        }
+    }
+    return (size_t)(op - out);
+}
@@ -0,0 +1,20 @@
+#ifndef PAGE_COMPRESS_H
+#define PAGE_COMPRESS_H
+
+#include <stddef.h>
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* Byte-oriented LZ77 codec used for compressed page files: literal runs
+   and back-references (up to 64 KiB back) behind one-byte tokens. */
+
+/* compress srcLen bytes into at most dstCap bytes; returns the compressed
+   length, or 0 when the result would not fit (store the data raw instead) */
+extern size_t pageCompress (const void *src, size_t srcLen, void *dst, size_t dstCap);
+
+/* decompress into at most dstCap bytes; returns the decompressed length,
+   or (size_t)-1 when the input is malformed */
+extern size_t pageDecompress (const void *src, size_t srcLen, void *dst, size_t dstCap);
+
+#endif
@@ -0,0 +1,236 @@
+#define _GNU_SOURCE     /* sysconf(_SC_NPROCESSORS_ONLN) under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* --------------------------------------------------------------------------
+   Parallel range scans
+
+   The range is cut into chunks of SCAN_CHUNK_PAGES pages, each read with
+   one vectored call. Every worker starts out owning an equal, contiguous
+   run of chunks and takes them from the front, so its reads stay
+   sequential. A worker whose run is used up steals the back half of the
+   largest remaining run, so a slow callback on some pages holds up only
+   the worker that has them.
+   -------------------------------------------------------------------------- */
+
+/* Pages read per call; also the smallest unit a thief takes. */
+#define SCAN_CHUNK_PAGES 32
+
+/* Workers used when the caller passes nThreads <= 0 and the CPU count is unknown. */
+#define SCAN_DEFAULT_THREADS 4
+
+typedef struct ScanWorker {
+    pthread_mutex_t lock;
+    int next, end;              /* chunks [next, end) still owned */
+} ScanWorker;
+
+typedef struct Scan {
+    SM_Internal *meta;
+    int startPage, endPage;
+    SM_ScanCallback callback;
+    void *ctx;
+    ScanWorker *workers;
+    int nWorkers;
+    int stop;                   /* set (atomically) once rc is recorded */
+    pthread_mutex_t rcLock;
+    RC rc;                      /* first failure */
+    char *message;              /* its RC_message, handed to the caller's thread */
+} Scan;
+
+typedef struct ScanThread {
+    Scan *scan;
+    int self;
+} ScanThread;
+
+static void scan_fail(Scan *s, RC rc) {
+    pthread_mutex_lock(&s->rcLock);
+    if (s->rc == RC_OK) {
+        s->rc = rc;
+        s->message = RC_message;
+    }
+    pthread_mutex_unlock(&s->rcLock);
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+}
+
+/* Take the next chunk from worker w's own run; -1 when it is empty.
+   next and end change only under the worker's lock, but steal() reads
+   them without it to pick a victim, so the stores are atomic. */
+static int take_own(ScanWorker *w) {
+    pthread_mutex_lock(&w->lock);
+    int c = -1;
+    if (w->next < w->end) {
+        c = w->next;
+        __atomic_store_n(&w->next, c + 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return c;
+}
+
+/* Move the back half of the largest other run to worker `self`.
+   Returns 0 when every run is empty (the scan is finishing). */
+static int steal(Scan *s, int self) {
+    for (;;) {
+        int victim = -1, most = 0;
+        for (int i = 0; i < s->nWorkers; ++i) {
+            if (i == self) continue;
+            ScanWorker *v = &s->workers[i];
+            int left = __atomic_load_n(&v->end, __ATOMIC_RELAXED) -
+                       __atomic_load_n(&v->next, __ATOMIC_RELAXED);
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) return 0;
+
+        ScanWorker *v = &s->workers[victim];
+        pthread_mutex_lock(&v->lock);
+        int left = v->end - v->next;
+        int take = (left + 1) / 2;      /* the last chunk too: its owner may be stuck */
+        int from = v->end - take;
+        if (take > 0) __atomic_store_n(&v->end, from, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&v->lock);
+        if (take == 0) continue;        /* drained meanwhile; look again */
+
+        ScanWorker *me = &s->workers[self];
+        pthread_mutex_lock(&me->lock);
+        __atomic_store_n(&me->next, from, __ATOMIC_RELAXED);
+        __atomic_store_n(&me->end, from + take, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&me->lock);
+        return 1;
+    }
+}
+
+/* Read one chunk into buf (or point into the mapping) and visit its pages. */
+static RC scan_chunk(Scan *s, int chunk, char *buf) {
+    SM_Internal *meta = s->meta;
+    int size = meta->pageSize;
+    int first = s->startPage + chunk * SCAN_CHUNK_PAGES;
+    int count = (s->endPage - first < SCAN_CHUNK_PAGES) ? s->endPage - first : SCAN_CHUNK_PAGES;
+    SM_PageHandle pages[SCAN_CHUNK_PAGES];
+    RC rc = RC_OK;
+
+    if (meta->map != NULL) {
+        for (int i = 0; i < count; ++i)
+            pages[i] = meta->map + sm_page_offset(meta, first + i);
+    } else {
+        for (int i = 0; i < count; ++i)
+            pages[i] = buf + (size_t)i * (size_t)size;
+        if (meta->snap != NULL) {
+            for (int i = 0; i < count && rc == RC_OK; ++i)
+                rc = sm_snap_read(meta, first + i, pages[i]);
+        } else if (sm_read_pages(meta, first, pages, count) != count) {
+            RC_message = "incomplete page read";
+            rc = RC_READ_NON_EXISTING_PAGE;
+        } else {
+            for (int i = 0; i < count && rc == RC_OK; ++i)
+                rc = sm_checksum_verify(meta, first + i, pages[i]);
+        }
+    }
+    sm_stats_io(meta, 0, first, (rc == RC_OK) ? count : 0, rc);
+
+    for (int i = 0; i < count && rc == RC_OK; ++i) {
+        if (__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) break;
+        rc = s->callback(first + i, pages[i], s->ctx);
+    }
+    return rc;
+}
+
+static void *scan_worker(void *arg) {
+    ScanThread *t = (ScanThread *)arg;
+    Scan *s = t->scan;
+    char *buf = NULL;
+    if (s->meta->map == NULL &&
+        posix_memalign((void **)&buf, PAGE_SIZE,
+                       (size_t)SCAN_CHUNK_PAGES * (size_t)s->meta->pageSize) != 0) {
+        RC_message = "out of memory for scan buffer";
+        scan_fail(s, RC_READ_NON_EXISTING_PAGE);
+        return NULL;
+    }
+
+    while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+        int c = take_own(&s->workers[t->self]);
+        if (c < 0) {
+            if (!steal(s, t->self)) break;
+            continue;
+        }
+        RC rc = scan_chunk(s, c, buf);
+        if (rc != RC_OK) scan_fail(s, rc);
+    }
+    free(buf);
+    return NULL;
+}
+
+/* --------------------------------------------------------------------------
+   Public API (declared in storage_mgr.h)
+   -------------------------------------------------------------------------- */
+
+/* Visit pages [startPage, endPage) on nThreads workers (the caller is one). */
+RC scanPageFile(SM_FileHandle *fHandle, int startPage, int endPage,
+                SM_ScanCallback callback, void *ctx, int nThreads) {
+    if (fHandle == NULL || callback == NULL) {
+        RC_message = "invalid arguments to scanPageFile";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc == RC_OK)
+        rc = sm_wb_drain(meta);     /* workers read the file itself */
+    if (rc != RC_OK) return rc;
+    if (startPage < 0 || endPage < startPage || endPage > fHandle->totalNumPages) {
+        RC_message = "page range outside the file";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    int chunks = (endPage - startPage + SCAN_CHUNK_PAGES - 1) / SCAN_CHUNK_PAGES;
+    if (chunks == 0) return RC_OK;
+
+    if (nThreads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nThreads = (cpus > 0) ? (int)cpus : SCAN_DEFAULT_THREADS;
+    }
+    if (nThreads > chunks) nThreads = chunks;
+
+    Scan s = {meta, startPage, endPage, callback, ctx, NULL, nThreads,
+              0, PTHREAD_MUTEX_INITIALIZER, RC_OK, NULL};
+    s.workers = (ScanWorker *)calloc((size_t)nThreads, sizeof *s.workers);
+    ScanThread *args = (ScanThread *)calloc((size_t)nThreads, sizeof *args);
+    pthread_t *tids = (pthread_t *)calloc((size_t)nThreads, sizeof *tids);
+    if (s.workers == NULL || args == NULL || tids == NULL) {
+        free(s.workers);
+        free(args);
+        free(tids);
+        RC_message = "out of memory for scan workers";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        pthread_mutex_init(&s.workers[i].lock, NULL);
+        s.workers[i].next = (int)((long)chunks * i / nThreads);
+        s.workers[i].end = (int)((long)chunks * (i + 1) / nThreads);
+        args[i].scan = &s;
+        args[i].self = i;
+    }
+
+    int started = 1;
+    for (; started < nThreads; ++started)
+        if (pthread_create(&tids[started], NULL, scan_worker, &args[started]) != 0)
+            break;              /* fewer threads: the others steal their chunks */
+    scan_worker(&args[0]);
+    for (int i = 1; i < started; ++i)
+        pthread_join(tids[i], NULL);
+
+    for (int i = 0; i < nThreads; ++i)
+        pthread_mutex_destroy(&s.workers[i].lock);
+    free(s.workers);
+    free(args);
+    free(tids);
+    pthread_mutex_destroy(&s.rcLock);
+    if (s.rc != RC_OK) RC_message = s.message;
+    return s.rc;
+}
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE     /* pread/pwrite and mkstemp under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* --------------------------------------------------------------------------
+   Copy-on-write snapshots
+
+   A snapshot reads the live file except for pages written since it was
+   taken. The first write to such a page, through any handle on the file,
+   copies the old image into the file's shadow file (an unlinked temporary
+   next to the page file) and points every snapshot still missing that
+   page at the copy. A page that no snapshot lacks is written with no
+   extra work. The snapshot list and the shadow hang off the shared
+   registry entry; a snapshot reads unpreserved pages through the handle
+   it was taken from, which stays open until the snapshot is closed.
+
+   Locking (the file's snapLock): writers hold it shared while they write
+   and exclusively only while they preserve; snapshot reads hold it
+   shared. A snapshot that finds a page unpreserved therefore reads it
+   before any writer can begin changing it.
+   -------------------------------------------------------------------------- */
+
+typedef struct SM_Shadow {
+    int fd;             /* unlinked temporary file */
+    off_t end;          /* bytes used; space is reclaimed with the last snapshot */
+} SM_Shadow;
+
+struct SM_Snapshot {
+    SM_Internal *live;      /* bookkeeping of the handle it was taken from */
+    int pages;              /* file size when taken */
+    off_t *saved;           /* per page: image offset in the shadow, -1 = live */
+    SM_Snapshot *next;      /* live->shared->snaps */
+};
+
+/* Does some snapshot still read pageNum from the live file? */
+static int unpreserved(const SM_SharedFile *sf, int pageNum) {
+    for (const SM_Snapshot *s = sf->snaps; s != NULL; s = s->next)
+        if (pageNum < s->pages && s->saved[pageNum] < 0) return 1;
+    return 0;
+}
+
+static int range_unpreserved(const SM_SharedFile *sf, int first, int count) {
+    if (sf->snaps == NULL) return 0;
+    for (int p = first; p < first + count; ++p)
+        if (unpreserved(sf, p)) return 1;
+    return 0;
+}
+
+/* Copy the current image of every unpreserved page in the range to the
+   shadow, reading it through the writing handle. Caller holds snapLock
+   exclusively. */
+static RC preserve(SM_Internal *live, int first, int count) {
+    SM_SharedFile *sf = live->shared;
+    SM_Shadow *sh = sf->shadow;
+    SM_PageHandle page = allocatePageHandleSized(live->pageSize);
+    if (page == NULL) {
+        RC_message = "out of memory for snapshot copy";
+        return RC_WRITE_FAILED;
+    }
+    RC rc = RC_OK;
+    for (int p = first; p < first + count && rc == RC_OK; ++p) {
+        if (!unpreserved(sf, p)) continue;
+        if (sm_read_pages(live, p, &page, 1) != 1 ||
+            sm_pwrite_full(sh->fd, page, (size_t)live->pageSize, sh->end) != (size_t)live->pageSize) {
+            RC_message = "copying page for snapshot failed";
+            rc = RC_WRITE_FAILED;
+            break;
+        }
+        for (SM_Snapshot *s = sf->snaps; s != NULL; s = s->next)
+            if (p < s->pages && s->saved[p] < 0) s->saved[p] = sh->end;
+        sh->end += live->pageSize;
+    }
+    freePageHandle(page);
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c and async_io.c (storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_snap_write_begin(SM_Internal *live, int first, int count) {
+    SM_SharedFile *sf = live->shared;
+    pthread_rwlock_rdlock(&sf->snapLock);
+    while (range_unpreserved(sf, first, count)) {
+        pthread_rwlock_unlock(&sf->snapLock);
+        pthread_rwlock_wrlock(&sf->snapLock);
+        RC rc = preserve(live, first, count);
+        pthread_rwlock_unlock(&sf->snapLock);
+        if (rc != RC_OK) return rc;
+        /* a snapshot taken in between is caught by the re-check */
+        pthread_rwlock_rdlock(&sf->snapLock);
+    }
+    return RC_OK;
+}
+
+void sm_snap_write_end(SM_Internal *live) {
+    pthread_rwlock_unlock(&live->shared->snapLock);
+}
+
+RC sm_snap_create(SM_Internal *live, SM_Internal *snapMeta, const char *fileName, int pages) {
+    SM_Snapshot *s = (SM_Snapshot *)calloc(1, sizeof *s);
+    off_t *saved = (off_t *)malloc((size_t)(pages > 0 ? pages : 1) * sizeof *saved);
+    if (s == NULL || saved == NULL) {
+        free(s);
+        free(saved);
+        RC_message = "out of memory for snapshot";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    for (int p = 0; p < pages; ++p) saved[p] = -1;
+    s->live = live;
+    s->pages = pages;
+    s->saved = saved;
+
+    SM_SharedFile *sf = live->shared;
+    pthread_rwlock_wrlock(&sf->snapLock);
+    RC rc = RC_OK;
+    if (sf->shadow == NULL) {
+        SM_Shadow *sh = (SM_Shadow *)calloc(1, sizeof *sh);
+        char *name = sm_side_file_name(fileName, ".shadowXXXXXX");
+        int fd = (sh != NULL && name != NULL) ? mkstemp(name) : -1;
+        if (fd >= 0) unlink(name);      /* lives only as long as the descriptor */
+        free(name);
+        if (fd < 0) {
+            free(sh);
+            RC_message = "unable to create snapshot shadow file";
+            rc = RC_FILE_HANDLE_NOT_INIT;
+        } else {
+            sh->fd = fd;
+            sf->shadow = sh;
+        }
+    }
+    if (rc == RC_OK) {
+        s->next = sf->snaps;
+        sf->snaps = s;
+        snapMeta->snap = s;
+        __atomic_add_fetch(&live->snapsTaken, 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&sf->snapLock);
+
+    if (rc != RC_OK) {
+        free(saved);
+        free(s);
+    }
+    return rc;
+}
+
+void sm_snap_release(SM_Internal *snapMeta) {
+    SM_Snapshot *s = snapMeta->snap;
+    if (s == NULL) return;
+    SM_SharedFile *sf = s->live->shared;
+
+    pthread_rwlock_wrlock(&sf->snapLock);
+    for (SM_Snapshot **pp = &sf->snaps; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            break;
+        }
+    }
+    if (sf->snaps == NULL && sf->shadow != NULL) {
+        close(sf->shadow->fd);
+        free(sf->shadow);
+        sf->shadow = NULL;
+    }
+    __atomic_sub_fetch(&s->live->snapsTaken, 1, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(&sf->snapLock);
+
+    free(s->saved);
+    free(s);
+    snapMeta->snap = NULL;
+}
+
+RC sm_snap_read(SM_Internal *snapMeta, int pageNum, char *page) {
+    SM_Snapshot *s = snapMeta->snap;
+    SM_Internal *live = s->live;
+    SM_SharedFile *sf = live->shared;
+    RC rc = RC_OK;
+
+    pthread_rwlock_rdlock(&sf->snapLock);
+    off_t at = s->saved[pageNum];
+    if (at >= 0) {
+        if (sm_pread_full(sf->shadow->fd, page, (size_t)live->pageSize, at) != (size_t)live->pageSize) {
+            RC_message = "reading snapshot copy failed";
+            rc = RC_READ_NON_EXISTING_PAGE;
+        }
+    } else {
+        SM_PageHandle buf = page;
+        if (sm_read_pages(live, pageNum, &buf, 1) != 1) {
+            RC_message = "incomplete page read";
+            rc = RC_READ_NON_EXISTING_PAGE;
+        } else {
+            rc = sm_checksum_verify(live, pageNum, page);
+        }
+    }
+    pthread_rwlock_unlock(&sf->snapLock);
+    return rc;
+}
@@ -1,97 +1,998 @@
+#define _GNU_SOURCE     /* pread/pwrite and friends under -std=c11 */
+
 #include "storage_mgr.h"
+#include "storage_mgr_internal.h"
+#include "wal.h"
+#include "page_checksum.h"
 #include "dberror.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
 
 /* --------------------------------------------------------------------------
-   Internal bookkeeping kept in SM_FileHandle->mgmtInfo
+   Tunables (SM_Internal itself lives in storage_mgr_internal.h)
    -------------------------------------------------------------------------- */
-typedef struct SM_Internal {
-    FILE *fp;           /* stream used for I/O */
-} SM_Internal;
+
+/* Smallest mapping created for a mapped handle, in pages. */
+#define SM_MIN_MAP_PAGES 16
+
+/* Pages moved per preadv/pwritev call (well under IOV_MAX). */
+#define SM_IOV_BATCH 256
+
+/* Read-ahead: cursor reads in a row before prefetching starts, and the
+   first and largest window in pages. */
+#define SM_RA_TRIGGER   2
+#define SM_RA_MIN_PAGES 4
+#define SM_RA_MAX_PAGES 64
 
 /* --------------------------------------------------------------------------
-   Small utility helpers (file-local)
+   Small utility helpers (sm_* ones are shared via storage_mgr_internal.h)
    -------------------------------------------------------------------------- */
 
-/* Convert byte length to page count (floor division). */
-static int bytes_to_pages(long nbytes) {
-    if (nbytes <= 0) return 0;
-    return (int)(nbytes / PAGE_SIZE);
+/* Byte offset of a data page (0-based) inside the file. */
+off_t sm_page_offset(const SM_Internal *meta, int pageNum) {
+    return (off_t)SM_HEADER_SIZE + (off_t)pageNum * (off_t)meta->pageSize;
+}
+
+/* Descriptor and byte offset of a data page: in a stripe member for a
+   striped file, behind the header otherwise. */
+off_t sm_page_loc(const SM_Internal *meta, int pageNum, int *fd) {
+    if (meta->stripe != NULL) return sm_stripe_locate(meta, pageNum, fd);
+    *fd = meta->fd;
+    return sm_page_offset(meta, pageNum);
+}
+
+/* Let a handle see pages added through other handles on its file. A
+   mapped handle sees no further than its mapping. (A compressed file has
+   only one handle.) */
+static void follow_page_count(SM_FileHandle *h, const SM_Internal *meta) {
+    int pages = __atomic_load_n(&meta->shared->pageCount, __ATOMIC_ACQUIRE);
+    if (pages <= h->totalNumPages) return;
+    if (meta->map != NULL) {
+        int mapped = (int)((meta->mapLen - SM_HEADER_SIZE) / (size_t)meta->pageSize);
+        if (pages > mapped) pages = mapped;
+        if (pages <= h->totalNumPages) return;
+    }
+    h->totalNumPages = pages;
 }
 
-/* Get the underlying FILE* from a file handle, validating it. */
-static RC get_stream(const SM_FileHandle *h, FILE **out) {
+/* follow_page_count for the cursor calls, which range-check before any
+   call that validates the handle. */
+static void refresh_page_count(SM_FileHandle *h) {
+    SM_Internal *meta = (SM_Internal *)h->mgmtInfo;
+    if (meta->snap == NULL) follow_page_count(h, meta);
+}
+
+/* Get the bookkeeping from a file handle, validating it. */
+RC sm_get_internal(SM_FileHandle *h, SM_Internal **out) {
     if (h == NULL || h->mgmtInfo == NULL) {
         RC_message = "file handle not initialized";
         return RC_FILE_HANDLE_NOT_INIT;
     }
     SM_Internal *meta = (SM_Internal *)h->mgmtInfo;
-    if (meta->fp == NULL) {
-        RC_message = "file stream missing";
+    if (meta->fd < 0 && meta->snap == NULL) {
+        RC_message = "file descriptor missing";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    *out = meta->fp;
+    if (meta->snap == NULL) follow_page_count(h, meta);
+    *out = meta;
     return RC_OK;
 }
 
-/* Move the file position to the beginning of a page (0-based). */
-static RC move_to_page(FILE *fp, int pageNum) {
-    long offset = (long)pageNum * (long)PAGE_SIZE;
-    if (fseek(fp, offset, SEEK_SET) != 0) {
-        RC_message = "seek to page failed";
-        return RC_READ_NON_EXISTING_PAGE;
+RC sm_get_writable(SM_FileHandle *h, SM_Internal **out) {
+    RC rc = sm_get_internal(h, out);
+    if (rc == RC_OK && (*out)->snap != NULL) {
+        RC_message = "snapshot handles are read-only";
+        return RC_WRITE_FAILED;
+    }
+    return rc;
+}
+
+/* pread until len bytes arrived; returns bytes read (short only at EOF/error). */
+size_t sm_pread_full(int fd, void *buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, off + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+/* pwrite until len bytes are written; returns bytes written. */
+size_t sm_pwrite_full(int fd, const void *buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, off + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+/* Move `count` whole pages of `size` bytes at byte offset `off` with one
+   preadv/pwritev per SM_IOV_BATCH pages. A page split by a short transfer
+   is finished with the scalar path. Returns the number of complete pages
+   moved. */
+int sm_rw_pages(int fd, SM_PageHandle *pages, int count, int size, off_t off, int writing) {
+    struct iovec iov[SM_IOV_BATCH];
+    int done = 0;
+    while (done < count) {
+        int n = (count - done < SM_IOV_BATCH) ? count - done : SM_IOV_BATCH;
+        for (int i = 0; i < n; ++i) {
+            iov[i].iov_base = pages[done + i];
+            iov[i].iov_len  = (size_t)size;
+        }
+        off_t at = off + (off_t)done * size;
+        ssize_t got = writing ? pwritev(fd, iov, n, at) : preadv(fd, iov, n, at);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+
+        int whole = (int)(got / size);
+        size_t tail = (size_t)got % (size_t)size;
+        if (tail != 0) {
+            size_t rest = (size_t)size - tail;
+            char *p = pages[done + whole] + tail;
+            size_t moved = writing ? sm_pwrite_full(fd, p, rest, at + (off_t)got)
+                                   : sm_pread_full(fd, p, rest, at + (off_t)got);
+            if (moved != rest) return done + whole;
+            whole++;
+        }
+        done += whole;
+    }
+    return done;
+}
+
+/* Read `count` consecutive pages from `first`, through the page table for a
+   compressed file. Returns the number of complete pages read. */
+int sm_read_pages(SM_Internal *meta, int first, SM_PageHandle *pages, int count) {
+    if (meta->stripe != NULL)
+        return sm_stripe_rw(meta, first, pages, count, 0);
+    if (meta->ptt == NULL)
+        return sm_rw_pages(meta->fd, pages, count, meta->pageSize,
+                           sm_page_offset(meta, first), 0);
+    int done = 0;
+    while (done < count && sm_ptt_read(meta, first + done, pages[done]) == RC_OK)
+        done++;
+    return done;
+}
+
+/* True when a direct-I/O handle is given a buffer O_DIRECT cannot use. */
+int sm_misaligned(const SM_Internal *meta, const void *buf) {
+    return (meta->flags & SM_OPEN_DIRECT) && ((uintptr_t)buf % PAGE_SIZE) != 0;
+}
+
+/* Open read/write, bypassing the page cache when SM_OPEN_DIRECT is set. */
+int sm_open_data_fd(const char *fileName, int flags) {
+    int oflags = O_RDWR;
+#ifdef O_DIRECT
+    if (flags & SM_OPEN_DIRECT) oflags |= O_DIRECT;
+#endif
+    int fd = open(fileName, oflags);
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    if (fd >= 0 && (flags & SM_OPEN_DIRECT)) (void)fcntl(fd, F_NOCACHE, 1);
+#endif
+    return fd;
+}
+
+/* "<fileName><suffix>" in a fresh malloc'ed string (NULL if out of memory). */
+char *sm_side_file_name(const char *fileName, const char *suffix) {
+    size_t n = strlen(fileName) + strlen(suffix) + 1;
+    char *name = (char *)malloc(n);
+    if (name != NULL) snprintf(name, n, "%s%s", fileName, suffix);
+    return name;
+}
+
+/* Remove a side file if it exists; a missing one is not an error. */
+static void remove_side_file(const char *fileName, const char *suffix) {
+    char *name = sm_side_file_name(fileName, suffix);
+    if (name != NULL) {
+        (void)unlink(name);
+        free(name);
+    }
+}
+
+/* Bookkeeping for a handle on descriptor fd (-1 for a snapshot); the
+   caller attaches the shared state. */
+static SM_Internal *new_internal(int fd, int flags) {
+    SM_Internal *meta = (SM_Internal *)calloc(1, sizeof *meta);
+    if (meta == NULL) return NULL;
+    meta->fd = fd;
+    meta->flags = flags;
+    meta->pageSize = PAGE_SIZE;
+    meta->durability = SM_DURABILITY_FLUSH_ON_SYNC;
+    pthread_mutex_init(&meta->syncLock, NULL);
+    pthread_cond_init(&meta->syncDone, NULL);
+    pthread_mutex_init(&meta->raLock, NULL);
+    meta->raLastPage = -1;
+    return meta;
+}
+
+/* Release everything hanging off a handle's bookkeeping; returns close(2)'s
+   result when this was the last handle on the file, 0 otherwise. */
+static int free_internal(SM_Internal *meta) {
+    (void)sm_wb_close(meta);
+    if (meta->map != NULL)
+        munmap(meta->map, meta->mapLen);
+    sm_ptt_close(meta);
+    sm_stripe_close(meta);
+    free(meta->holes);
+    int rc = sm_file_release(meta->shared);
+    meta->fd = -1;
+    pthread_cond_destroy(&meta->syncDone);
+    pthread_mutex_destroy(&meta->syncLock);
+    pthread_mutex_destroy(&meta->raLock);
+    free(meta->raBuf);
+    free(meta);
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Per-file statistics (compiled out with -DSM_NO_STATS)
+   -------------------------------------------------------------------------- */
+#ifndef SM_NO_STATS
+
+/* relaxed atomics: every handle on the file adds to the same counters */
+#define STAT_ADD(meta, field, n) \
+    __atomic_fetch_add(&(meta)->shared->stats.field, (unsigned long long)(n), __ATOMIC_RELAXED)
+
+static uint64_t stat_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void sm_stats_io(SM_Internal *meta, int writing, int pageNum, int pages, RC rc) {
+    if (rc != RC_OK) STAT_ADD(meta, errors, 1);
+    if (pages <= 0) return;
+    if (__atomic_exchange_n(&meta->statsNextPage, pageNum + pages, __ATOMIC_RELAXED) != pageNum)
+        STAT_ADD(meta, seeks, 1);
+    if (writing) {
+        STAT_ADD(meta, writes, pages);
+        STAT_ADD(meta, bytesWritten, (unsigned long long)pages * (unsigned)meta->pageSize);
+    } else {
+        STAT_ADD(meta, reads, pages);
+        STAT_ADD(meta, bytesRead, (unsigned long long)pages * (unsigned)meta->pageSize);
+    }
+}
+
+/* Count a finished call that moved `pages` pages; t0 != 0 also files the
+   call's latency in the read or write histogram. */
+static void stat_call(SM_FileHandle *h, int writing, int pageNum, int pages, RC rc, uint64_t t0) {
+    SM_Internal *meta = (h != NULL) ? (SM_Internal *)h->mgmtInfo : NULL;
+    if (meta == NULL) return;
+    sm_stats_io(meta, writing, pageNum, pages, rc);
+    if (t0 == 0 || rc != RC_OK) return;
+
+    uint64_t ns = stat_clock() - t0;
+    int b = (ns > 1) ? 63 - __builtin_clzll(ns) : 0;
+    if (b >= SM_STATS_BUCKETS) b = SM_STATS_BUCKETS - 1;
+    SM_FileStats *st = &meta->shared->stats;
+    unsigned long long *hist = writing ? st->writeLatency : st->readLatency;
+    __atomic_fetch_add(&hist[b], 1ull, __ATOMIC_RELAXED);
+}
+
+#else
+
+#define STAT_ADD(meta, field, n) ((void)0)
+
+static uint64_t stat_clock(void) {
+    return 0;
+}
+
+void sm_stats_io(SM_Internal *meta, int writing, int pageNum, int pages, RC rc) {
+    (void)meta; (void)writing; (void)pageNum; (void)pages; (void)rc;
+}
+
+static void stat_call(SM_FileHandle *h, int writing, int pageNum, int pages, RC rc, uint64_t t0) {
+    (void)h; (void)writing; (void)pageNum; (void)pages; (void)rc; (void)t0;
+}
+
+#endif
+
+/* One physical flush of everything written through the handle. */
+static RC flush_to_disk(SM_FileHandle *h, SM_Internal *meta) {
+    STAT_ADD(meta, flushes, 1);
+    if (meta->map != NULL) {
+        size_t used = (size_t)sm_page_offset(meta, h->totalNumPages);
+        if (used > 0 && msync(meta->map, used, MS_SYNC) != 0) {
+            RC_message = "msync failed";
+            return RC_WRITE_FAILED;
+        }
+        return sm_fsm_sync(meta->shared);
+    }
+    if (fdatasync(meta->fd) != 0) {
+        RC_message = "fdatasync failed";
+        return RC_WRITE_FAILED;
+    }
+    if (meta->shared->crcFd >= 0 && fdatasync(meta->shared->crcFd) != 0) {
+        RC_message = "fdatasync of checksum table failed";
+        return RC_WRITE_FAILED;
+    }
+    RC rc = sm_fsm_sync(meta->shared);
+    if (rc != RC_OK) return rc;
+    if (meta->stripe != NULL) return sm_stripe_sync(meta);
+    return (meta->ptt != NULL) ? sm_ptt_sync(meta) : RC_OK;
+}
+
+RC sm_flush_file(SM_FileHandle *h) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(h, &meta);
+    if (rc == RC_OK)
+        rc = sm_wb_drain(meta);
+    return (rc == RC_OK) ? flush_to_disk(h, meta) : rc;
+}
+
+/* Group commit: take a ticket, then either find it covered by a flush that
+   started after it was issued, or become the leader and flush for everyone
+   holding a ticket so far. */
+static RC group_sync(SM_FileHandle *h, SM_Internal *meta) {
+    pthread_mutex_lock(&meta->syncLock);
+    unsigned long ticket = ++meta->syncTickets;
+    while (meta->syncRunning && meta->syncCovered < ticket)
+        pthread_cond_wait(&meta->syncDone, &meta->syncLock);
+    if (meta->syncCovered >= ticket) {
+        RC rc = meta->syncResult;
+        pthread_mutex_unlock(&meta->syncLock);
+        return rc;
+    }
+
+    unsigned long batch = meta->syncTickets;
+    meta->syncRunning = 1;
+    pthread_mutex_unlock(&meta->syncLock);
+
+    RC rc = flush_to_disk(h, meta);
+
+    pthread_mutex_lock(&meta->syncLock);
+    meta->syncRunning = 0;
+    meta->syncCovered = batch;
+    meta->syncResult = rc;
+    pthread_cond_broadcast(&meta->syncDone);
+    pthread_mutex_unlock(&meta->syncLock);
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Page checksums (CRC32C side table)
+   -------------------------------------------------------------------------- */
+
+/* SM_MAX_PAGE_SIZE zeros, aligned for SM_OPEN_DIRECT descriptors */
+static _Alignas(PAGE_SIZE) const char zero_page[SM_MAX_PAGE_SIZE];
+
+/* CRC of an all-zero page, per supported size (index log2(size / PAGE_SIZE)) */
+#define SM_PAGE_SIZE_COUNT 5
+static uint32_t zero_page_crc[SM_PAGE_SIZE_COUNT];
+static pthread_once_t zero_page_once = PTHREAD_ONCE_INIT;
+
+static void compute_zero_page_crc(void) {
+    for (int i = 0; i < SM_PAGE_SIZE_COUNT; ++i)
+        zero_page_crc[i] = crc32c(0, zero_page, (size_t)PAGE_SIZE << i);
+}
+
+/* Value stored in the side table for a page. */
+static uint32_t page_crc(const SM_Internal *meta, const char *page) {
+    pthread_once(&zero_page_once, compute_zero_page_crc);
+    int i = __builtin_ctz((unsigned)meta->pageSize / PAGE_SIZE);
+    return crc32c(0, page, (size_t)meta->pageSize) ^ zero_page_crc[i];
+}
+
+/* Make the file's in-memory table hold at least `pages` entries (new ones
+   zero). Every handle reads the table, so it is reallocated under the
+   write side of crcLock. */
+static RC ensure_crc_capacity(SM_SharedFile *sf, int pages) {
+    if (sf->crcFd < 0) return RC_OK;
+    RC rc = RC_OK;
+    pthread_rwlock_wrlock(&sf->crcLock);
+    if (pages > sf->crcCap) {
+        int cap = (sf->crcCap > 0) ? sf->crcCap : SM_MIN_MAP_PAGES;
+        while (cap < pages) cap *= 2;
+        uint32_t *grown = (uint32_t *)realloc(sf->crc, (size_t)cap * sizeof *grown);
+        if (grown == NULL) {
+            RC_message = "out of memory for checksum table";
+            rc = RC_WRITE_FAILED;
+        } else {
+            memset(grown + sf->crcCap, 0, (size_t)(cap - sf->crcCap) * sizeof *grown);
+            sf->crc = grown;
+            sf->crcCap = cap;
+        }
+    }
+    pthread_rwlock_unlock(&sf->crcLock);
+    return rc;
+}
+
+/* Open and load <fileName>.crc for a file created with checksums; later
+   handles on the file find it loaded. */
+static RC load_checksums(SM_SharedFile *sf, const char *fileName) {
+    pthread_mutex_lock(&sf->openLock);
+    if (sf->crcFd >= 0) {
+        pthread_mutex_unlock(&sf->openLock);
+        return RC_OK;
+    }
+    RC rc = RC_OK;
+    char *name = sm_side_file_name(fileName, SM_CRC_SUFFIX);
+    int fd = (name != NULL) ? open(name, O_RDWR) : -1;
+    if (name == NULL) {
+        RC_message = "out of memory for checksum table";
+        rc = RC_FILE_HANDLE_NOT_INIT;
+    } else if (fd < 0) {
+        RC_message = "checksum table of checksummed file is missing";
+        rc = RC_FILE_NOT_FOUND;
+    } else {
+        int pages = __atomic_load_n(&sf->pageCount, __ATOMIC_ACQUIRE);
+        sf->crcFd = fd;
+        rc = ensure_crc_capacity(sf, pages > 0 ? pages : 1);
+        /* entries past the end of the side file stay zero (= zero page) */
+        if (rc == RC_OK)
+            (void)sm_pread_full(fd, sf->crc, (size_t)pages * sizeof *sf->crc, 0);
+        else
+            sm_checksum_close(sf);
+    }
+    free(name);
+    pthread_mutex_unlock(&sf->openLock);
+    return rc;
+}
+
+void sm_checksum_close(SM_SharedFile *sf) {
+    if (sf->crcFd >= 0) close(sf->crcFd);
+    free(sf->crc);
+    sf->crcFd = -1;
+    sf->crc = NULL;
+    sf->crcCap = 0;
+}
+
+RC sm_checksum_verify(const SM_Internal *meta, int pageNum, const char *page) {
+    SM_SharedFile *sf = meta->shared;
+    if (sf->crcFd < 0) return RC_OK;
+    uint32_t want = page_crc(meta, page);
+    pthread_rwlock_rdlock(&sf->crcLock);
+    uint32_t have = __atomic_load_n(&sf->crc[pageNum], __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&sf->crcLock);
+    if (want != have) {
+        RC_message = "page checksum mismatch (torn or corrupted page)";
+        return RC_PAGE_CHECKSUM_MISMATCH;
     }
     return RC_OK;
 }
 
-/* Recompute total pages for an opened file and write into handle. */
-static RC refresh_page_count(SM_FileHandle *h) {
-    FILE *fp;
-    RC rc = get_stream(h, &fp);
+/* Record checksums for pages just written and persist those entries with a
+   single pwrite (contiguous pages have contiguous entries). */
+RC sm_checksum_update(SM_Internal *meta, int firstPage, SM_PageHandle *pages, int count) {
+    SM_SharedFile *sf = meta->shared;
+    if (sf->crcFd < 0 || count <= 0) return RC_OK;
+    RC rc = RC_OK;
+    pthread_rwlock_rdlock(&sf->crcLock);
+    for (int i = 0; i < count; ++i)
+        __atomic_store_n(&sf->crc[firstPage + i], page_crc(meta, pages[i]), __ATOMIC_RELAXED);
+
+    size_t len = (size_t)count * sizeof *sf->crc;
+    off_t at = (off_t)firstPage * (off_t)sizeof *sf->crc;
+    if (sm_pwrite_full(sf->crcFd, sf->crc + firstPage, len, at) != len) {
+        RC_message = "writing page checksum failed";
+        rc = RC_WRITE_FAILED;
+    }
+    pthread_rwlock_unlock(&sf->crcLock);
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Sparse pages: zero pages are holes, and SM_OPEN_SPARSE handles remember
+   where the holes are so reads of them need no syscall
+   -------------------------------------------------------------------------- */
+
+/* OR every word of the page together; `size` is a constant in each
+   instance, so the loop is fully unrolled and vectorized. Most pages
+   written hold data near the start, so the first cache line is tested
+   on its own before the full scan. */
+static inline int zero_words(const char *page, size_t size) {
+    uint64_t acc = 0;
+    for (size_t i = 0; i < 64; i += sizeof acc) {
+        uint64_t w;
+        memcpy(&w, page + i, sizeof w);
+        acc |= w;
+    }
+    if (acc != 0) return 0;
+    for (size_t i = 64; i < size; i += sizeof acc) {
+        uint64_t w;
+        memcpy(&w, page + i, sizeof w);
+        acc |= w;
+    }
+    return acc == 0;
+}
+
+int sm_is_zero_page(const char *page, int size) {
+    switch (size) {
+#define SM_ZERO_TEST_CASE(n) case n: return zero_words(page, n);
+    SM_PAGE_SIZE_CASES(SM_ZERO_TEST_CASE)
+#undef SM_ZERO_TEST_CASE
+    default: return zero_words(page, (size_t)size);
+    }
+}
+
+static int hole_known(const SM_Internal *meta, int pageNum) {
+    if (meta->holes == NULL || pageNum / 64 >= meta->holeWords) return 0;
+    uint64_t w = __atomic_load_n(&meta->holes[pageNum / 64], __ATOMIC_RELAXED);
+    return (int)((w >> (pageNum % 64)) & 1);
+}
+
+static void holes_mark(SM_Internal *meta, int first, int count) {
+    for (int p = first; meta->holes != NULL && p < first + count && p / 64 < meta->holeWords; ++p)
+        __atomic_fetch_or(&meta->holes[p / 64], 1ull << (p % 64), __ATOMIC_RELAXED);
+}
+
+/* Forget holes in [first, first+count) once data has been written there. */
+void sm_holes_clear(SM_Internal *meta, int first, int count) {
+    for (int p = first; meta->holes != NULL && p < first + count && p / 64 < meta->holeWords; ++p)
+        __atomic_fetch_and(&meta->holes[p / 64], ~(1ull << (p % 64)), __ATOMIC_RELAXED);
+}
+
+/* Record the holes among data pages [first, end) as the filesystem reports
+   them, growing the map to cover `end` pages. Only called while the handle
+   is used exclusively (open and growth). */
+static RC scan_holes(SM_Internal *meta, int first, int end) {
+    int words = (end + 63) / 64;
+    if (words > meta->holeWords) {
+        uint64_t *grown = (uint64_t *)realloc(meta->holes, (size_t)words * sizeof *grown);
+        if (grown == NULL) {
+            RC_message = "out of memory for hole map";
+            return RC_FILE_HANDLE_NOT_INIT;
+        }
+        memset(grown + meta->holeWords, 0, (size_t)(words - meta->holeWords) * sizeof *grown);
+        meta->holes = grown;
+        meta->holeWords = words;
+    }
+
+    off_t pos = sm_page_offset(meta, first), stop = sm_page_offset(meta, end);
+    off_t size = meta->pageSize;
+    while (pos < stop) {
+        off_t hole = lseek(meta->fd, pos, SEEK_HOLE);
+        if (hole < 0 || hole >= stop) break;        /* no (more) holes in range */
+        off_t data = lseek(meta->fd, hole, SEEK_DATA);
+        if (data < 0 || data > stop) data = stop;   /* ENXIO: hole runs to EOF */
+        /* only pages lying wholly inside the hole */
+        int p0 = (int)((hole - SM_HEADER_SIZE + size - 1) / size);
+        int p1 = (int)((data - SM_HEADER_SIZE) / size);
+        if (p1 > p0) holes_mark(meta, p0, p1 - p0);
+        pos = data;
+    }
+    return RC_OK;
+}
+
+/* Deallocate the disk blocks behind a page; it reads back as zeros.
+   Returns 0 on success, -1 where punching is unsupported. */
+static int punch_page(SM_Internal *meta, int pageNum) {
+    int fd;
+    off_t off = sm_page_loc(meta, pageNum, &fd);
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, meta->pageSize) != 0)
+        return -1;
+    holes_mark(meta, pageNum, 1);
+    return 0;
+}
+
+/* Make one page read as zeros, as a hole where the filesystem allows it. */
+static RC zero_page_on_disk(SM_Internal *meta, int pageNum) {
+    RC rc = RC_OK;
+    int fd = -1;
+    off_t off = (meta->ptt == NULL) ? sm_page_loc(meta, pageNum, &fd) : 0;
+    if (meta->ptt != NULL) {
+        rc = sm_ptt_write(meta, pageNum, zero_page);    /* a zero entry, no slot */
+    } else if (punch_page(meta, pageNum) != 0 &&
+               sm_pwrite_full(fd, zero_page, (size_t)meta->pageSize, off) != (size_t)meta->pageSize) {
+        RC_message = "zeroing page failed";
+        rc = RC_WRITE_FAILED;
+    }
     if (rc != RC_OK) return rc;
+    SM_PageHandle page = (SM_PageHandle)zero_page;
+    return sm_checksum_update(meta, pageNum, &page, 1);
+}
 
-    long here = ftell(fp);
-    if (here < 0) {
-        RC_message = "ftell failed";
-        return RC_FILE_HANDLE_NOT_INIT;
+/* --------------------------------------------------------------------------
+   File header page
+   -------------------------------------------------------------------------- */
+
+/* A page size createPageFileSized accepts: a power of two in range. */
+static int valid_page_size(uint32_t size) {
+    return size >= SM_MIN_PAGE_SIZE && size <= SM_MAX_PAGE_SIZE && (size & (size - 1)) == 0;
+}
+
+static void init_header(SM_FileHeader *hdr, int createFlags, int pageSize) {
+    memset(hdr, 0, sizeof *hdr);
+    memcpy(hdr->magic, SM_FILE_MAGIC, sizeof hdr->magic);
+    hdr->version = SM_FORMAT_VERSION;
+    hdr->pageSize = (uint32_t)pageSize;
+    hdr->pageCount = 1;
+    hdr->freeListHead = SM_NO_FREE_PAGE;
+    hdr->flags = (uint32_t)(createFlags & (SM_CREATE_CHECKSUM | SM_CREATE_COMPRESSED));
+}
+
+static uint32_t header_crc(const SM_FileHeader *hdr) {
+    return crc32c(0, hdr, offsetof(SM_FileHeader, checksum));
+}
+
+/* Seal and write the header page. The whole page goes out from an aligned
+   buffer so the same path serves SM_OPEN_DIRECT descriptors. */
+static RC write_header(int fd, SM_FileHeader *hdr) {
+    hdr->checksum = header_crc(hdr);
+    void *page = NULL;
+    if (posix_memalign(&page, PAGE_SIZE, SM_HEADER_SIZE) != 0) {
+        RC_message = "out of memory for file header";
+        return RC_WRITE_FAILED;
     }
-    if (fseek(fp, 0L, SEEK_END) != 0) {
-        RC_message = "seek to end failed";
-        return RC_FILE_HANDLE_NOT_INIT;
+    memset(page, 0, SM_HEADER_SIZE);
+    memcpy(page, hdr, sizeof *hdr);
+    size_t out = sm_pwrite_full(fd, page, SM_HEADER_SIZE, 0);
+    free(page);
+    if (out != SM_HEADER_SIZE) {
+        RC_message = "writing file header failed";
+        return RC_WRITE_FAILED;
     }
-    long size = ftell(fp);
-    if (size < 0) {
-        RC_message = "ftell at end failed";
+    return RC_OK;
+}
+
+/* Read and validate the header page of an opened file. */
+RC sm_read_header(int fd, SM_FileHeader *hdr) {
+    void *page = NULL;
+    if (posix_memalign(&page, PAGE_SIZE, SM_HEADER_SIZE) != 0) {
+        RC_message = "out of memory for file header";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    /* restore original position (best-effort) */
-    (void)fseek(fp, here, SEEK_SET);
+    size_t got = sm_pread_full(fd, page, SM_HEADER_SIZE, 0);
+    memcpy(hdr, page, sizeof *hdr);
+    free(page);
 
-    h->totalNumPages = bytes_to_pages(size);
-    return RC_OK;
+    if (got != SM_HEADER_SIZE)
+        RC_message = "file too short for a page file header";
+    else if (memcmp(hdr->magic, SM_FILE_MAGIC, sizeof hdr->magic) != 0)
+        RC_message = "not a page file (bad magic)";
+    else if (hdr->checksum != header_crc(hdr))
+        RC_message = "page file header is corrupted (checksum mismatch)";
+    else if (hdr->version != SM_FORMAT_VERSION)
+        RC_message = "unsupported page file format version";
+    else if (!valid_page_size(hdr->pageSize) ||
+             ((hdr->flags & SM_CREATE_COMPRESSED) && hdr->pageSize != PAGE_SIZE))
+        RC_message = "page file header has an unsupported page size";
+    else if (hdr->pageCount > INT_MAX)
+        RC_message = "page file header has an impossible page count";
+    else
+        return RC_OK;
+    return RC_FILE_HEADER_INVALID;
 }
 
-/* Write exactly one zero-filled page at the current position. */
-static RC write_zero_page(FILE *fp) {
-    /* Avoid heap churn: use a fixed-size stack buffer. */
-    char zero_buf[PAGE_SIZE];
-    memset(zero_buf, 0, sizeof zero_buf);
+/* The header every handle on the file shares. */
+static SM_FileHeader load_header(const SM_Internal *meta) {
+    SM_SharedFile *sf = meta->shared;
+    pthread_mutex_lock(&sf->headerLock);
+    SM_FileHeader hdr = sf->header;
+    pthread_mutex_unlock(&sf->headerLock);
+    return hdr;
+}
+
+/* Record a grown page count in the header (counts only ever go up) and
+   publish it to the other handles on the file. */
+static RC store_page_count(SM_Internal *meta, int pages) {
+    SM_SharedFile *sf = meta->shared;
+    RC rc = RC_OK;
+    pthread_mutex_lock(&sf->headerLock);
+    if ((uint32_t)pages > sf->header.pageCount) {
+        SM_FileHeader hdr = sf->header;
+        hdr.pageCount = (uint32_t)pages;
+        rc = write_header(meta->fd, &hdr);
+        if (rc == RC_OK) {
+            sf->header = hdr;
+            __atomic_store_n(&sf->pageCount, pages, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&sf->headerLock);
+    return rc;
+}
+
+/* Lower the header's free-page hint to pageNum. Raising it is left to the
+   next header write: a stale hint that is too low only costs a longer scan.
+   Called with headerLock held. */
+static RC store_free_hint(SM_Internal *meta, int pageNum) {
+    SM_SharedFile *sf = meta->shared;
+    if (sf->header.freeListHead != SM_NO_FREE_PAGE &&
+        sf->header.freeListHead <= (uint32_t)pageNum)
+        return RC_OK;
+    SM_FileHeader hdr = sf->header;
+    hdr.freeListHead = (uint32_t)pageNum;
+    hdr.flags |= SM_HEADER_FREE_MAP;
+    RC rc = write_header(meta->fd, &hdr);
+    if (rc == RC_OK) sf->header = hdr;
+    return rc;
+}
+
+/* Take the lowest free page off the file's free-space map, or return -1
+   when none is left. The hint only moves in memory; the next header write
+   persists it. */
+static int take_free_page(SM_Internal *meta, RC *rc) {
+    SM_SharedFile *sf = meta->shared;
+    int page = -1;
+    *rc = RC_OK;
+    pthread_mutex_lock(&sf->headerLock);
+    uint32_t hint = sf->header.freeListHead;
+    if (hint != SM_NO_FREE_PAGE) {
+        page = sm_fsm_find(sf, (int)hint);
+        if (page < 0) {
+            sf->header.freeListHead = SM_NO_FREE_PAGE;   /* the map is empty */
+        } else {
+            *rc = sm_fsm_set(sf, page, 0);
+            if (*rc == RC_OK)
+                sf->header.freeListHead = (uint32_t)page + 1;
+        }
+    }
+    pthread_mutex_unlock(&sf->headerLock);
+    return page;
+}
+
+/* Make sure a mapped handle's mapping covers at least `pages` pages.
+   Capacity doubles so that page-by-page growth remaps O(log n) times. */
+static RC ensure_mapped(SM_Internal *meta, int pages) {
+    size_t need = (size_t)sm_page_offset(meta, pages);
+    if (meta->map != NULL && need <= meta->mapLen) return RC_OK;
+
+    size_t len = (meta->mapLen > 0) ? meta->mapLen : (size_t)SM_MIN_MAP_PAGES * PAGE_SIZE;
+    while (len < need) len *= 2;
+
+    void *p;
+    if (meta->map == NULL)
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, meta->fd, 0);
+    else
+        p = mremap(meta->map, meta->mapLen, len, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) {
+        RC_message = "mapping page file failed";
+        return RC_FILE_MAP_FAILED;
+    }
+    meta->map = (char *)p;
+    meta->mapLen = len;
+    return RC_OK;
+}
 
-    size_t n = fwrite(zero_buf, sizeof(char), PAGE_SIZE, fp);
-    if (n != PAGE_SIZE) {
-        RC_message = "writing zero page failed";
+/* Extend the file to `pages` zero-filled data pages of `size` bytes in one
+   ftruncate; the filesystem supplies the zeros. Never shrinks a file that
+   another handle has already grown further; *have (if not NULL) receives
+   the data pages the file now holds. */
+static RC extend_file(int fd, int pages, int size, int *have) {
+    off_t end = (off_t)SM_HEADER_SIZE + (off_t)pages * size;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        RC_message = "fstat failed";
         return RC_WRITE_FAILED;
     }
-    if (fflush(fp) != 0) {
-        RC_message = "flush failed after write";
+    if (have != NULL) *have = pages;
+    if (st.st_size >= end) {
+        if (have != NULL) *have = (int)((st.st_size - SM_HEADER_SIZE) / size);
+        return RC_OK;
+    }
+    if (ftruncate(fd, end) != 0) {
+        RC_message = "extending file failed";
         return RC_WRITE_FAILED;
     }
     return RC_OK;
 }
 
+/* Grow an open handle to `pages` pages, keeping any mapping and the
+   header's page count in step. The header is written last, so a crash
+   part-way leaves the old count describing valid pages. */
+static RC grow_handle(SM_FileHandle *h, SM_Internal *meta, int pages) {
+    /* snapshot reads and the write-back flusher use the tables reallocated below */
+    sm_wb_pause(meta);
+    pthread_rwlock_wrlock(&meta->shared->snapLock);
+    int have = pages;
+    RC rc = ensure_crc_capacity(meta->shared, pages);
+    if (rc == RC_OK && meta->ptt != NULL)
+        rc = sm_ptt_grow(meta, pages);
+    else if (rc == RC_OK && meta->stripe != NULL)
+        rc = sm_stripe_extend(meta, pages);
+    else if (rc == RC_OK)
+        rc = extend_file(meta->fd, pages, meta->pageSize, &have);
+    if (rc == RC_OK)
+        rc = store_page_count(meta, have);
+    if (rc == RC_OK && (meta->flags & SM_OPEN_MMAP))
+        rc = ensure_mapped(meta, pages);
+    if (rc == RC_OK && meta->holes != NULL)
+        rc = scan_holes(meta, h->totalNumPages, pages);
+    pthread_rwlock_unlock(&meta->shared->snapLock);
+    sm_wb_resume(meta);
+    if (rc != RC_OK) {
+        STAT_ADD(meta, errors, 1);
+        return rc;
+    }
+    STAT_ADD(meta, appends, pages - h->totalNumPages);
+    h->totalNumPages = pages;
+    return RC_OK;
+}
+
+
+/* --------------------------------------------------------------------------
+   Read-ahead for cursor scans
+   -------------------------------------------------------------------------- */
+
+/* Hint that pages [first, first+count) will be read soon. */
+static void advise_pages(SM_Internal *meta, int first, int count) {
+    if (count <= 0 || meta->ptt != NULL) return;    /* no fixed page offsets */
+    if (meta->map != NULL) {
+        (void)madvise(meta->map + sm_page_offset(meta, first),
+                      (size_t)count * (size_t)meta->pageSize, MADV_WILLNEED);
+    } else if (meta->stripe != NULL && !(meta->flags & SM_OPEN_DIRECT)) {
+        /* one hint per stripe unit touched */
+        for (int p = first, run; p < first + count; p += run) {
+            int fd;
+            off_t off = sm_page_loc(meta, p, &fd);
+            run = sm_stripe_run(meta, p);
+            if (run > first + count - p) run = first + count - p;
+            (void)posix_fadvise(fd, off, (off_t)run * meta->pageSize, POSIX_FADV_WILLNEED);
+        }
+    } else if (!(meta->flags & SM_OPEN_DIRECT)) {
+        (void)posix_fadvise(meta->fd, sm_page_offset(meta, first),
+                            (off_t)count * meta->pageSize, POSIX_FADV_WILLNEED);
+    }
+}
+
+/* Record a cursor read of pageNum in direction dir and, once the scan looks
+   sequential, keep the kernel advised one window ahead of it. The window
+   doubles each time the scan catches up with half of it. Caller holds raLock. */
+static void track_scan(SM_Internal *meta, int pageNum, int dir, int total) {
+    if (meta->raDir == dir && pageNum == meta->raLastPage + dir) {
+        meta->raStreak++;
+    } else {
+        meta->raDir = dir;
+        meta->raStreak = 1;
+        meta->raWindow = SM_RA_MIN_PAGES;
+        meta->raFrontier = pageNum + dir;
+    }
+    meta->raLastPage = pageNum;
+    if (meta->raStreak < SM_RA_TRIGGER) return;
+
+    int w = meta->raWindow;
+    if (dir > 0 && pageNum + w / 2 >= meta->raFrontier) {
+        int lo = (meta->raFrontier > pageNum + 1) ? meta->raFrontier : pageNum + 1;
+        int hi = (pageNum + 1 + w < total) ? pageNum + 1 + w : total;
+        advise_pages(meta, lo, hi - lo);
+        meta->raFrontier = hi;
+    } else if (dir < 0 && pageNum - w / 2 <= meta->raFrontier) {
+        int hi = (meta->raFrontier < pageNum - 1) ? meta->raFrontier : pageNum - 1;
+        int lo = (pageNum - w > 0) ? pageNum - w : 0;
+        advise_pages(meta, lo, hi - lo + 1);
+        meta->raFrontier = lo - 1;
+    } else {
+        return;
+    }
+    if (meta->raWindow < SM_RA_MAX_PAGES) meta->raWindow *= 2;
+}
+
+/* The pages a refill from pageNum in direction dir reads: up to one
+   window, clipped to the file. Caller holds raLock. */
+static void prefetch_range(const SM_Internal *meta, int pageNum, int dir, int total,
+                           int *first, int *count) {
+    int w = (meta->raWindow < SM_RA_MAX_PAGES) ? meta->raWindow : SM_RA_MAX_PAGES;
+    *first = (dir > 0) ? pageNum : pageNum - w + 1;
+    if (*first < 0) *first = 0;
+    *count = (*first + w <= total) ? w : total - *first;
+}
+
+/* Refill the prefetch buffer with pages [first, first+count) (at most
+   SM_RA_MAX_PAGES). Caller holds raLock. */
+static void fill_prefetch(SM_Internal *meta, int first, int count) {
+    if (meta->raBuf == NULL &&
+        posix_memalign((void **)&meta->raBuf, PAGE_SIZE,
+                       (size_t)SM_RA_MAX_PAGES * (size_t)meta->pageSize) != 0) {
+        meta->raBuf = NULL;
+        return;
+    }
+    SM_PageHandle slots[SM_RA_MAX_PAGES];
+    for (int i = 0; i < count; ++i)
+        slots[i] = meta->raBuf + (size_t)i * (size_t)meta->pageSize;
+    meta->raStart = first;
+    meta->raCount = sm_read_pages(meta, first, slots, count);
+
+    /* keep only the verified prefix; readBlock reports the bad page itself */
+    for (int i = 0; i < meta->raCount; ++i) {
+        if (sm_checksum_verify(meta, first + i, slots[i]) != RC_OK) {
+            meta->raCount = i;
+            break;
+        }
+    }
+}
+
+/* Drop buffered pages overlapping [first, first+count) after a write. */
+void sm_invalidate_prefetch(SM_Internal *meta, int first, int count) {
+    if (!(meta->flags & SM_OPEN_READAHEAD)) return;
+    pthread_mutex_lock(&meta->raLock);
+    if (meta->raCount > 0 && first < meta->raStart + meta->raCount &&
+        meta->raStart < first + count)
+        meta->raCount = 0;
+    pthread_mutex_unlock(&meta->raLock);
+}
+
+/* --------------------------------------------------------------------------
+   Latching inside the calls of SM_OPEN_LATCHED handles
+   -------------------------------------------------------------------------- */
+
+/* Take the latches of pages [first, first+count) on a latched handle.
+   Returns the bookkeeping to hand to auto_unlatch, NULL if none were taken. */
+static SM_Internal *auto_latch(SM_FileHandle *h, int first, int count, int exclusive) {
+    SM_Internal *meta = (h != NULL) ? (SM_Internal *)h->mgmtInfo : NULL;
+    if (meta == NULL || !(meta->flags & SM_OPEN_LATCHED) || count <= 0) return NULL;
+    return (sm_latch_range(meta, first, count, exclusive) == RC_OK) ? meta : NULL;
+}
+
+static void auto_unlatch(SM_Internal *meta, int first, int count, int exclusive) {
+    if (meta != NULL) sm_unlatch_range(meta, first, count, exclusive);
+}
+
+/* Every latch, exclusively: for calls that change totalNumPages. */
+static SM_Internal *latch_all(SM_FileHandle *h) {
+    return auto_latch(h, 0, SM_LATCH_STRIPES, 1);
+}
+
+static void unlatch_all(SM_Internal *meta) {
+    auto_unlatch(meta, 0, SM_LATCH_STRIPES, 1);
+}
+
+/* Cursor read of pageNum, one step in direction dir from the last one.
+   On a latched handle the page is read under its shared latch, as in
+   readBlock, and a refill holds the latches of every page it reads. The
+   latches come before raLock: writers invalidate the buffer with their
+   latch held. */
+static RC cursor_read(SM_FileHandle *h, int pageNum, int dir, SM_PageHandle memPage) {
+    uint64_t t0 = stat_clock();
+    SM_Internal *meta;
+    RC rc = sm_get_internal(h, &meta);
+    if (rc != RC_OK) return rc;
+    if (pageNum < 0 || pageNum >= h->totalNumPages)
+        return readBlock(pageNum, h, memPage);     /* reports the error */
+
+    int latchFirst = pageNum, latchCount = 1;
+    SM_Internal *held = auto_latch(h, latchFirst, latchCount, 0);
+    pthread_mutex_lock(&meta->raLock);
+    track_scan(meta, pageNum, dir, h->totalNumPages);
+
+    int buffered = (meta->flags & SM_OPEN_READAHEAD) && meta->map == NULL &&
+                   !sm_misaligned(meta, memPage);
+    if (buffered && meta->raStreak >= SM_RA_TRIGGER &&
+        !(pageNum >= meta->raStart && pageNum < meta->raStart + meta->raCount)) {
+        int first, count;
+        prefetch_range(meta, pageNum, dir, h->totalNumPages, &first, &count);
+        if (held != NULL) {
+            /* widen the latch to the refill, which covers pageNum */
+            pthread_mutex_unlock(&meta->raLock);
+            auto_unlatch(held, latchFirst, latchCount, 0);
+            latchFirst = first;
+            latchCount = count;
+            held = auto_latch(h, latchFirst, latchCount, 0);
+            pthread_mutex_lock(&meta->raLock);
+        }
+        fill_prefetch(meta, first, count);
+    }
+    if (buffered && pageNum >= meta->raStart && pageNum < meta->raStart + meta->raCount) {
+        /* a buffered write is newer than the prefetched image */
+        if (!sm_wb_read(meta, pageNum, memPage))
+            sm_page_copy(memPage, meta->raBuf + (size_t)(pageNum - meta->raStart) * (size_t)meta->pageSize,
+                         meta->pageSize);
+        pthread_mutex_unlock(&meta->raLock);
+        auto_unlatch(held, latchFirst, latchCount, 0);
+        h->curPagePos = pageNum;
+        stat_call(h, 0, pageNum, 1, RC_OK, t0);
+        return RC_OK;
+    }
+    pthread_mutex_unlock(&meta->raLock);
+    auto_unlatch(held, latchFirst, latchCount, 0);
+    return readBlock(pageNum, h, memPage);
+}
 
 /* --------------------------------------------------------------------------
    Public API
@@ -101,16 +1002,65 @@ void initStorageManager(void) {
     /* Nothing to initialize globally in this implementation. */
 }
 
-/* Create a new page file with exactly one zero-filled page. */
-RC createPageFile(char *fileName) {
-    FILE *fp = fopen(fileName, "wb+");     /* binary mode for portability */
-    if (fp == NULL) {
+/* Shared body of the create calls; members == 0 for an unstriped file. */
+static RC create_file(char *fileName, int flags, int pageSize,
+                      char *const *memberPaths, int members, int stripePages) {
+    if (pageSize < 0 || !valid_page_size((uint32_t)pageSize)) {
+        RC_message = "page size must be a power of two from SM_MIN_PAGE_SIZE to SM_MAX_PAGE_SIZE";
+        return RC_WRITE_FAILED;
+    }
+    if ((flags & SM_CREATE_COMPRESSED) && pageSize != PAGE_SIZE) {
+        RC_message = "compressed files use PAGE_SIZE pages";
+        return RC_WRITE_FAILED;
+    }
+    if ((flags & SM_CREATE_COMPRESSED) && members > 0) {
+        RC_message = "compressed files cannot be striped";
+        return RC_WRITE_FAILED;
+    }
+    /* truncating keeps the inode, so open handles would share stale state */
+    if (sm_file_is_open(fileName)) {
+        RC_message = "file is open; close its handles before re-creating it";
+        return RC_WRITE_FAILED;
+    }
+    int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         RC_message = "unable to create file";
         return RC_WRITE_FAILED;
     }
 
-    RC rc = write_zero_page(fp);
-    int close_rc = fclose(fp);
+    /* the data file of a compressed or striped file holds just the header:
+       its page is a zero entry in the page table, or sits in member 0 */
+    SM_FileHeader hdr;
+    init_header(&hdr, flags, pageSize);
+    if (members > 0) hdr.flags |= SM_HEADER_STRIPED;
+    remove_side_file(fileName, SM_PTT_SUFFIX);
+    remove_side_file(fileName, SM_FSM_SUFFIX);
+    remove_side_file(fileName, SM_WAL_SUFFIX);
+    remove_side_file(fileName, SM_STRIPE_SUFFIX);
+    RC rc;
+    if (flags & SM_CREATE_COMPRESSED)
+        rc = sm_ptt_create(fileName);
+    else if (members > 0)
+        rc = sm_stripe_create(fileName, memberPaths, members, stripePages, pageSize);
+    else
+        rc = extend_file(fd, 1, pageSize, NULL);
+    if (rc == RC_OK)
+        rc = write_header(fd, &hdr);
+    int close_rc = close(fd);
+
+    /* an empty side table is valid: every entry reads as "zero page" */
+    remove_side_file(fileName, SM_CRC_SUFFIX);
+    if (rc == RC_OK && (flags & SM_CREATE_CHECKSUM)) {
+        char *name = sm_side_file_name(fileName, SM_CRC_SUFFIX);
+        int crcFd = (name != NULL) ? open(name, O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+        free(name);
+        if (crcFd < 0) {
+            RC_message = "unable to create checksum table";
+            rc = RC_WRITE_FAILED;
+        } else {
+            close(crcFd);
+        }
+    }
 
     if (rc != RC_OK) return rc;
     if (close_rc != 0) {
@@ -120,36 +1070,116 @@ RC createPageFile(char *fileName) {
     return RC_OK;
 }
 
+/* Create a new page file with exactly one zero-filled page. */
+RC createPageFile(char *fileName) {
+    return createPageFileEx(fileName, 0);
+}
+
+/* Create a new page file with SM_CREATE_* format options. */
+RC createPageFileEx(char *fileName, int flags) {
+    return createPageFileSized(fileName, flags, PAGE_SIZE);
+}
+
+/* Create a new page file whose pages are pageSize bytes. */
+RC createPageFileSized(char *fileName, int flags, int pageSize) {
+    return create_file(fileName, flags, pageSize, NULL, 0, 0);
+}
+
+/* Create a page file whose data pages are striped over memberPaths. */
+RC createPageFileStriped(char *fileName, int flags, int pageSize,
+                         char *const *memberPaths, int memberCount, int stripePages) {
+    if (memberPaths == NULL || memberCount < 1) {
+        RC_message = "a striped file needs at least one member";
+        return RC_WRITE_FAILED;
+    }
+    return create_file(fileName, flags, pageSize, memberPaths, memberCount, stripePages);
+}
+
 /* Open an existing page file and populate the handle. */
 RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
+    return openPageFileEx(fileName, fHandle, 0);
+}
+
+/* Open an existing page file with SM_OPEN_* flags. */
+RC openPageFileEx(char *fileName, SM_FileHandle *fHandle, int flags) {
     if (fHandle == NULL) {
         RC_message = "file handle argument is NULL";
         return RC_FILE_HANDLE_NOT_INIT;
     }
 
-    FILE *fp = fopen(fileName, "rb+");     /* must be readable & writable */
-    if (fp == NULL) {
-        RC_message = "file not found";
-        return RC_FILE_NOT_FOUND;
+    if ((flags & SM_OPEN_MMAP) && (flags & SM_OPEN_DIRECT)) {
+        RC_message = "SM_OPEN_DIRECT cannot be combined with SM_OPEN_MMAP";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if ((flags & SM_OPEN_MMAP) && (flags & SM_OPEN_WRITEBACK)) {
+        RC_message = "SM_OPEN_WRITEBACK cannot be combined with SM_OPEN_MMAP";
+        return RC_FILE_HANDLE_NOT_INIT;
     }
 
-    SM_Internal *meta = (SM_Internal *)malloc(sizeof *meta);
+    /* the descriptor, header and page count come from the open-file
+       registry: other handles on the same file share them */
+    SM_SharedFile *sf;
+    RC rc = sm_file_acquire(fileName, flags, &sf);
+    if (rc != RC_OK) return rc;
+
+    SM_Internal *meta = new_internal((flags & SM_OPEN_DIRECT) ? sf->directFd : sf->fd, flags);
     if (meta == NULL) {
-        fclose(fp);
+        sm_file_release(sf);
         RC_message = "out of memory for mgmtInfo";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    meta->fp = fp;
+    meta->shared = sf;
 
     fHandle->fileName      = fileName;
     fHandle->mgmtInfo      = meta;
     fHandle->curPagePos    = 0;
 
-    RC rc = refresh_page_count(fHandle);
+    SM_FileHeader hdr = load_header(meta);
+    fHandle->totalNumPages = (int)hdr.pageCount;
+    meta->pageSize = (int)hdr.pageSize;
+    int compressed = (hdr.flags & SM_CREATE_COMPRESSED) != 0;
+    if (rc == RC_OK && compressed && (flags & (SM_OPEN_MMAP | SM_OPEN_DIRECT))) {
+        RC_message = "compressed files cannot be opened with SM_OPEN_MMAP or SM_OPEN_DIRECT";
+        rc = RC_FILE_HANDLE_NOT_INIT;
+    }
+    /* the slot allocator lives in the handle: a second one would hand out
+       the same slots */
+    if (rc == RC_OK && compressed && sm_file_refs(sf) > 1) {
+        RC_message = "compressed file is already open through another handle";
+        rc = RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (rc == RC_OK && compressed)
+        rc = sm_ptt_open(meta, fileName, fHandle->totalNumPages);
+    int striped = (hdr.flags & SM_HEADER_STRIPED) != 0;
+    if (rc == RC_OK && striped && (flags & (SM_OPEN_MMAP | SM_OPEN_SPARSE))) {
+        RC_message = "striped files cannot be opened with SM_OPEN_MMAP or SM_OPEN_SPARSE";
+        rc = RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (rc == RC_OK && striped)
+        rc = sm_stripe_open(meta, fileName, flags);
+    if (rc == RC_OK && (hdr.flags & SM_CREATE_CHECKSUM))
+        rc = load_checksums(sf, fileName);
+    if (rc == RC_OK && sf->crcFd >= 0 && (flags & SM_OPEN_MMAP)) {
+        RC_message = "checksummed files cannot be opened with SM_OPEN_MMAP";
+        rc = RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (rc == RC_OK && (hdr.flags & SM_HEADER_FREE_MAP)) {
+        pthread_mutex_lock(&meta->shared->headerLock);
+        rc = sm_fsm_open(meta->shared, fileName, 0);
+        pthread_mutex_unlock(&meta->shared->headerLock);
+    }
+    if (rc == RC_OK && (flags & SM_OPEN_MMAP))
+        rc = ensure_mapped(meta, fHandle->totalNumPages);
+    /* mapped and compressed files already read zero pages without I/O */
+    if (rc == RC_OK && (flags & SM_OPEN_SPARSE) && meta->map == NULL && meta->ptt == NULL)
+        rc = scan_holes(meta, 0, fHandle->totalNumPages);
+    if (rc == RC_OK)
+        rc = sm_wal_open(fHandle);      /* recovery writes through the handle */
+    if (rc == RC_OK && (flags & SM_OPEN_WRITEBACK))
+        rc = sm_wb_open(meta);
     if (rc != RC_OK) {
         /* Best-effort cleanup on failure */
-        fclose(fp);
-        free(meta);
+        free_internal(meta);
         fHandle->mgmtInfo = NULL;
         return rc;
     }
@@ -163,14 +1193,30 @@ RC closePageFile(SM_FileHandle *fHandle) {
         return RC_FILE_HANDLE_NOT_INIT;
     }
     SM_Internal *meta = (SM_Internal *)fHandle->mgmtInfo;
-    FILE *fp = meta->fp;
+    if (__atomic_load_n(&meta->snapsTaken, __ATOMIC_ACQUIRE) > 0) {
+        RC_message = "close the snapshots taken from this handle first";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (meta->snap != NULL) {
+        sm_snap_release(meta);
+        free_internal(meta);
+        fHandle->mgmtInfo = NULL;
+        return RC_OK;
+    }
 
-    int rc = fclose(fp);
-    /* Clear pointers even if fclose fails to avoid reuse; report error, though. */
-    meta->fp = NULL;
-    free(meta);
+    /* write back buffered pages, then checkpoint the log; SM_DURABILITY_NONE
+       defers its only flush to here */
+    RC sync_rc = sm_wb_close(meta);
+    if (sync_rc == RC_OK)
+        sync_rc = checkpointPageFile(fHandle);
+    if (sync_rc == RC_OK && meta->durability == SM_DURABILITY_NONE && meta->fd >= 0)
+        sync_rc = flush_to_disk(fHandle, meta);
+
+    /* Clear state even if close fails to avoid reuse; report error, though. */
+    int rc = free_internal(meta);
     fHandle->mgmtInfo = NULL;
 
+    if (sync_rc != RC_OK) return sync_rc;
     if (rc != 0) {
         RC_message = "closing file failed";
         return RC_FILE_HANDLE_NOT_INIT;
@@ -184,36 +1230,80 @@ RC destroyPageFile(char *fileName) {
         RC_message = "remove failed (file missing or in use)";
         return RC_FILE_NOT_FOUND;
     }
+    sm_stripe_remove(fileName);
+    remove_side_file(fileName, SM_STRIPE_SUFFIX);
+    remove_side_file(fileName, SM_CRC_SUFFIX);
+    remove_side_file(fileName, SM_PTT_SUFFIX);
+    remove_side_file(fileName, SM_FSM_SUFFIX);
+    remove_side_file(fileName, SM_WAL_SUFFIX);
     return RC_OK;
 }
 
-/* Read the page with absolute page number into memPage. */
-RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
+/* Body of readBlock (which adds the statistics). */
+static RC read_page(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL || memPage == NULL) {
         RC_message = "invalid arguments to readBlock";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    FILE *fp;
-    RC rc = get_stream(fHandle, &fp);
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
     if (rc != RC_OK) return rc;
 
     if (pageNum < 0 || pageNum >= fHandle->totalNumPages) {
         RC_message = "page number out of range";
         return RC_READ_NON_EXISTING_PAGE;
     }
+    if (sm_misaligned(meta, memPage)) {
+        RC_message = "direct I/O needs a PAGE_SIZE-aligned buffer (allocatePageHandle)";
+        return RC_PAGE_NOT_ALIGNED;
+    }
 
-    rc = move_to_page(fp, pageNum);
-    if (rc != RC_OK) return rc;
-
-    size_t got = fread(memPage, sizeof(char), PAGE_SIZE, fp);
-    if (got != PAGE_SIZE) {
+    size_t got;
+    if (sm_wb_read(meta, pageNum, memPage)) {
+        fHandle->curPagePos = pageNum;
+        return RC_OK;
+    } else if (meta->snap != NULL) {
+        rc = sm_snap_read(meta, pageNum, memPage);
+        if (rc != RC_OK) return rc;
+        fHandle->curPagePos = pageNum;
+        return RC_OK;
+    } else if (meta->ptt != NULL) {
+        rc = sm_ptt_read(meta, pageNum, memPage);
+        if (rc != RC_OK) return rc;
+        got = PAGE_SIZE;
+    } else if (meta->map != NULL) {
+        sm_page_copy(memPage, meta->map + sm_page_offset(meta, pageNum), meta->pageSize);
+        got = (size_t)meta->pageSize;
+    } else if (hole_known(meta, pageNum)) {
+        sm_page_zero(memPage, meta->pageSize);
+        got = (size_t)meta->pageSize;
+    } else {
+        int fd;
+        off_t off = sm_page_loc(meta, pageNum, &fd);
+        got = sm_pread_full(fd, memPage, (size_t)meta->pageSize, off);
+    }
+    if (got != (size_t)meta->pageSize) {
         RC_message = "incomplete page read";
         return RC_READ_NON_EXISTING_PAGE;
     }
+    rc = sm_checksum_verify(meta, pageNum, memPage);
+    if (rc != RC_OK) return rc;
 
     fHandle->curPagePos = pageNum;
     return RC_OK;
 }
+
+/* Read the page with absolute page number into memPage.
+   Uses pread, so no shared file position is consulted or changed. */
+RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
+    uint64_t t0 = stat_clock();
+    SM_Internal *held = auto_latch(fHandle, pageNum, 1, 0);
+    RC rc = read_page(pageNum, fHandle, memPage);
+    auto_unlatch(held, pageNum, 1, 0);
+    stat_call(fHandle, 0, pageNum, rc == RC_OK, rc, t0);
+    return rc;
+}
+
 /* Return current page index (or -1 if the handle isn't usable). */
 int getBlockPos(SM_FileHandle *fHandle) {
     if (fHandle == NULL || fHandle->mgmtInfo == NULL)
@@ -243,13 +1333,14 @@ RC readPreviousBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
         return RC_READ_NON_EXISTING_PAGE;
 
     int prev = fHandle->curPagePos - 1;
-    return readBlock(prev, fHandle, memPage);
+    return cursor_read(fHandle, prev, -1, memPage);
 }
 
 RC readCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL || fHandle->mgmtInfo == NULL || memPage == NULL)
         return RC_FILE_HANDLE_NOT_INIT;
 
+    refresh_page_count(fHandle);
     int here = fHandle->curPagePos;
     if (here < 0 || here >= fHandle->totalNumPages)
         return RC_READ_NON_EXISTING_PAGE;
@@ -261,17 +1352,19 @@ RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL || fHandle->mgmtInfo == NULL || memPage == NULL)
         return RC_FILE_HANDLE_NOT_INIT;
 
+    refresh_page_count(fHandle);
     int next = fHandle->curPagePos + 1;
     if (next >= fHandle->totalNumPages)
         return RC_READ_NON_EXISTING_PAGE;
 
-    return readBlock(next, fHandle, memPage);
+    return cursor_read(fHandle, next, +1, memPage);
 }
 
 RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL || fHandle->mgmtInfo == NULL || memPage == NULL)
         return RC_FILE_HANDLE_NOT_INIT;
 
+    refresh_page_count(fHandle);
     if (fHandle->totalNumPages <= 0)
         return RC_READ_NON_EXISTING_PAGE;
 
@@ -279,37 +1372,247 @@ RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     return readBlock(last, fHandle, memPage);
 }
 
-/* Write a page at an absolute page number  */
-RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
+/* Body of writeBlock (which adds the statistics). */
+static RC write_page(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
     
     if (!(fHandle && memPage))
         return RC_FILE_HANDLE_NOT_INIT;
 
-    FILE *fp = NULL;
-    RC st = get_stream(fHandle, &fp);
+    SM_Internal *meta = NULL;
+    RC st = sm_get_writable(fHandle, &meta);
     if (st != RC_OK) return st;
 
     if (pageNum < 0 || pageNum >= fHandle->totalNumPages) {
         RC_message = "page index outside valid range for write";
         return RC_WRITE_FAILED;
     }
+    if (sm_misaligned(meta, memPage)) {
+        RC_message = "direct I/O needs a PAGE_SIZE-aligned buffer (allocatePageHandle)";
+        return RC_PAGE_NOT_ALIGNED;
+    }
 
-    const long offset = (long)pageNum * (long)PAGE_SIZE;
-    if (fseek(fp, offset, SEEK_SET) != 0) {
-        RC_message = "seek failed before write";
-        return RC_WRITE_FAILED;
+    if (meta->wb != NULL) {
+        st = sm_wb_write(meta, pageNum, &memPage, 1);
+        if (st != RC_OK) return st;
+        fHandle->curPagePos = pageNum;
+        return RC_OK;
     }
 
-    size_t out = fwrite(memPage, 1, PAGE_SIZE, fp);
-    if (out != (size_t)PAGE_SIZE || fflush(fp) != 0) {
-        RC_message = "incomplete page write or flush failure";
+    st = sm_snap_write_begin(meta, pageNum, 1);
+    if (st != RC_OK) return st;
+    size_t out;
+    if (meta->ptt != NULL) {
+        st = sm_ptt_write(meta, pageNum, memPage);
+        out = (st == RC_OK) ? PAGE_SIZE : 0;
+    } else if (meta->map != NULL) {
+        sm_page_copy(meta->map + sm_page_offset(meta, pageNum), memPage, meta->pageSize);
+        out = (size_t)meta->pageSize;
+    } else if (sm_is_zero_page(memPage, meta->pageSize) && punch_page(meta, pageNum) == 0) {
+        out = (size_t)meta->pageSize;
+    } else {
+        int fd;
+        off_t off = sm_page_loc(meta, pageNum, &fd);
+        out = sm_pwrite_full(fd, memPage, (size_t)meta->pageSize, off);
+        if (out == (size_t)meta->pageSize) sm_holes_clear(meta, pageNum, 1);
+    }
+    sm_snap_write_end(meta);
+    if (st != RC_OK) return st;
+    if (out != (size_t)meta->pageSize) {
+        RC_message = "incomplete page write";
         return RC_WRITE_FAILED;
     }
+    st = sm_checksum_update(meta, pageNum, &memPage, 1);
+    if (st != RC_OK) return st;
+    sm_invalidate_prefetch(meta, pageNum, 1);
 
     fHandle->curPagePos = pageNum;
     return RC_OK;
 }
 
+/* Write a page at an absolute page number  */
+RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
+    uint64_t t0 = stat_clock();
+    SM_Internal *held = auto_latch(fHandle, pageNum, 1, 1);
+    RC rc = write_page(pageNum, fHandle, memPage);
+    auto_unlatch(held, pageNum, 1, 1);
+    stat_call(fHandle, 1, pageNum, rc == RC_OK, rc, t0);
+    return rc;
+}
+
+/* Write pages [first, first+count) to the file, runs of data pages in one
+   call each and all-zero pages punched out as write_page does; returns the
+   leading pages written. */
+static int write_punching(SM_Internal *meta, int first, SM_PageHandle *pages, int count) {
+    int at = 0;
+    while (at < count) {
+        if (sm_is_zero_page(pages[at], meta->pageSize) && punch_page(meta, first + at) == 0) {
+            at++;
+            continue;
+        }
+        int n = 1;
+        while (at + n < count && !sm_is_zero_page(pages[at + n], meta->pageSize)) n++;
+        int got = (meta->stripe != NULL)
+            ? sm_stripe_rw(meta, first + at, pages + at, n, 1)
+            : sm_rw_pages(meta->fd, pages + at, n, meta->pageSize,
+                          sm_page_offset(meta, first + at), 1);
+        sm_holes_clear(meta, first + at, got);
+        at += got;
+        if (got < n) break;
+    }
+    return at;
+}
+
+/* Write `count` pages from `first` by the handle's own path; *done
+   receives the leading pages written. */
+RC sm_write_pages(SM_Internal *meta, int first, SM_PageHandle *pages, int count, int *done) {
+    RC rc = sm_snap_write_begin(meta, first, count);
+    if (rc != RC_OK) {
+        *done = 0;
+        return rc;
+    }
+    int n;
+    if (meta->ptt != NULL) {
+        for (n = 0; n < count; ++n)
+            if (sm_ptt_write(meta, first + n, pages[n]) != RC_OK) break;
+    } else if (meta->map != NULL) {
+        for (n = 0; n < count; ++n)
+            sm_page_copy(meta->map + sm_page_offset(meta, first + n), pages[n], meta->pageSize);
+    } else {
+        n = write_punching(meta, first, pages, count);
+    }
+    sm_snap_write_end(meta);
+
+    *done = n;
+    if (meta->ptt != NULL || meta->map != NULL) sm_holes_clear(meta, first, n);
+    rc = sm_checksum_update(meta, first, pages, n);
+    if (rc != RC_OK) return rc;
+    if (n > 0) sm_invalidate_prefetch(meta, first, n);
+    return RC_OK;
+}
+
+/* Reads through a write-back handle: buffered pages are copied from the
+   dirty table, the runs between them read and verified from the file.
+   Each page is looked up before it is read, so a flush completing in
+   between cannot leave an older image. */
+static RC read_through_writeback(SM_Internal *meta, int first, SM_PageHandle *pages,
+                                 int count, int *done) {
+    int at = 0;
+    while (at < count) {
+        if (sm_wb_read(meta, first + at, pages[at])) {
+            at++;
+            continue;
+        }
+        int n = 1;
+        while (at + n < count && !sm_wb_read(meta, first + at + n, NULL)) n++;
+        int got = sm_read_pages(meta, first + at, pages + at, n);
+        for (int i = 0; i < got; ++i) {
+            RC rc = sm_checksum_verify(meta, first + at + i, pages[at + i]);
+            if (rc != RC_OK) {
+                *done = at + i;
+                return rc;
+            }
+        }
+        at += got;
+        if (got < n) break;
+    }
+    *done = at;
+    return RC_OK;
+}
+
+/* Shared body of readBlocks/writeBlocks: clip the range to the file, move
+   the pages and leave the cursor on the last page transferred. */
+static RC transfer_range(int startPage, int count, SM_FileHandle *fHandle,
+                         SM_PageHandle *memPages, int *pagesDone, int writing) {
+    RC fail = writing ? RC_WRITE_FAILED : RC_READ_NON_EXISTING_PAGE;
+    if (pagesDone != NULL) *pagesDone = 0;
+    if (fHandle == NULL || memPages == NULL || count < 0) {
+        RC_message = "invalid arguments to vectored page I/O";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = writing ? sm_get_writable(fHandle, &meta) : sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    if (startPage < 0 || startPage > fHandle->totalNumPages) {
+        RC_message = "page number out of range";
+        return fail;
+    }
+    int avail = fHandle->totalNumPages - startPage;
+    int want = (count < avail) ? count : avail;
+    for (int i = 0; i < want; ++i) {
+        if (sm_misaligned(meta, memPages[i])) {
+            RC_message = "direct I/O needs PAGE_SIZE-aligned buffers (allocatePageHandle)";
+            return RC_PAGE_NOT_ALIGNED;
+        }
+    }
+
+    int done = 0;
+    if (writing && meta->wb != NULL) {
+        rc = sm_wb_write(meta, startPage, memPages, want);
+        if (rc != RC_OK) return rc;
+        done = want;
+    } else if (writing) {
+        rc = sm_write_pages(meta, startPage, memPages, want, &done);
+        if (rc != RC_OK) return rc;
+    } else if (meta->snap != NULL) {
+        for (done = 0; done < want; ++done) {
+            if ((rc = sm_snap_read(meta, startPage + done, memPages[done])) != RC_OK) {
+                if (pagesDone != NULL) *pagesDone = done;
+                return rc;
+            }
+        }
+    } else {
+        if (meta->wb != NULL)
+            rc = read_through_writeback(meta, startPage, memPages, want, &done);
+        else if (meta->map != NULL)
+            for (done = 0; done < want; ++done)
+                sm_page_copy(memPages[done], meta->map + sm_page_offset(meta, startPage + done),
+                             meta->pageSize);
+        else
+            done = sm_read_pages(meta, startPage, memPages, want);
+        for (int i = 0; i < done && rc == RC_OK && meta->wb == NULL; ++i) {
+            rc = sm_checksum_verify(meta, startPage + i, memPages[i]);
+            if (rc != RC_OK) done = i;
+        }
+        if (rc != RC_OK) {
+            if (pagesDone != NULL) *pagesDone = done;
+            return rc;
+        }
+    }
+    if (done > 0) fHandle->curPagePos = startPage + done - 1;
+    if (pagesDone != NULL) *pagesDone = done;
+    if (done < count) {
+        RC_message = (want < count) ? "page range runs past end of file"
+                                    : "incomplete vectored page transfer";
+        return fail;
+    }
+    return RC_OK;
+}
+
+/* Read `count` consecutive pages starting at startPage into memPages[]. */
+RC readBlocks(int startPage, int count, SM_FileHandle *fHandle,
+              SM_PageHandle *memPages, int *pagesRead) {
+    int done = 0;
+    SM_Internal *held = auto_latch(fHandle, startPage, count, 0);
+    RC rc = transfer_range(startPage, count, fHandle, memPages, &done, 0);
+    auto_unlatch(held, startPage, count, 0);
+    stat_call(fHandle, 0, startPage, done, rc, 0);
+    if (pagesRead != NULL) *pagesRead = done;
+    return rc;
+}
+
+/* Write memPages[] to `count` consecutive pages starting at startPage. */
+RC writeBlocks(int startPage, int count, SM_FileHandle *fHandle,
+               SM_PageHandle *memPages, int *pagesWritten) {
+    int done = 0;
+    SM_Internal *held = auto_latch(fHandle, startPage, count, 1);
+    RC rc = transfer_range(startPage, count, fHandle, memPages, &done, 1);
+    auto_unlatch(held, startPage, count, 1);
+    stat_call(fHandle, 1, startPage, done, rc, 0);
+    if (pagesWritten != NULL) *pagesWritten = done;
+    return rc;
+}
+
 /* Write the page at the current position (does not move the cursor). */
 RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL) {
@@ -325,34 +1628,339 @@ RC appendEmptyBlock(SM_FileHandle *fHandle) {
         RC_message = "file handle not initialized";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    FILE *fp;
-    RC rc = get_stream(fHandle, &fp);
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
     if (rc != RC_OK) return rc;
 
-    if (fseek(fp, 0L, SEEK_END) != 0) {
-        RC_message = "seek to end failed";
-        return RC_WRITE_FAILED;
+    SM_Internal *held = latch_all(fHandle);
+    rc = grow_handle(fHandle, meta, fHandle->totalNumPages + 1);
+    unlatch_all(held);
+    return rc;
+}
+
+/* Ensure file has at least numberOfPages pages; grows in one step. */
+RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
+    if (fHandle == NULL) {
+        RC_message = "file handle not initialized";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *held = latch_all(fHandle);
+    RC rc = RC_OK;
+    if (numberOfPages > fHandle->totalNumPages) {
+        SM_Internal *meta;
+        rc = sm_get_writable(fHandle, &meta);
+        if (rc == RC_OK)
+            rc = grow_handle(fHandle, meta, numberOfPages);
     }
-    rc = write_zero_page(fp);
+    unlatch_all(held);
+    return rc;
+}
+
+/* Body of allocatePage (which adds the latching). */
+static RC allocate_page(SM_FileHandle *fHandle, int *pageNum) {
+    if (pageNum == NULL) {
+        RC_message = "invalid arguments to allocatePage";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
     if (rc != RC_OK) return rc;
 
-    fHandle->totalNumPages += 1;
+    int page = take_free_page(meta, &rc);
+    if (rc != RC_OK) return rc;
+    if (page < 0) {
+        page = fHandle->totalNumPages;
+        rc = grow_handle(fHandle, meta, page + 1);
+    } else if (page >= fHandle->totalNumPages) {
+        /* freed through a handle that has grown past this one's view */
+        rc = grow_handle(fHandle, meta, page + 1);
+    }
+    if (rc != RC_OK) return rc;
+    *pageNum = page;
     return RC_OK;
 }
 
-/* Ensure file has at least numberOfPages pages by appending zeros. */
-RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
-    if (fHandle == NULL) {
-        RC_message = "file handle not initialized";
+/* Hand out a page: the lowest one released by freePage, else a new zero
+   page at EOF. Either way the page reads as zeros until written. */
+RC allocatePage(SM_FileHandle *fHandle, int *pageNum) {
+    SM_Internal *held = latch_all(fHandle);
+    RC rc = allocate_page(fHandle, pageNum);
+    unlatch_all(held);
+    return rc;
+}
+
+/* Body of freePage (which adds the latching). */
+static RC free_page(SM_FileHandle *fHandle, int pageNum) {
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    if (pageNum < 0 || pageNum >= fHandle->totalNumPages) {
+        RC_message = "page number out of range";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    SM_SharedFile *sf = meta->shared;
+    pthread_mutex_lock(&sf->headerLock);
+    int isFree = sm_fsm_is_free(sf, pageNum);
+    pthread_mutex_unlock(&sf->headerLock);
+    if (isFree) {
+        RC_message = "page is already free";
+        return RC_PAGE_ALREADY_FREE;
+    }
+    /* a buffered write must not land on the page after it is zeroed */
+    rc = sm_wb_drain(meta);
+    if (rc != RC_OK) return rc;
+    rc = sm_snap_write_begin(meta, pageNum, 1);
+    if (rc != RC_OK) return rc;
+    rc = zero_page_on_disk(meta, pageNum);
+    sm_snap_write_end(meta);
+    if (rc != RC_OK) return rc;
+    sm_invalidate_prefetch(meta, pageNum, 1);
+    pthread_mutex_lock(&sf->headerLock);
+    if (sm_fsm_is_free(sf, pageNum)) {
+        /* another handle freed it meanwhile */
+        RC_message = "page is already free";
+        rc = RC_PAGE_ALREADY_FREE;
+    } else {
+        rc = sm_fsm_open(sf, fHandle->fileName, 1);
+    }
+    /* hint before bit: a crash in between leaves the hint merely low */
+    if (rc == RC_OK)
+        rc = store_free_hint(meta, pageNum);
+    if (rc == RC_OK)
+        rc = sm_fsm_set(sf, pageNum, 1);
+    pthread_mutex_unlock(&sf->headerLock);
+    return rc;
+}
+
+/* Return a page to the free-space map for allocatePage to reuse. The page
+   is zeroed, as a hole where possible; the file keeps its size. */
+RC freePage(SM_FileHandle *fHandle, int pageNum) {
+    SM_Internal *held = latch_all(fHandle);
+    RC rc = free_page(fHandle, pageNum);
+    unlatch_all(held);
+    return rc;
+}
+
+/* Return a pointer to pageNum inside the mapping of an SM_OPEN_MMAP handle. */
+RC getPagePtr(int pageNum, SM_FileHandle *fHandle, SM_PageHandle *pagePtr) {
+    if (pagePtr == NULL) {
+        RC_message = "invalid arguments to getPagePtr";
         return RC_FILE_HANDLE_NOT_INIT;
     }
-    if (numberOfPages <= fHandle->totalNumPages) {
-        return RC_OK;
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    if (meta->map == NULL) {
+        RC_message = "handle was not opened with SM_OPEN_MMAP";
+        return RC_FILE_MAP_FAILED;
     }
-    /* Append until the requested capacity is met. */
-    while (fHandle->totalNumPages < numberOfPages) {
-        RC rc = appendEmptyBlock(fHandle);
-        if (rc != RC_OK) return rc;
+    if (pageNum < 0 || pageNum >= fHandle->totalNumPages) {
+        RC_message = "page number out of range";
+        return RC_READ_NON_EXISTING_PAGE;
+    }
+    *pagePtr = meta->map + sm_page_offset(meta, pageNum);
+    fHandle->curPagePos = pageNum;
+    return RC_OK;
+}
+
+/* Open a read-only handle on the file as it is now. Writes through
+   fHandle after this keep the old images for it in a shadow file. */
+RC createSnapshot(SM_FileHandle *fHandle, SM_FileHandle *snapshot) {
+    if (snapshot == NULL) {
+        RC_message = "invalid arguments to createSnapshot";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+    if (meta->map != NULL) {
+        RC_message = "snapshots need a handle opened without SM_OPEN_MMAP";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    /* the snapshot reads the file itself, so buffered writes go there first */
+    rc = sm_wb_drain(meta);
+    if (rc != RC_OK) return rc;
+
+    SM_Internal *snapMeta = new_internal(-1, meta->flags & SM_OPEN_DIRECT);
+    if (snapMeta == NULL) {
+        RC_message = "out of memory for mgmtInfo";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    sm_file_retain(meta->shared);       /* its reads count towards the file */
+    snapMeta->shared = meta->shared;
+    snapMeta->pageSize = meta->pageSize;
+    rc = sm_snap_create(meta, snapMeta, fHandle->fileName, fHandle->totalNumPages);
+    if (rc != RC_OK) {
+        free_internal(snapMeta);
+        return rc;
+    }
+    snapshot->fileName = fHandle->fileName;
+    snapshot->totalNumPages = fHandle->totalNumPages;
+    snapshot->curPagePos = 0;
+    snapshot->mgmtInfo = snapMeta;
+    return RC_OK;
+}
+
+/* Choose how syncPageFile (and closePageFile) push writes to disk. */
+RC setDurabilityMode(SM_FileHandle *fHandle, SM_Durability mode) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+    if (mode != SM_DURABILITY_NONE && mode != SM_DURABILITY_FLUSH_ON_SYNC &&
+        mode != SM_DURABILITY_GROUP_COMMIT) {
+        RC_message = "unknown durability mode";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    meta->durability = mode;
+    return RC_OK;
+}
+
+/* Push written pages to stable storage according to the durability mode. */
+RC syncPageFile(SM_FileHandle *fHandle) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    if (meta->snap != NULL) return RC_OK;     /* nothing written through it */
+    rc = sm_wb_drain(meta);
+    if (rc != RC_OK) return rc;
+    switch (meta->durability) {
+    case SM_DURABILITY_NONE:         return RC_OK;
+    case SM_DURABILITY_GROUP_COMMIT: return group_sync(fHandle, meta);
+    default:                         return flush_to_disk(fHandle, meta);
+    }
+}
+
+/* Take the latch of pageNum in the given mode, waiting for it as needed. */
+RC latchPage(SM_FileHandle *fHandle, int pageNum, SM_LatchMode mode) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+    if (pageNum < 0 || (mode != SM_LATCH_SHARED && mode != SM_LATCH_EXCLUSIVE)) {
+        RC_message = "invalid arguments to latchPage";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    return sm_latch_page(meta, pageNum, mode == SM_LATCH_EXCLUSIVE);
+}
+
+/* Release a latch taken with latchPage. */
+RC unlatchPage(SM_FileHandle *fHandle, int pageNum, SM_LatchMode mode) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+    if (pageNum < 0 || (mode != SM_LATCH_SHARED && mode != SM_LATCH_EXCLUSIVE)) {
+        RC_message = "invalid arguments to unlatchPage";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    return sm_unlatch_page(meta, pageNum, mode == SM_LATCH_EXCLUSIVE);
+}
+
+/* Resize the dirty-page table and set the age limit of a write-back handle. */
+RC setWriteBackLimits(SM_FileHandle *fHandle, int maxDirtyPages, int maxAgeMs) {
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+    if (meta->wb == NULL) {
+        RC_message = "handle was not opened with SM_OPEN_WRITEBACK";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (maxDirtyPages < 1 || maxAgeMs < 1) {
+        RC_message = "write-back limits must be positive";
+        return RC_FILE_HANDLE_NOT_INIT;
     }
+    return sm_wb_set_limits(meta, maxDirtyPages, maxAgeMs);
+}
+
+/* Snapshot of the file's counters; each field is read atomically. */
+RC getPageFileStats(SM_FileHandle *fHandle, SM_FileStats *stats) {
+    if (stats == NULL) {
+        RC_message = "invalid arguments to getPageFileStats";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = sm_get_internal(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    memset(stats, 0, sizeof *stats);
+#ifndef SM_NO_STATS
+    const unsigned long long *src = (const unsigned long long *)&meta->shared->stats;
+    unsigned long long *dst = (unsigned long long *)stats;
+    for (size_t i = 0; i < sizeof *stats / sizeof *dst; ++i)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+#endif
     return RC_OK;
 }
+
+/* Upper bound (ns) of the bucket holding the q-quantile of a histogram. */
+static unsigned long long latency_quantile(const unsigned long long *hist,
+                                           unsigned long long total, double q) {
+    unsigned long long want = (unsigned long long)(q * (double)total + 0.999999);
+    unsigned long long seen = 0;
+    for (int b = 0; b < SM_STATS_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen >= want) return 2ull << b;
+    }
+    return 2ull << (SM_STATS_BUCKETS - 1);
+}
+
+static void dump_latency(FILE *out, const char *name, const unsigned long long *hist) {
+    unsigned long long total = 0;
+    for (int b = 0; b < SM_STATS_BUCKETS; ++b) total += hist[b];
+    if (total == 0) {
+        fprintf(out, "  %s latency: no samples\n", name);
+        return;
+    }
+    fprintf(out, "  %s latency: %llu calls, p50 < %llu ns, p99 < %llu ns\n", name, total,
+            latency_quantile(hist, total, 0.50), latency_quantile(hist, total, 0.99));
+    for (int b = 0; b < SM_STATS_BUCKETS; ++b)
+        if (hist[b] != 0)
+            fprintf(out, "    [%llu, %llu) ns  %llu\n", b ? 1ull << b : 0ull, 2ull << b, hist[b]);
+}
+
+/* Human-readable dump of getPageFileStats. */
+RC dumpPageFileStats(SM_FileHandle *fHandle, FILE *out) {
+    SM_FileStats st;
+    RC rc = getPageFileStats(fHandle, &st);
+    if (rc != RC_OK) return rc;
+    if (out == NULL) out = stdout;
+
+    fprintf(out, "page file %s: %d pages\n", fHandle->fileName ? fHandle->fileName : "?",
+            fHandle->totalNumPages);
+    fprintf(out, "  reads   %llu pages, %llu bytes\n", st.reads, st.bytesRead);
+    fprintf(out, "  writes  %llu pages, %llu bytes\n", st.writes, st.bytesWritten);
+    fprintf(out, "  appends %llu pages\n", st.appends);
+    fprintf(out, "  seeks %llu, flushes %llu, errors %llu\n", st.seeks, st.flushes, st.errors);
+    if (st.writebackRuns > 0)
+        fprintf(out, "  write-back %llu pages in %llu writes\n", st.writebackPages, st.writebackRuns);
+    dump_latency(out, "readBlock", st.readLatency);
+    dump_latency(out, "writeBlock", st.writeLatency);
+    return RC_OK;
+}
+
+/* Allocate a zero-filled, PAGE_SIZE-aligned page buffer. */
+SM_PageHandle allocatePageHandle(void) {
+    return allocatePageHandleSized(PAGE_SIZE);
+}
+
+/* Same, pageSize bytes long (a file's getPageSize). */
+SM_PageHandle allocatePageHandleSized(int pageSize) {
+    void *p = NULL;
+    if (pageSize <= 0 || posix_memalign(&p, PAGE_SIZE, (size_t)pageSize) != 0)
+        return NULL;
+    sm_page_zero(p, pageSize);
+    return (SM_PageHandle)p;
+}
+
+/* Bytes per page of an open file, or -1 if the handle isn't usable. */
+int getPageSize(SM_FileHandle *fHandle) {
+    if (fHandle == NULL || fHandle->mgmtInfo == NULL)
+        return -1;
+    return ((SM_Internal *)fHandle->mgmtInfo)->pageSize;
+}
+
+/* Release a buffer from allocatePageHandle. */
+void freePageHandle(SM_PageHandle memPage) {
+    free(memPage);
+}
@@ -3,6 +3,8 @@
 
 #include "dberror.h"
 
+#include <stdio.h>
+
 /************************************************************
  *                    handle data structures                *
  ************************************************************/
@@ -15,29 +17,254 @@ typedef struct SM_FileHandle {
 
 typedef char* SM_PageHandle;
 
+/* when written pages are pushed to stable storage (per handle) */
+typedef enum SM_Durability {
+	SM_DURABILITY_NONE = 0,           /* never synced until closePageFile */
+	SM_DURABILITY_FLUSH_ON_SYNC = 1,  /* syncPageFile issues fdatasync (default) */
+	SM_DURABILITY_GROUP_COMMIT = 2    /* concurrent syncPageFile calls share one fdatasync */
+} SM_Durability;
+
+/* per-file I/O statistics (getPageFileStats), summed over every handle
+   open on the file and reset when the last one closes. Latency bucket i
+   counts calls that took [2^i, 2^(i+1)) ns; the last bucket also holds
+   anything slower. Build with -DSM_NO_STATS to compile the bookkeeping out. */
+#define SM_STATS_BUCKETS 32
+
+typedef struct SM_FileStats {
+	unsigned long long reads;          /* pages read (any read call or async read) */
+	unsigned long long writes;         /* pages written */
+	unsigned long long appends;        /* pages added by appendEmptyBlock/ensureCapacity */
+	unsigned long long bytesRead;
+	unsigned long long bytesWritten;
+	unsigned long long seeks;          /* transfers not starting where the last one ended */
+	unsigned long long flushes;        /* fdatasync/msync calls issued */
+	unsigned long long errors;         /* calls that returned an error */
+	unsigned long long writebackRuns;  /* vectored writes issued for buffered pages */
+	unsigned long long writebackPages; /* buffered pages written out */
+	unsigned long long readLatency[SM_STATS_BUCKETS];   /* readBlock and cursor reads */
+	unsigned long long writeLatency[SM_STATS_BUCKETS];  /* writeBlock */
+} SM_FileStats;
+
+/* page sizes createPageFileSized accepts: powers of two in this range.
+   The size is stored in the file header; every page buffer passed for a
+   file must hold getPageSize bytes (compressed files always use PAGE_SIZE). */
+#define SM_MIN_PAGE_SIZE PAGE_SIZE
+#define SM_MAX_PAGE_SIZE 65536
+
+/* striped files (createPageFileStriped): data pages are spread round-robin,
+   stripePages at a time, over up to SM_STRIPE_MAX_MEMBERS member files,
+   e.g. one per device. The member list is kept in <fileName>.stripe, so
+   openPageFile(fileName) finds the members again; paths are stored as
+   given (relative ones resolve against the working directory). Vectored
+   transfers spanning several members run one stream per member in
+   parallel. Striped files cannot be compressed, and cannot be opened
+   with SM_OPEN_MMAP or SM_OPEN_SPARSE. */
+#define SM_STRIPE_MAX_MEMBERS 16
+
+/* flags for createPageFileEx */
+#define SM_CREATE_CHECKSUM 0x1  /* CRC32C per page in <fileName>.crc, checked on every read */
+#define SM_CREATE_COMPRESSED 0x2    /* pages stored compressed, mapped via <fileName>.ptt */
+/* A compressed file keeps its slot allocator in the handle: open it through
+   one handle at a time (a second open is refused), without SM_OPEN_MMAP /
+   SM_OPEN_DIRECT, and not with the asynchronous queue. Zero pages take no space in the data file. */
+
+/* Shared open files: handles opened on the same file (found by device and
+   inode, whatever the path) share one descriptor (one more for
+   SM_OPEN_DIRECT handles), the header and page count, the write-ahead log,
+   the free-space map, the checksum table, the page latches, the
+   snapshots and the statistics. Pages added through one handle show up in
+   the others' totalNumPages at their next call; a mapped handle sees them
+   up to the end of its own mapping. An open file cannot be re-created
+   with createPageFile* until its handles are closed. */
+
+/* flags for openPageFileEx (may be OR'ed together) */
+#define SM_OPEN_MMAP   0x1   /* map the file; enables getPagePtr */
+#define SM_OPEN_DIRECT 0x2   /* O_DIRECT: page buffers must come from allocatePageHandle */
+#define SM_OPEN_READAHEAD 0x4 /* cursor scans are served from a prefetch buffer */
+#define SM_OPEN_SPARSE 0x8   /* readBlock returns holes from memory (see below) */
+/* Zero pages are stored as holes: growth uses ftruncate, and writing an
+   all-zero page or freeing a page punches the page out of the file. An
+   SM_OPEN_SPARSE handle also maps the holes (SEEK_HOLE/SEEK_DATA) at open
+   and keeps the map current through its own writes; a page written by
+   another handle may still read as zeros through it. */
+#define SM_OPEN_WRITEBACK 0x10  /* writes are buffered and flushed in the background */
+/* Write-back: writeBlock(s) copy the pages into the handle's dirty-page
+   table and return. A flusher thread writes the table out sorted by page
+   number, neighbouring pages merged into one vectored write, once half of
+   it is dirty or its oldest page reaches the age limit; syncPageFile,
+   closePageFile and the calls that reach the file another way (scans,
+   snapshots, freePage, the asynchronous queue, log checkpoints) write it
+   out first. Reads through the handle see the buffered pages; other
+   handles see them once written. A failed background write drops its
+   pages and is reported by the next write, sync or close on the handle.
+   Not with SM_OPEN_MMAP. */
+#define SM_WRITEBACK_PAGES 256      /* default dirty-table size in pages */
+#define SM_WRITEBACK_AGE_MS 100     /* default age limit of a dirty page */
+#define SM_OPEN_LATCHED 0x20    /* read and write calls latch their pages (see latchPage) */
+
+/* page latches (latchPage): reader/writer latches on page numbers, one
+   table per file, shared by all its handles. Page n uses latch n % SM_LATCH_STRIPES, so pages that
+   far apart share a latch; a thread taking several should take them in
+   increasing order of that index and never two in one stripe. */
+#define SM_LATCH_STRIPES 256
+
+typedef enum SM_LatchMode {
+	SM_LATCH_SHARED = 0,
+	SM_LATCH_EXCLUSIVE = 1
+} SM_LatchMode;
+
+/************************************************************
+ *                    thread-safety contract                *
+ ************************************************************
+ * Error context (RC_message) is per thread; see dberror.h.
+ *
+ * initStorageManager   call once before starting threads.
+ * createPageFile,      safe from any thread for different file names.
+ * destroyPageFile
+ * openPageFile(Ex),    one thread per handle; no other call may be using
+ * closePageFile        the handle while it is opened or closed.
+ * readBlock(s),        safe concurrently on one shared handle. Concurrent
+ * writeBlock(s),       writes to the same page leave one of them; a read
+ * getPagePtr,          racing a write of the same page may see a mix.
+ * syncPageFile,        curPagePos ends up at the last page any of them
+ * createSnapshot,      touched. Snapshot handles may be read while the
+ * scanPageFile         handle they came from is written.
+ * appendEmptyBlock,    exclusive: no other call on the handle may run
+ * ensureCapacity,      at the same time (they change totalNumPages and
+ * allocatePage,        may remap a mapped file). On SM_OPEN_LATCHED
+ * freePage,            handles the first four take every page latch
+ *                      instead and may run alongside reads and writes.
+ * setDurabilityMode,
+ * setWriteBackLimits
+ * read{First,Previous, cursor calls read or move curPagePos and are
+ * Current,Next,Last}-  meant for one thread per handle.
+ * Block, getBlockPos,
+ * writeCurrentBlock
+ * allocatePageHandle(Sized), safe from any thread.
+ * freePageHandle,
+ * getPageSize
+ * latchPage,           safe from any thread.
+ * unlatchPage
+ ************************************************************/
+
 /************************************************************
  *                    interface                             *
  ************************************************************/
 /* manipulating page files */
 extern void initStorageManager (void);
 extern RC createPageFile (char *fileName);
+extern RC createPageFileEx (char *fileName, int flags);
+extern RC createPageFileSized (char *fileName, int flags, int pageSize);
+extern RC createPageFileStriped (char *fileName, int flags, int pageSize,
+		char *const *memberPaths, int memberCount, int stripePages);
 extern RC openPageFile (char *fileName, SM_FileHandle *fHandle);
+extern RC openPageFileEx (char *fileName, SM_FileHandle *fHandle, int flags);
 extern RC closePageFile (SM_FileHandle *fHandle);
 extern RC destroyPageFile (char *fileName);
 
-/* reading blocks from disc */
+/* reading blocks from disc (positional pread; no shared seek position)
+   readNextBlock/readPreviousBlock detect sequential scans and ask the kernel
+   to read an adaptively growing window ahead; with SM_OPEN_READAHEAD that
+   window is also fetched into a private buffer with one call per window.
+   Writes through the same handle invalidate the buffer; writes through
+   other handles may not be seen by a scan until it leaves the window. */
 extern RC readBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern int getBlockPos (SM_FileHandle *fHandle);
+extern int getPageSize (SM_FileHandle *fHandle);
 extern RC readFirstBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readPreviousBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readNextBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readLastBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 
+/* multi-page transfers: pages startPage .. startPage+count-1 move with one
+   vectored syscall per batch. The page count actually transferred is stored
+   in *pagesRead / *pagesWritten (may be NULL); a range running past the end
+   of the file is clipped and reported with the usual read/write error. */
+extern RC readBlocks (int startPage, int count, SM_FileHandle *fHandle,
+		SM_PageHandle *memPages, int *pagesRead);
+
+/* parallel scans: scanPageFile calls callback(pageNum, page, ctx) once for
+   every page in startPage .. endPage-1, from nThreads threads (the caller
+   included; <= 0 means one per CPU). Pages are read in chunks with
+   positional I/O. Each thread works through its own share of the range
+   in order, and a thread that runs out takes half of the largest share
+   left, so pages are visited in no fixed order and ctx must tolerate
+   concurrent calls. page is valid only during the call and must not be
+   written. A callback returning anything but RC_OK stops the scan, and
+   that code (or the first read error) is returned. curPagePos is left
+   unchanged. */
+typedef RC (*SM_ScanCallback) (int pageNum, SM_PageHandle page, void *ctx);
+extern RC scanPageFile (SM_FileHandle *fHandle, int startPage, int endPage,
+		SM_ScanCallback callback, void *ctx, int nThreads);
+
 /* writing blocks to a page file */
 extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC writeBlocks (int startPage, int count, SM_FileHandle *fHandle,
+		SM_PageHandle *memPages, int *pagesWritten);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
 
+/* page allocation: freePage records a page as unused in an on-disk bitmap
+   (<fileName>.fsm, created on first use); allocatePage hands back the lowest
+   free page, or appends one when none is free. Freed pages read as zeros
+   and give their disk space back. The bitmap is shared by every handle
+   on the file, so pages may be freed and allocated through any of them. */
+extern RC allocatePage (SM_FileHandle *fHandle, int *pageNum);
+extern RC freePage (SM_FileHandle *fHandle, int pageNum);
+
+/* mapped access (handles opened with SM_OPEN_MMAP)
+   getPagePtr returns a pointer into the mapping; writes through it reach the
+   file without writeBlock. The pointer stays valid until the file grows past
+   the mapped capacity or the handle is closed. */
+extern RC getPagePtr (int pageNum, SM_FileHandle *fHandle, SM_PageHandle *pagePtr);
+
+/* snapshots: createSnapshot opens *snapshot as a read-only handle that
+   keeps seeing the file as it was at the call, while fHandle stays
+   writable. The first write to a page a snapshot still needs, through
+   fHandle or any other handle on the file, copies the old image to an
+   unlinked shadow file; later writes to it cost nothing extra. Read a
+   snapshot with the usual read calls and release it with closePageFile,
+   before closing fHandle. Not available on SM_OPEN_MMAP handles, and
+   getPagePtr stores through any mapped handle on the file are not seen
+   (they cannot be intercepted); pages still buffered by another
+   SM_OPEN_WRITEBACK handle count as written after the snapshot. */
+extern RC createSnapshot (SM_FileHandle *fHandle, SM_FileHandle *snapshot);
+
+/* durability: writes are never flushed individually. syncPageFile makes
+   every write that returned before the call durable (msync for mapped
+   handles, fdatasync otherwise), subject to the handle's durability mode. */
+extern RC setDurabilityMode (SM_FileHandle *fHandle, SM_Durability mode);
+extern RC syncPageFile (SM_FileHandle *fHandle);
+
+/* page latches: latchPage blocks until the latch of pageNum is free for
+   the mode (shared latches coexist; an exclusive one excludes all others
+   and holds new shared ones back while it waits). They guard only callers
+   that take them, except on SM_OPEN_LATCHED handles, where readBlock(s),
+   the cursor reads (and the read-ahead pages they fetch) and writeBlock(s)
+   latch their pages shared or exclusive themselves: a
+   thread must not call those while holding a latch on the same file
+   (through any handle).
+   unlatchPage returns RC_PAGE_NOT_LATCHED for a latch not held in mode. */
+extern RC latchPage (SM_FileHandle *fHandle, int pageNum, SM_LatchMode mode);
+extern RC unlatchPage (SM_FileHandle *fHandle, int pageNum, SM_LatchMode mode);
+
+/* write-back limits of an SM_OPEN_WRITEBACK handle: table size in pages
+   and the age in milliseconds after which buffered pages are written
+   out. Writes the table out before resizing it. */
+extern RC setWriteBackLimits (SM_FileHandle *fHandle, int maxDirtyPages, int maxAgeMs);
+
+/* statistics: a snapshot of the handle's counters (all zero when built
+   with SM_NO_STATS); dumpPageFileStats prints them with latency
+   percentiles to out */
+extern RC getPageFileStats (SM_FileHandle *fHandle, SM_FileStats *stats);
+extern RC dumpPageFileStats (SM_FileHandle *fHandle, FILE *out);
+
+/* page buffers aligned to PAGE_SIZE (required by SM_OPEN_DIRECT handles);
+   files created with a larger page size need allocatePageHandleSized */
+extern SM_PageHandle allocatePageHandle (void);
+extern SM_PageHandle allocatePageHandleSized (int pageSize);
+extern void freePageHandle (SM_PageHandle memPage);
+
 #endif
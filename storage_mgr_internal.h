@@ -0,0 +1,371 @@
+#ifndef STORAGE_MGR_INTERNAL_H
+#define STORAGE_MGR_INTERNAL_H
+
+/* Private to the storage manager and the modules built directly on its file
+   descriptor (async_io.c). Not part of the public interface. */
+
+#include "storage_mgr.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/************************************************************
+ *                    file header page                      *
+ ************************************************************/
+/* The first PAGE_SIZE bytes of every page file are a header; data page n
+   starts at byte SM_HEADER_SIZE + n * pageSize. Fields are stored in host
+   byte order. */
+#define SM_HEADER_SIZE PAGE_SIZE
+#define SM_FILE_MAGIC "CS525PF"         /* 8 bytes with the terminating NUL */
+#define SM_FORMAT_VERSION 1
+#define SM_NO_FREE_PAGE 0xFFFFFFFFu
+
+typedef struct SM_FileHeader {
+	char magic[8];
+	uint32_t version;       /* SM_FORMAT_VERSION */
+	uint32_t pageSize;      /* bytes per data page (SM_MIN..SM_MAX_PAGE_SIZE) */
+	uint32_t pageCount;     /* data pages, the header page not included */
+	uint32_t freeListHead;  /* no page below it is free; SM_NO_FREE_PAGE when none is */
+	uint32_t flags;         /* SM_CREATE_* format options, SM_HEADER_* state */
+	uint32_t checksum;      /* CRC32C of the fields above */
+} SM_FileHeader;
+
+/* header flag bits above the SM_CREATE_* range */
+#define SM_HEADER_FREE_MAP 0x10000      /* a free-space map has been created */
+#define SM_HEADER_STRIPED  0x20000      /* data pages live in the stripe members */
+
+/* suffixes of the side files kept next to a page file */
+#define SM_CRC_SUFFIX ".crc"    /* per-page checksums */
+#define SM_PTT_SUFFIX ".ptt"    /* page-translation table of a compressed file */
+#define SM_FSM_SUFFIX ".fsm"    /* free-space bitmap */
+#define SM_WAL_SUFFIX ".wal"    /* write-ahead log */
+#define SM_STRIPE_SUFFIX ".stripe"  /* stripe unit and member paths */
+
+/* write-ahead log state, private to wal.c */
+typedef struct SM_Wal SM_Wal;
+/* free-space bitmap, private to free_space.c */
+typedef struct SM_FreeMap SM_FreeMap;
+/* page latches, private to latch.c */
+typedef struct SM_LatchTable SM_LatchTable;
+/* snapshot state, private to snapshot.c */
+typedef struct SM_Snapshot SM_Snapshot;
+typedef struct SM_Shadow SM_Shadow;
+
+/************************************************************
+ *          per-file state shared by its handles            *
+ ************************************************************/
+/* One per page file open in the process, kept in the open-file registry
+   (file_registry.c) under the file's device and inode. */
+typedef struct SM_SharedFile {
+	dev_t dev;
+	ino_t ino;
+	int refs;           /* handles and snapshots using it (registry lock) */
+	int fd;             /* buffered descriptor, -1 until a handle needs it */
+	int directFd;       /* SM_OPEN_DIRECT descriptor, -1 until needed */
+	int pageCount;      /* header.pageCount, for lock-free readers (atomic) */
+	pthread_mutex_t headerLock;     /* orders header updates */
+	SM_FileHeader header;   /* as last read or written */
+	/* transactions committed through <fileName>.wal by any handle; set up
+	   (and a leftover log replayed) by the first open, under openLock */
+	pthread_mutex_t openLock;
+	SM_Wal *wal;
+	/* per-page CRC32C side table (<fileName>.crc), -1 / NULL when absent;
+	   loaded by the first open, under openLock. Entries are stored XOR the
+	   CRC of a zero page, so the all-zero entries of a freshly extended
+	   table describe freshly extended zero pages. Entries are read and
+	   written (atomically) under crcLock's read side; growing the table
+	   takes its write side. */
+	pthread_rwlock_t crcLock;
+	int crcFd;
+	uint32_t *crc;      /* in-memory copy, crcCap entries */
+	int crcCap;
+	/* page latches of every handle on the file, allocated by the first
+	   latchPage or latched call */
+	SM_LatchTable *latches;
+	/* copy-on-write snapshots taken from any handle on the file, and the
+	   shadow file holding the page images they still need; snapLock
+	   orders writers through every handle against snapshot reads (see
+	   snapshot.c) */
+	pthread_rwlock_t snapLock;
+	SM_Snapshot *snaps;
+	SM_Shadow *shadow;
+	/* pages released by freePage through any handle, NULL until the file
+	   has a free-space map; under headerLock like the free-page hint */
+	SM_FreeMap *fsm;
+#ifndef SM_NO_STATS
+	/* updated with relaxed atomics by every handle on the file */
+	SM_FileStats stats;
+#endif
+	struct SM_SharedFile *next;
+} SM_SharedFile;
+
+/* compressed-file state, private to compressed_file.c */
+typedef struct SM_PageTable SM_PageTable;
+/* stripe layout and member descriptors, private to stripe.c */
+typedef struct SM_Stripe SM_Stripe;
+/* dirty-page tables and flusher thread, private to writeback.c */
+typedef struct SM_WriteBack SM_WriteBack;
+
+/************************************************************
+ *          bookkeeping kept in SM_FileHandle->mgmtInfo     *
+ ************************************************************/
+typedef struct SM_Internal {
+	int fd;             /* descriptor used for positional I/O (shared's) */
+	int flags;          /* SM_OPEN_* flags given at open time */
+	int pageSize;       /* bytes per data page, from the header */
+	SM_SharedFile *shared;  /* header, page count and statistics of the file */
+	char *map;          /* SM_OPEN_MMAP: base of the shared mapping */
+	size_t mapLen;      /* bytes mapped; may run past EOF to absorb growth */
+
+	/* SM_CREATE_COMPRESSED files: logical pages are looked up in a
+	   page-translation table instead of sitting at pageNum * pageSize */
+	SM_PageTable *ptt;
+
+	/* SM_OPEN_SPARSE: bit n set while data page n is known to be a hole,
+	   so readBlock serves it without a syscall; NULL otherwise */
+	uint64_t *holes;
+	int holeWords;
+
+	/* striped files: the members holding the data pages (fd then holds
+	   only the header); NULL otherwise */
+	SM_Stripe *stripe;
+
+	/* SM_OPEN_WRITEBACK: pages written but not yet on disk; NULL otherwise */
+	SM_WriteBack *wb;
+
+	/* copy-on-write snapshots that read through this handle (under the
+	   file's snapLock). snap is set instead on a snapshot's own
+	   bookkeeping, which has no descriptor (fd -1). */
+	int snapsTaken;
+	SM_Snapshot *snap;
+
+	/* durability: syncPageFile callers in SM_DURABILITY_GROUP_COMMIT mode
+	   take a ticket; one leader syncs for every ticket issued before it began */
+	SM_Durability durability;
+	pthread_mutex_t syncLock;
+	pthread_cond_t syncDone;
+	unsigned long syncTickets;      /* tickets handed out */
+	unsigned long syncCovered;      /* highest ticket made durable */
+	int syncRunning;                /* a leader is inside fdatasync/msync */
+	RC syncResult;                  /* outcome of the last completed batch */
+
+	/* read-ahead for readNextBlock/readPreviousBlock scans */
+	pthread_mutex_t raLock;
+	int raLastPage;     /* last page returned by a cursor read, -1 if none */
+	int raDir;          /* +1 forward, -1 backward, 0 not yet known */
+	int raStreak;       /* consecutive cursor reads one step apart in raDir */
+	int raWindow;       /* pages advised / prefetched per step; doubles */
+	int raFrontier;     /* first page (in raDir) not yet advised */
+	char *raBuf;        /* SM_OPEN_READAHEAD: prefetch buffer, SM_RA_MAX_PAGES */
+	int raStart;        /* first page held in raBuf */
+	int raCount;        /* pages held in raBuf (0 = empty) */
+
+#ifndef SM_NO_STATS
+	int statsNextPage;  /* page after the last transfer, for counting seeks */
+#endif
+} SM_Internal;
+
+/************************************************************
+ *                    shared helpers                        *
+ ************************************************************/
+/* validate a handle and return its bookkeeping; brings totalNumPages up
+   to pages added through other handles on the file */
+extern RC sm_get_internal (SM_FileHandle *h, SM_Internal **out);
+/* the same for calls that modify the file: refuses snapshot handles */
+extern RC sm_get_writable (SM_FileHandle *h, SM_Internal **out);
+/* read and validate the header page of an opened file */
+extern RC sm_read_header (int fd, SM_FileHeader *hdr);
+/* byte offset of a data page inside the file (behind the header page) */
+extern off_t sm_page_offset (const SM_Internal *meta, int pageNum);
+/* descriptor and byte offset holding a data page, striped or not */
+extern off_t sm_page_loc (const SM_Internal *meta, int pageNum, int *fd);
+/* open a data file read/write, with O_DIRECT for SM_OPEN_DIRECT */
+extern int sm_open_data_fd (const char *path, int openFlags);
+/* move `count` pages of `size` bytes at `off` with vectored calls;
+   returns the complete pages moved */
+extern int sm_rw_pages (int fd, SM_PageHandle *pages, int count, int size, off_t off, int writing);
+/* positional I/O retried until len bytes moved; returns bytes moved */
+extern size_t sm_pread_full (int fd, void *buf, size_t len, off_t off);
+extern size_t sm_pwrite_full (int fd, const void *buf, size_t len, off_t off);
+/* "<fileName><suffix>" in a fresh malloc'ed string (NULL if out of memory) */
+extern char *sm_side_file_name (const char *fileName, const char *suffix);
+/* read `count` pages from `first` (through the page table of a compressed
+   file, or from the stripe members); returns the complete pages read */
+extern int sm_read_pages (SM_Internal *meta, int first, SM_PageHandle *pages, int count);
+/* write `count` pages from `first` straight to the file, keeping snapshots,
+   holes, checksums and the prefetch buffer in step; *done receives the
+   leading pages written */
+extern RC sm_write_pages (SM_Internal *meta, int first, SM_PageHandle *pages, int count, int *done);
+/* true when an SM_OPEN_DIRECT handle is given an unaligned buffer */
+extern int sm_misaligned (const SM_Internal *meta, const void *buf);
+/* count a finished transfer of `pages` pages at pageNum (or an error) */
+extern void sm_stats_io (SM_Internal *meta, int writing, int pageNum, int pages, RC rc);
+/* page checksums: no-ops returning RC_OK for files created without them */
+extern RC sm_checksum_verify (const SM_Internal *meta, int pageNum, const char *page);
+extern RC sm_checksum_update (SM_Internal *meta, int firstPage, SM_PageHandle *pages, int count);
+/* drop the file's checksum table with its last reference */
+extern void sm_checksum_close (SM_SharedFile *sf);
+/* fdatasync the file and its side files whatever the durability mode */
+extern RC sm_flush_file (SM_FileHandle *h);
+/* true when a page of `size` bytes holds only zero bytes */
+extern int sm_is_zero_page (const char *page, int size);
+/* data has been written to these pages: they are no longer holes */
+extern void sm_holes_clear (SM_Internal *meta, int first, int count);
+/* these pages were written: drop any read-ahead copy of them */
+extern void sm_invalidate_prefetch (SM_Internal *meta, int first, int count);
+
+/************************************************************
+ *                    page-sized copies                     *
+ ************************************************************/
+/* One switch arm per supported page size, each with the size as a
+   constant, so the common sizes get fixed-length copies and fills. */
+#define SM_PAGE_SIZE_CASES(X) X(4096) X(8192) X(16384) X(32768) X(65536)
+
+static inline void sm_page_copy(void *dst, const void *src, int size) {
+	switch (size) {
+#define SM_COPY_CASE(n) case n: memcpy(dst, src, n); return;
+	SM_PAGE_SIZE_CASES(SM_COPY_CASE)
+#undef SM_COPY_CASE
+	default: memcpy(dst, src, (size_t)size);
+	}
+}
+
+static inline void sm_page_zero(void *dst, int size) {
+	switch (size) {
+#define SM_ZERO_CASE(n) case n: memset(dst, 0, n); return;
+	SM_PAGE_SIZE_CASES(SM_ZERO_CASE)
+#undef SM_ZERO_CASE
+	default: memset(dst, 0, (size_t)size);
+	}
+}
+
+/************************************************************
+ *          open-file registry (file_registry.c)            *
+ ************************************************************/
+/* a reference to the shared state of fileName, opening its descriptor
+   (or the SM_OPEN_DIRECT one) unless another handle already has */
+extern RC sm_file_acquire (const char *fileName, int openFlags, SM_SharedFile **out);
+extern void sm_file_retain (SM_SharedFile *sf);
+/* drop a reference; the last one closes the descriptors (close(2) result) */
+extern int sm_file_release (SM_SharedFile *sf);
+/* true while some handle in the process has fileName open */
+extern int sm_file_is_open (const char *fileName);
+/* references held on the file: its open handles and their snapshots */
+extern int sm_file_refs (SM_SharedFile *sf);
+
+/************************************************************
+ *          compressed page files (compressed_file.c)       *
+ ************************************************************/
+/* write the page table of a new compressed file holding one zero page */
+extern RC sm_ptt_create (const char *fileName);
+/* load the page table of a compressed file holding `pages` pages */
+extern RC sm_ptt_open (SM_Internal *meta, const char *fileName, int pages);
+extern void sm_ptt_close (SM_Internal *meta);
+/* page I/O by logical page number; callers have range-checked pageNum */
+extern RC sm_ptt_read (SM_Internal *meta, int pageNum, char *page);
+extern RC sm_ptt_write (SM_Internal *meta, int pageNum, const char *page);
+extern RC sm_ptt_grow (SM_Internal *meta, int pages);
+/* after the data file is synced: makes the table durable, and the slots
+   of pages rewritten before the call reusable */
+extern RC sm_ptt_sync (SM_Internal *meta);
+
+/************************************************************
+ *          free-space map (free_space.c)                   *
+ ************************************************************/
+/* The map is the file's (sf->fsm); open, is_free, find and set are called
+   with sf->headerLock held. */
+/* load <fileName>.fsm, or start an empty one when create is set; a no-op
+   once another handle has loaded the map */
+extern RC sm_fsm_open (SM_SharedFile *sf, const char *fileName, int create);
+/* with the file's last reference */
+extern void sm_fsm_close (SM_SharedFile *sf);
+extern int sm_fsm_is_free (const SM_SharedFile *sf, int pageNum);
+/* first free page >= from, -1 when there is none */
+extern int sm_fsm_find (const SM_SharedFile *sf, int from);
+/* mark a page free (isFree != 0) or in use; persisted before returning */
+extern RC sm_fsm_set (SM_SharedFile *sf, int pageNum, int isFree);
+extern RC sm_fsm_sync (SM_SharedFile *sf);
+
+/************************************************************
+ *          striped page files (stripe.c)                   *
+ ************************************************************/
+/* write <fileName>.stripe and create (truncate) the member files, sized
+   for one data page of pageSize bytes */
+extern RC sm_stripe_create (const char *fileName, char *const *paths, int members,
+		int stripePages, int pageSize);
+/* load the layout and open every member with the handle's open flags */
+extern RC sm_stripe_open (SM_Internal *meta, const char *fileName, int openFlags);
+extern void sm_stripe_close (SM_Internal *meta);
+/* delete the members named by <fileName>.stripe (not the layout itself) */
+extern void sm_stripe_remove (const char *fileName);
+extern off_t sm_stripe_locate (const SM_Internal *meta, int pageNum, int *fd);
+/* pages from pageNum that sit contiguously in its member */
+extern int sm_stripe_run (const SM_Internal *meta, int pageNum);
+/* vectored transfer split by member, members in parallel; returns the
+   leading pages moved completely */
+extern int sm_stripe_rw (SM_Internal *meta, int first, SM_PageHandle *pages, int count, int writing);
+extern RC sm_stripe_extend (SM_Internal *meta, int pages);
+extern RC sm_stripe_sync (SM_Internal *meta);
+
+/************************************************************
+ *          write-back (writeback.c)                        *
+ ************************************************************/
+/* The sm_wb_* calls below other than sm_wb_open are no-ops returning
+   RC_OK (or 0) on handles without SM_OPEN_WRITEBACK. */
+/* allocate the tables with the default limits and start the flusher */
+extern RC sm_wb_open (SM_Internal *meta);
+/* stop the flusher, write out what is left and free everything */
+extern RC sm_wb_close (SM_Internal *meta);
+/* buffer pages [first, first+count), waiting while the table is full */
+extern RC sm_wb_write (SM_Internal *meta, int first, SM_PageHandle *pages, int count);
+/* copy a buffered page into buf (if not NULL); 0 when it is not buffered */
+extern int sm_wb_read (SM_Internal *meta, int pageNum, char *buf);
+/* write out everything buffered so far */
+extern RC sm_wb_drain (SM_Internal *meta);
+/* keep the flusher off the file while the caller resizes it */
+extern void sm_wb_pause (SM_Internal *meta);
+extern void sm_wb_resume (SM_Internal *meta);
+extern RC sm_wb_set_limits (SM_Internal *meta, int maxDirtyPages, int maxAgeMs);
+
+/************************************************************
+ *          page latches (latch.c)                          *
+ ************************************************************/
+extern RC sm_latch_page (SM_Internal *meta, int pageNum, int exclusive);
+/* RC_PAGE_NOT_LATCHED when the latch is not held in that mode */
+extern RC sm_unlatch_page (SM_Internal *meta, int pageNum, int exclusive);
+/* every latch covering pages [first, first+count), in table order */
+extern RC sm_latch_range (SM_Internal *meta, int first, int count, int exclusive);
+extern void sm_unlatch_range (SM_Internal *meta, int first, int count, int exclusive);
+/* with the file's last reference */
+extern void sm_latch_free (SM_SharedFile *sf);
+
+/************************************************************
+ *          write-ahead log (wal.c)                         *
+ ************************************************************/
+/* attach a fully opened handle to its file's log; the first handle on the
+   file sets the log up, replaying one left behind by a process that did
+   not close the file */
+extern RC sm_wal_open (SM_FileHandle *h);
+/* release the log state with the file's last reference; the log file is
+   removed once checkpointed */
+extern void sm_wal_close (SM_SharedFile *sf);
+
+/************************************************************
+ *          copy-on-write snapshots (snapshot.c)            *
+ ************************************************************/
+/* bracket every write of pages [first, first+count) through a live handle:
+   begin preserves the old images snapshots still need; end must follow
+   (only) a successful begin */
+extern RC sm_snap_write_begin (SM_Internal *live, int first, int count);
+extern void sm_snap_write_end (SM_Internal *live);
+/* attach snapMeta as a snapshot of the first `pages` pages of live */
+extern RC sm_snap_create (SM_Internal *live, SM_Internal *snapMeta, const char *fileName, int pages);
+extern void sm_snap_release (SM_Internal *snapMeta);
+/* read pageNum as of the snapshot; callers have range-checked it */
+extern RC sm_snap_read (SM_Internal *snapMeta, int pageNum, char *page);
+
+#endif
@@ -0,0 +1,330 @@
+#define _GNU_SOURCE     /* preadv/pwritev and fdatasync under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* --------------------------------------------------------------------------
+   Striped page files
+
+   The data pages of a striped file live in its member files, not behind
+   its header. Pages go round-robin in units of stripePages: unit u (pages
+   u*stripePages ..) is stored in member u % members as that member's unit
+   u / members. Members have no header of their own. <fileName>.stripe
+   records the layout as text: "stripe <stripePages> <members>", then one
+   member path per line.
+
+   Any run of consecutive pages falls on one contiguous range in each
+   member, so a vectored transfer becomes one preadv/pwritev stream per
+   member. Those streams run on their own threads when the run spans
+   more than one unit.
+   -------------------------------------------------------------------------- */
+
+struct SM_Stripe {
+    int members;
+    int stripePages;
+    int *fds;           /* one per member, opened like the page file */
+    char **paths;
+};
+
+/* Where member-local page `local` of a member starts. */
+static off_t local_offset(const SM_Internal *meta, int local) {
+    return (off_t)local * (off_t)meta->pageSize;
+}
+
+/* Member and member-local page of a data page. */
+static int locate(const SM_Stripe *st, int pageNum, int *local) {
+    int unit = pageNum / st->stripePages;
+    *local = (unit / st->members) * st->stripePages + pageNum % st->stripePages;
+    return unit % st->members;
+}
+
+/* Pages member m holds in a file of `pages` data pages. */
+static int member_pages(const SM_Stripe *st, int m, int pages) {
+    int units = pages / st->stripePages, tail = pages % st->stripePages;
+    int n = (units / st->members + (m < units % st->members)) * st->stripePages;
+    return n + ((m == units % st->members) ? tail : 0);
+}
+
+static void free_stripe(SM_Stripe *st) {
+    if (st == NULL) return;
+    for (int m = 0; m < st->members; ++m) {
+        if (st->fds != NULL && st->fds[m] >= 0) close(st->fds[m]);
+        if (st->paths != NULL) free(st->paths[m]);
+    }
+    free(st->fds);
+    free(st->paths);
+    free(st);
+}
+
+/* Read <fileName>.stripe; the member files are not opened. */
+static RC load_layout(const char *fileName, SM_Stripe **out) {
+    char *name = sm_side_file_name(fileName, SM_STRIPE_SUFFIX);
+    FILE *f = (name != NULL) ? fopen(name, "r") : NULL;
+    free(name);
+    if (f == NULL) {
+        RC_message = "stripe layout file is missing";
+        return RC_FILE_NOT_FOUND;
+    }
+    SM_Stripe *st = (SM_Stripe *)calloc(1, sizeof *st);
+    int members = 0, stripePages = 0;
+    RC rc = RC_OK;
+    if (st == NULL || fscanf(f, "stripe %d %d\n", &stripePages, &members) != 2 ||
+        members < 1 || members > SM_STRIPE_MAX_MEMBERS || stripePages < 1) {
+        RC_message = "stripe layout file is damaged";
+        rc = RC_FILE_HEADER_INVALID;
+    } else {
+        st->fds = (int *)malloc((size_t)members * sizeof *st->fds);
+        st->paths = (char **)calloc((size_t)members, sizeof *st->paths);
+        if (st->fds == NULL || st->paths == NULL) {
+            RC_message = "out of memory for stripe layout";
+            rc = RC_FILE_HANDLE_NOT_INIT;
+        }
+    }
+    if (rc == RC_OK) {
+        st->members = members;
+        st->stripePages = stripePages;
+        for (int m = 0; m < members; ++m) st->fds[m] = -1;
+        char line[4096];
+        for (int m = 0; m < members && rc == RC_OK; ++m) {
+            size_t len;
+            if (fgets(line, sizeof line, f) == NULL || (len = strlen(line)) < 2 ||
+                line[len - 1] != '\n') {
+                RC_message = "stripe layout file is damaged";
+                rc = RC_FILE_HEADER_INVALID;
+                break;
+            }
+            line[len - 1] = '\0';
+            if ((st->paths[m] = strdup(line)) == NULL) {
+                RC_message = "out of memory for stripe layout";
+                rc = RC_FILE_HANDLE_NOT_INIT;
+            }
+        }
+    }
+    fclose(f);
+    if (rc != RC_OK) {
+        free_stripe(st);
+        return rc;
+    }
+    *out = st;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Parallel per-member transfers
+   -------------------------------------------------------------------------- */
+
+/* One member's share of a transfer: its pages in logical order. */
+typedef struct MemberIO {
+    SM_Internal *meta;
+    int fd;
+    off_t off;              /* member offset of the first page */
+    SM_PageHandle *pages;
+    int *logical;           /* logical index (in the caller's array) of each */
+    int count;
+    int writing;
+    int done;               /* complete pages moved */
+} MemberIO;
+
+static void *member_transfer(void *arg) {
+    MemberIO *io = (MemberIO *)arg;
+    io->done = sm_rw_pages(io->fd, io->pages, io->count, io->meta->pageSize, io->off, io->writing);
+    return NULL;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c and async_io.c (storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_stripe_create(const char *fileName, char *const *paths, int members, int stripePages,
+                    int pageSize) {
+    if (paths == NULL || members < 1 || members > SM_STRIPE_MAX_MEMBERS || stripePages < 1) {
+        RC_message = "a striped file needs 1..SM_STRIPE_MAX_MEMBERS members and a positive stripe unit";
+        return RC_WRITE_FAILED;
+    }
+    for (int m = 0; m < members; ++m) {
+        if (paths[m] == NULL || paths[m][0] == '\0' || strchr(paths[m], '\n') != NULL ||
+            strlen(paths[m]) >= 4000) {
+            RC_message = "invalid stripe member path";
+            return RC_WRITE_FAILED;
+        }
+        for (int k = 0; k < m; ++k) {
+            if (strcmp(paths[k], paths[m]) == 0) {
+                RC_message = "stripe member listed twice";
+                return RC_WRITE_FAILED;
+            }
+        }
+    }
+
+    char *name = sm_side_file_name(fileName, SM_STRIPE_SUFFIX);
+    FILE *f = (name != NULL) ? fopen(name, "w") : NULL;
+    free(name);
+    if (f == NULL) {
+        RC_message = "unable to create stripe layout file";
+        return RC_WRITE_FAILED;
+    }
+    int bad = fprintf(f, "stripe %d %d\n", stripePages, members) < 0;
+    for (int m = 0; m < members; ++m) {
+        bad |= fprintf(f, "%s\n", paths[m]) < 0;
+        int fd = open(paths[m], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        bad |= fd < 0;
+        if (fd < 0) continue;
+        /* the file's one page is page 0 of member 0 */
+        if (m == 0) bad |= ftruncate(fd, pageSize) != 0;
+        close(fd);
+    }
+    bad |= fclose(f) != 0;
+    if (bad) {
+        RC_message = "unable to create stripe members";
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
+
+RC sm_stripe_open(SM_Internal *meta, const char *fileName, int openFlags) {
+    SM_Stripe *st;
+    RC rc = load_layout(fileName, &st);
+    if (rc != RC_OK) return rc;
+    for (int m = 0; m < st->members; ++m) {
+        st->fds[m] = sm_open_data_fd(st->paths[m], openFlags);
+        if (st->fds[m] < 0) {
+            RC_message = "stripe member file is missing";
+            free_stripe(st);
+            return RC_FILE_NOT_FOUND;
+        }
+    }
+    meta->stripe = st;
+    return RC_OK;
+}
+
+void sm_stripe_close(SM_Internal *meta) {
+    free_stripe(meta->stripe);
+    meta->stripe = NULL;
+}
+
+/* Remove the member files of a striped file. */
+void sm_stripe_remove(const char *fileName) {
+    SM_Stripe *st;
+    if (load_layout(fileName, &st) != RC_OK) return;
+    for (int m = 0; m < st->members; ++m)
+        (void)remove(st->paths[m]);
+    free_stripe(st);
+}
+
+off_t sm_stripe_locate(const SM_Internal *meta, int pageNum, int *fd) {
+    int local;
+    int m = locate(meta->stripe, pageNum, &local);
+    *fd = meta->stripe->fds[m];
+    return local_offset(meta, local);
+}
+
+int sm_stripe_run(const SM_Internal *meta, int pageNum) {
+    return meta->stripe->stripePages - pageNum % meta->stripe->stripePages;
+}
+
+/* Move pages [first, first+count): one vectored stream per member, on
+   parallel threads once more than one unit is involved. Returns the
+   number of leading pages moved completely. */
+int sm_stripe_rw(SM_Internal *meta, int first, SM_PageHandle *pages, int count, int writing) {
+    SM_Stripe *st = meta->stripe;
+    if (count <= 0) return 0;
+
+    MemberIO *io = (MemberIO *)calloc((size_t)st->members, sizeof *io);
+    SM_PageHandle *memberPages = (SM_PageHandle *)malloc((size_t)count * sizeof *memberPages);
+    int *logical = (int *)malloc((size_t)count * sizeof *logical);
+    if (io == NULL || memberPages == NULL || logical == NULL) {
+        free(io);
+        free(memberPages);
+        free(logical);
+        RC_message = "out of memory for striped transfer";
+        return 0;
+    }
+
+    /* Count each member's pages, give it a slice of the arrays, fill them
+       in logical order; a member's pages are contiguous on that member. */
+    for (int i = 0; i < count; ++i) {
+        int local, m = locate(st, first + i, &local);
+        if (io[m].count++ == 0) io[m].off = local_offset(meta, local);
+    }
+    int at = 0;
+    for (int m = 0; m < st->members; ++m) {
+        io[m].meta = meta;
+        io[m].fd = st->fds[m];
+        io[m].writing = writing;
+        io[m].pages = memberPages + at;
+        io[m].logical = logical + at;
+        at += io[m].count;
+        io[m].count = 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        int local, m = locate(st, first + i, &local);
+        io[m].pages[io[m].count] = pages[i];
+        io[m].logical[io[m].count++] = i;
+    }
+
+    pthread_t tids[SM_STRIPE_MAX_MEMBERS];
+    int threaded[SM_STRIPE_MAX_MEMBERS] = {0};
+    int parallel = count > st->stripePages;
+    int self = -1;              /* the caller's own share, run once the others start */
+    for (int m = 0; m < st->members; ++m) {
+        if (io[m].count == 0) continue;
+        if (!parallel) {
+            member_transfer(&io[m]);
+        } else if (self < 0) {
+            self = m;
+        } else if (pthread_create(&tids[m], NULL, member_transfer, &io[m]) == 0) {
+            threaded[m] = 1;
+        } else {
+            member_transfer(&io[m]);
+        }
+    }
+    if (self >= 0) member_transfer(&io[self]);
+
+    int done = count;
+    for (int m = 0; m < st->members; ++m) {
+        if (threaded[m]) pthread_join(tids[m], NULL);
+        if (io[m].done < io[m].count && io[m].logical[io[m].done] < done)
+            done = io[m].logical[io[m].done];
+    }
+    free(io);
+    free(memberPages);
+    free(logical);
+    return done;
+}
+
+/* Grow every member to its share of `pages` data pages (never shrinking). */
+RC sm_stripe_extend(SM_Internal *meta, int pages) {
+    SM_Stripe *st = meta->stripe;
+    for (int m = 0; m < st->members; ++m) {
+        off_t end = local_offset(meta, member_pages(st, m, pages));
+        struct stat sb;
+        if (fstat(st->fds[m], &sb) != 0) {
+            RC_message = "fstat failed";
+            return RC_WRITE_FAILED;
+        }
+        if (sb.st_size < end && ftruncate(st->fds[m], end) != 0) {
+            RC_message = "extending stripe member failed";
+            return RC_WRITE_FAILED;
+        }
+    }
+    return RC_OK;
+}
+
+RC sm_stripe_sync(SM_Internal *meta) {
+    SM_Stripe *st = meta->stripe;
+    for (int m = 0; m < st->members; ++m) {
+        if (fdatasync(st->fds[m]) != 0) {
+            RC_message = "fdatasync of stripe member failed";
+            return RC_WRITE_FAILED;
+        }
+    }
+    return RC_OK;
+}
@@ -0,0 +1,471 @@
+#define _GNU_SOURCE     /* pread/pwritev and fdatasync under -std=c11 */
+
+#include "wal.h"
+#include "storage_mgr_internal.h"
+#include "page_checksum.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/* --------------------------------------------------------------------------
+   Log format
+
+   <fileName>.wal is a sequence of records: a WAL_Record header, followed by
+   the page image for WAL_PAGE records. A transaction reaches the log in one
+   append at commit (its page records, then a WAL_COMMIT record carrying
+   the page count), so recovery replays exactly the transactions whose
+   commit record is intact and stops at the first torn or corrupt record.
+   LSNs increase by one per record from the start of the log.
+
+   Every handle on a file commits to the file's one log (its SM_Wal hangs
+   off the shared file state), so records from all of them form one LSN
+   sequence. The first open of the file in the process replays what an
+   earlier process left behind; later opens find the log live and leave
+   it alone.
+   -------------------------------------------------------------------------- */
+
+#define WAL_MAGIC  0x4C415753u      /* "SWAL" */
+#define WAL_PAGE   1
+#define WAL_COMMIT 2
+
+/* Log size at which a commit checkpoints. */
+#define WAL_CHECKPOINT_BYTES (8L * 1024 * 1024)
+
+/* Records handed to one pwritev call (well under IOV_MAX). */
+#define WAL_IOV_BATCH 256
+
+typedef struct WAL_Record {
+    uint32_t magic;
+    uint32_t type;      /* WAL_PAGE or WAL_COMMIT */
+    uint64_t lsn;
+    uint64_t txId;
+    int32_t pageNum;    /* WAL_PAGE: target page; WAL_COMMIT: pages in the tx */
+    uint32_t crc;       /* CRC32C of the record (crc taken as 0) and its image */
+} WAL_Record;
+
+struct SM_Wal {
+    pthread_mutex_t lock;   /* serializes commits and checkpoints */
+    char *name;             /* <fileName>.wal */
+    int fd;                 /* -1 until the first commit (or recovery) */
+    int pageSize;           /* bytes per logged image (the file's page size) */
+    off_t end;              /* bytes in the log */
+    uint64_t nextLsn;
+    uint64_t nextTx;
+};
+
+typedef struct WAL_Entry {
+    int pageNum;
+    SM_PageHandle image;    /* aligned copy of one page */
+} WAL_Entry;
+
+struct SM_Tx {
+    SM_FileHandle *fh;
+    SM_Wal *wal;
+    uint64_t id;
+    WAL_Entry *entries;
+    int count, cap;
+};
+
+static uint32_t record_crc(const SM_Wal *wal, const WAL_Record *r, const char *image) {
+    WAL_Record tmp = *r;
+    tmp.crc = 0;
+    uint32_t crc = crc32c(0, &tmp, sizeof tmp);
+    return (image != NULL) ? crc32c(crc, image, (size_t)wal->pageSize) : crc;
+}
+
+static void free_tx(SM_Tx *tx) {
+    for (int i = 0; i < tx->count; ++i)
+        freePageHandle(tx->entries[i].image);
+    free(tx->entries);
+    free(tx);
+}
+
+static int by_page(const void *a, const void *b) {
+    const WAL_Entry *x = (const WAL_Entry *)a, *y = (const WAL_Entry *)b;
+    return (x->pageNum > y->pageNum) - (x->pageNum < y->pageNum);
+}
+
+static void free_wal(SM_Wal *wal) {
+    if (wal->fd >= 0) close(wal->fd);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal->name);
+    free(wal);
+}
+
+/* --------------------------------------------------------------------------
+   Log I/O (caller holds wal->lock)
+   -------------------------------------------------------------------------- */
+
+static RC open_log(SM_Wal *wal) {
+    if (wal->fd >= 0) return RC_OK;
+    wal->fd = open(wal->name, O_RDWR | O_CREAT, 0644);
+    if (wal->fd < 0) {
+        RC_message = "unable to create write-ahead log";
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
+
+/* Write iov[0..n) at off, finishing any short transfer piecewise. */
+static RC write_vec(int fd, struct iovec *iov, int n, off_t off) {
+    for (int i = 0; i < n; ) {
+        int batch = (n - i < WAL_IOV_BATCH) ? n - i : WAL_IOV_BATCH;
+        ssize_t w;
+        do {
+            w = pwritev(fd, iov + i, batch, off);
+        } while (w < 0 && errno == EINTR);
+        if (w < 0) {
+            RC_message = "writing write-ahead log failed";
+            return RC_WRITE_FAILED;
+        }
+        size_t left = (size_t)w;
+        for (; i < n && left >= iov[i].iov_len; ++i) {
+            left -= iov[i].iov_len;
+            off += (off_t)iov[i].iov_len;
+        }
+        if (i < n && left > 0) {
+            size_t rest = iov[i].iov_len - left;
+            if (sm_pwrite_full(fd, (char *)iov[i].iov_base + left, rest, off + (off_t)left) != rest) {
+                RC_message = "writing write-ahead log failed";
+                return RC_WRITE_FAILED;
+            }
+            off += (off_t)iov[i].iov_len;
+            ++i;
+        }
+    }
+    return RC_OK;
+}
+
+/* Sync the data file, then empty the log. */
+static RC checkpoint_locked(SM_FileHandle *fh, SM_Wal *wal) {
+    if (wal->fd < 0 || wal->end == 0) return RC_OK;
+    RC rc = sm_flush_file(fh);
+    if (rc != RC_OK) return rc;
+    if (ftruncate(wal->fd, 0) != 0 || fdatasync(wal->fd) != 0) {
+        RC_message = "truncating write-ahead log failed";
+        return RC_WRITE_FAILED;
+    }
+    wal->end = 0;
+    wal->nextLsn = 1;
+    return RC_OK;
+}
+
+/* Apply the page images of a committed transaction, contiguous runs with
+   one writeBlocks call each. */
+static RC apply_entries(SM_FileHandle *fh, WAL_Entry *entries, int count) {
+    qsort(entries, (size_t)count, sizeof *entries, by_page);
+    SM_PageHandle run[WAL_IOV_BATCH];
+    for (int i = 0; i < count; ) {
+        int n = 0;
+        do {
+            run[n] = entries[i + n].image;
+            ++n;
+        } while (i + n < count && n < WAL_IOV_BATCH &&
+                 entries[i + n].pageNum == entries[i].pageNum + n);
+        RC rc = writeBlocks(entries[i].pageNum, n, fh, run, NULL);
+        if (rc != RC_OK) return rc;
+        i += n;
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Recovery
+   -------------------------------------------------------------------------- */
+
+/* Replay the committed transactions in an existing log. */
+static RC replay(SM_FileHandle *fh, SM_Wal *wal) {
+    WAL_Entry *pending = NULL;
+    int count = 0, cap = 0;
+    uint64_t txId = 0, lastLsn = 0;
+    off_t off = 0;
+    RC rc = RC_OK;
+
+    for (;;) {
+        WAL_Record r;
+        if (sm_pread_full(wal->fd, &r, sizeof r, off) != sizeof r) break;
+        if (r.magic != WAL_MAGIC || r.lsn != lastLsn + 1) break;
+
+        if (r.type == WAL_PAGE) {
+            if (count > 0 && r.txId != txId) break;
+            if (count == cap) {
+                int ncap = (cap > 0) ? cap * 2 : 16;
+                WAL_Entry *grown = (WAL_Entry *)realloc(pending, (size_t)ncap * sizeof *grown);
+                if (grown == NULL) {
+                    RC_message = "out of memory replaying write-ahead log";
+                    rc = RC_FILE_HANDLE_NOT_INIT;
+                    break;
+                }
+                pending = grown;
+                cap = ncap;
+            }
+            SM_PageHandle image = allocatePageHandleSized(wal->pageSize);
+            if (image == NULL) {
+                RC_message = "out of memory replaying write-ahead log";
+                rc = RC_FILE_HANDLE_NOT_INIT;
+                break;
+            }
+            if (sm_pread_full(wal->fd, image, (size_t)wal->pageSize,
+                              off + (off_t)sizeof r) != (size_t)wal->pageSize ||
+                record_crc(wal, &r, image) != r.crc || r.pageNum < 0) {
+                freePageHandle(image);
+                break;
+            }
+            txId = r.txId;
+            pending[count].pageNum = r.pageNum;
+            pending[count].image = image;
+            ++count;
+            off += (off_t)sizeof r + wal->pageSize;
+        } else if (r.type == WAL_COMMIT) {
+            if (record_crc(wal, &r, NULL) != r.crc || r.pageNum != count ||
+                (count > 0 && r.txId != txId))
+                break;
+            /* the log does not record growth: a lost ensureCapacity is redone */
+            int last = 0;
+            for (int i = 0; i < count; ++i)
+                if (pending[i].pageNum >= last) last = pending[i].pageNum + 1;
+            rc = ensureCapacity(last, fh);
+            if (rc == RC_OK)
+                rc = apply_entries(fh, pending, count);
+            for (int i = 0; i < count; ++i)
+                freePageHandle(pending[i].image);
+            count = 0;
+            off += (off_t)sizeof r;
+            if (rc != RC_OK) break;
+        } else {
+            break;
+        }
+        lastLsn = r.lsn;
+    }
+
+    for (int i = 0; i < count; ++i)
+        freePageHandle(pending[i].image);
+    free(pending);
+    if (rc != RC_OK) return rc;
+
+    /* make the replayed pages durable before the log that holds them goes;
+       a torn tail past `off` is dropped with it */
+    if (off > 0 && (rc = sm_flush_file(fh)) != RC_OK) return rc;
+    if (ftruncate(wal->fd, 0) != 0 || fdatasync(wal->fd) != 0) {
+        RC_message = "truncating write-ahead log failed";
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c (declared in storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+RC sm_wal_open(SM_FileHandle *fh) {
+    SM_Internal *meta = (SM_Internal *)fh->mgmtInfo;
+    SM_SharedFile *sf = meta->shared;
+    pthread_mutex_lock(&sf->openLock);
+    if (sf->wal != NULL) {
+        pthread_mutex_unlock(&sf->openLock);
+        return RC_OK;
+    }
+    SM_Wal *wal = (SM_Wal *)calloc(1, sizeof *wal);
+    char *name = sm_side_file_name(fh->fileName, SM_WAL_SUFFIX);
+    if (wal == NULL || name == NULL) {
+        pthread_mutex_unlock(&sf->openLock);
+        free(wal);
+        free(name);
+        RC_message = "out of memory for write-ahead log";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    pthread_mutex_init(&wal->lock, NULL);
+    wal->name = name;
+    wal->pageSize = meta->pageSize;
+    wal->nextLsn = 1;
+    wal->nextTx = 1;
+    sf->wal = wal;
+
+    /* no other handle has the file open yet, so an existing log was left
+       by a process that did not close it cleanly; later opens wait here
+       until it has been replayed */
+    RC rc = RC_OK;
+    wal->fd = open(name, O_RDWR);
+    if (wal->fd >= 0) rc = replay(fh, wal);
+    if (rc != RC_OK) {
+        /* keep the log for the next open to try again */
+        free_wal(wal);
+        sf->wal = NULL;
+    }
+    pthread_mutex_unlock(&sf->openLock);
+    return rc;
+}
+
+void sm_wal_close(SM_SharedFile *sf) {
+    SM_Wal *wal = sf->wal;
+    if (wal == NULL) return;
+    if (wal->fd >= 0 && wal->end == 0)
+        unlink(wal->name);      /* checkpointed: nothing to replay */
+    free_wal(wal);
+    sf->wal = NULL;
+}
+
+/* --------------------------------------------------------------------------
+   Public API
+   -------------------------------------------------------------------------- */
+
+/* Start a transaction on an open page file. */
+RC beginTx(SM_FileHandle *fHandle, SM_Tx **tx) {
+    if (tx == NULL) {
+        RC_message = "invalid arguments to beginTx";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    SM_Tx *t = (SM_Tx *)calloc(1, sizeof *t);
+    if (t == NULL) {
+        RC_message = "out of memory for transaction";
+        return RC_WRITE_FAILED;
+    }
+    t->fh = fHandle;
+    t->wal = meta->shared->wal;
+    t->id = __atomic_fetch_add(&t->wal->nextTx, 1, __ATOMIC_RELAXED);
+    *tx = t;
+    return RC_OK;
+}
+
+/* Buffer the new image of pageNum in the transaction. */
+RC logPageWrite(SM_Tx *tx, int pageNum, SM_PageHandle memPage) {
+    if (tx == NULL || memPage == NULL) {
+        RC_message = "invalid arguments to logPageWrite";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    if (pageNum < 0 || pageNum >= tx->fh->totalNumPages) {
+        RC_message = "page index outside valid range for write";
+        return RC_WRITE_FAILED;
+    }
+    for (int i = 0; i < tx->count; ++i) {
+        if (tx->entries[i].pageNum == pageNum) {
+            sm_page_copy(tx->entries[i].image, memPage, tx->wal->pageSize);
+            return RC_OK;
+        }
+    }
+    if (tx->count == tx->cap) {
+        int cap = (tx->cap > 0) ? tx->cap * 2 : 8;
+        WAL_Entry *grown = (WAL_Entry *)realloc(tx->entries, (size_t)cap * sizeof *grown);
+        if (grown == NULL) {
+            RC_message = "out of memory for transaction";
+            return RC_WRITE_FAILED;
+        }
+        tx->entries = grown;
+        tx->cap = cap;
+    }
+    SM_PageHandle image = allocatePageHandleSized(tx->wal->pageSize);
+    if (image == NULL) {
+        RC_message = "out of memory for transaction";
+        return RC_WRITE_FAILED;
+    }
+    sm_page_copy(image, memPage, tx->wal->pageSize);
+    tx->entries[tx->count].pageNum = pageNum;
+    tx->entries[tx->count].image = image;
+    tx->count++;
+    return RC_OK;
+}
+
+/* Append the transaction to the log, sync it, then write the pages in place. */
+RC commitTx(SM_Tx *tx) {
+    if (tx == NULL) {
+        RC_message = "invalid arguments to commitTx";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    SM_Wal *wal = tx->wal;
+    if (tx->count == 0) {
+        free_tx(tx);
+        return RC_OK;
+    }
+
+    int n = tx->count;
+    WAL_Record *recs = (WAL_Record *)calloc((size_t)n + 1, sizeof *recs);
+    struct iovec *iov = (struct iovec *)malloc((size_t)(2 * n + 1) * sizeof *iov);
+    if (recs == NULL || iov == NULL) {
+        free(recs);
+        free(iov);
+        free_tx(tx);
+        RC_message = "out of memory for transaction";
+        return RC_WRITE_FAILED;
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    RC rc = open_log(wal);
+    if (rc == RC_OK) {
+        for (int i = 0; i <= n; ++i) {
+            WAL_Record *r = &recs[i];
+            r->magic = WAL_MAGIC;
+            r->lsn = wal->nextLsn + (uint64_t)i;
+            r->txId = tx->id;
+            r->type = (i < n) ? WAL_PAGE : WAL_COMMIT;
+            r->pageNum = (i < n) ? tx->entries[i].pageNum : n;
+            r->crc = record_crc(wal, r, (i < n) ? tx->entries[i].image : NULL);
+            iov[2 * i].iov_base = r;
+            iov[2 * i].iov_len = sizeof *r;
+            if (i < n) {
+                iov[2 * i + 1].iov_base = tx->entries[i].image;
+                iov[2 * i + 1].iov_len = (size_t)wal->pageSize;
+            }
+        }
+        off_t bytes = (off_t)n * ((off_t)sizeof *recs + wal->pageSize) + (off_t)sizeof *recs;
+        rc = write_vec(wal->fd, iov, 2 * n + 1, wal->end);
+        if (rc == RC_OK && fdatasync(wal->fd) != 0) {
+            RC_message = "fdatasync of write-ahead log failed";
+            rc = RC_WRITE_FAILED;
+        }
+        if (rc == RC_OK) {
+            wal->end += bytes;
+            wal->nextLsn += (uint64_t)n + 1;
+        } else if (ftruncate(wal->fd, wal->end) != 0) {
+            /* a torn tail would hide every later commit from recovery */
+            RC_message = "write-ahead log left with a torn tail";
+        }
+    }
+
+    /* durable from here on: a failed in-place write is redone by recovery.
+       Another handle may checkpoint the log next, and it cannot write out
+       pages this handle still buffers. */
+    if (rc == RC_OK)
+        rc = apply_entries(tx->fh, tx->entries, n);
+    if (rc == RC_OK)
+        rc = sm_wb_drain((SM_Internal *)tx->fh->mgmtInfo);
+    if (rc == RC_OK && wal->end >= WAL_CHECKPOINT_BYTES)
+        rc = checkpoint_locked(tx->fh, wal);
+    pthread_mutex_unlock(&wal->lock);
+
+    free(recs);
+    free(iov);
+    free_tx(tx);
+    return rc;
+}
+
+RC abortTx(SM_Tx *tx) {
+    if (tx == NULL) {
+        RC_message = "invalid arguments to abortTx";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    free_tx(tx);
+    return RC_OK;
+}
+
+RC checkpointPageFile(SM_FileHandle *fHandle) {
+    SM_Internal *meta;
+    RC rc = sm_get_writable(fHandle, &meta);
+    if (rc != RC_OK) return rc;
+
+    SM_Wal *wal = meta->shared->wal;
+    pthread_mutex_lock(&wal->lock);
+    rc = checkpoint_locked(fHandle, wal);
+    pthread_mutex_unlock(&wal->lock);
+    return rc;
+}
@@ -0,0 +1,46 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "dberror.h"
+#include "storage_mgr.h"
+
+/************************************************************
+ *                    handle data structures                *
+ ************************************************************/
+/* a transaction in progress; opaque, created by beginTx */
+typedef struct SM_Tx SM_Tx;
+
+/************************************************************
+ *                    interface                             *
+ ************************************************************/
+/* Write-ahead logging for atomic multi-page updates.
+
+   Pages given to logPageWrite are buffered in the transaction. commitTx
+   appends them, followed by a commit record, to <fileName>.wal with one
+   vectored write and one fdatasync, then writes them in place without a
+   sync. The data file is synced only when the log is checkpointed: once it
+   passes a size limit, on checkpointPageFile and on closePageFile. The
+   first open of a file with a non-empty log first replays every committed
+   transaction in it, so a crash never leaves part of a transaction applied.
+
+   Every handle on a file in the process commits to the same log. A
+   transaction is used by one thread; transactions on a shared handle or on
+   different handles of one file may commit concurrently (commits are
+   serialized). Changes become visible to
+   readBlock at commit. Until the next checkpoint, write pages that were
+   updated in a transaction only through transactions: recovery would
+   replay the logged image over a plain writeBlock. Pages must exist when
+   logged; the log does not record file growth. */
+extern RC beginTx (SM_FileHandle *fHandle, SM_Tx **tx);
+/* record the new contents of pageNum (copied; a later call for the same
+   page replaces the image) */
+extern RC logPageWrite (SM_Tx *tx, int pageNum, SM_PageHandle memPage);
+/* make the transaction durable and apply it; tx is freed in every case */
+extern RC commitTx (SM_Tx *tx);
+/* discard the transaction without touching the file; tx is freed */
+extern RC abortTx (SM_Tx *tx);
+
+/* sync the data file and empty the log */
+extern RC checkpointPageFile (SM_FileHandle *fHandle);
+
+#endif
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE     /* pthread_condattr_setclock and clock_gettime under -std=c11 */
+
+#include "storage_mgr_internal.h"
+#include "dberror.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+/* --------------------------------------------------------------------------
+   Write-back
+
+   Writes land in the active dirty-page table. To write pages out, the
+   active table is swapped for the empty spare and the full one, now the
+   flushing table, is written in page order: each run of consecutive page
+   numbers becomes one vectored write. Readers look in the active table,
+   then the flushing one, and only then at the file; the flushing table
+   is emptied after its pages (and their checksums) are on disk, so a page
+   is never missing from both.
+
+   Locking: wb->lock guards the tables and is held only for lookups and
+   copies. wb->ioLock is held while a table is written out, so one flush
+   runs at a time and resizing the file can keep the flusher away.
+   -------------------------------------------------------------------------- */
+
+typedef struct WbTable {
+    int count;              /* slots in use */
+    int *slotPage;          /* page held by each slot */
+    int *hash;              /* page -> slot + 1, 0 = empty; linear probing */
+    char *pages;            /* one page per slot, PAGE_SIZE-aligned */
+    uint64_t since;         /* when the first slot was taken (ns) */
+} WbTable;
+
+struct SM_WriteBack {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* to the flusher: work to do, or stop */
+    pthread_cond_t changed;     /* to writers: a flush finished */
+    pthread_mutex_t ioLock;
+    WbTable tables[2];
+    WbTable *active;
+    WbTable *flushing;          /* NULL unless a flush is writing */
+    int cap;                    /* slots per table */
+    int hashCap;                /* power of two, at least 2 * cap */
+    int maxAgeMs;
+    int stop;
+    pthread_t thread;
+    RC error;                   /* first failed background write, until reported */
+    char *errorMessage;
+};
+
+typedef struct WbEntry {
+    int page;
+    int slot;
+} WbEntry;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void count_run(SM_Internal *meta, int pages) {
+#ifndef SM_NO_STATS
+    __atomic_fetch_add(&meta->shared->stats.writebackRuns, 1ull, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&meta->shared->stats.writebackPages, (unsigned long long)pages, __ATOMIC_RELAXED);
+#else
+    (void)meta; (void)pages;
+#endif
+}
+
+/* --------------------------------------------------------------------------
+   Dirty-page tables
+   -------------------------------------------------------------------------- */
+
+static void table_free(WbTable *t) {
+    free(t->slotPage);
+    free(t->hash);
+    free(t->pages);
+    memset(t, 0, sizeof *t);
+}
+
+static int table_alloc(WbTable *t, int cap, int hashCap, int pageSize) {
+    memset(t, 0, sizeof *t);
+    t->slotPage = (int *)malloc((size_t)cap * sizeof *t->slotPage);
+    t->hash = (int *)calloc((size_t)hashCap, sizeof *t->hash);
+    if (posix_memalign((void **)&t->pages, PAGE_SIZE, (size_t)cap * (size_t)pageSize) != 0)
+        t->pages = NULL;
+    if (t->slotPage == NULL || t->hash == NULL || t->pages == NULL) {
+        table_free(t);
+        return -1;
+    }
+    return 0;
+}
+
+/* Hash position where pageNum is, or where it would go. */
+static int table_probe(const SM_WriteBack *wb, const WbTable *t, int pageNum) {
+    int mask = wb->hashCap - 1;
+    int h = (int)(((uint32_t)pageNum * 2654435761u) & (uint32_t)mask);
+    while (t->hash[h] != 0 && t->slotPage[t->hash[h] - 1] != pageNum)
+        h = (h + 1) & mask;
+    return h;
+}
+
+static char *table_page(SM_Internal *meta, const WbTable *t, int slot) {
+    return t->pages + (size_t)slot * (size_t)meta->pageSize;
+}
+
+/* Buffered image of pageNum in t, or NULL. */
+static char *table_find(SM_Internal *meta, const WbTable *t, int pageNum) {
+    if (t == NULL || t->count == 0) return NULL;
+    int slot = t->hash[table_probe(meta->wb, t, pageNum)] - 1;
+    return (slot >= 0) ? table_page(meta, t, slot) : NULL;
+}
+
+static void table_clear(const SM_WriteBack *wb, WbTable *t) {
+    memset(t->hash, 0, (size_t)wb->hashCap * sizeof *t->hash);
+    t->count = 0;
+}
+
+static int by_page(const void *a, const void *b) {
+    int x = ((const WbEntry *)a)->page, y = ((const WbEntry *)b)->page;
+    return (x > y) - (x < y);
+}
+
+/* Write out every page of t, one vectored write per run of consecutive
+   page numbers. Caller holds ioLock, not lock. */
+static RC table_write(SM_Internal *meta, WbTable *t) {
+    WbEntry *order = (WbEntry *)malloc((size_t)t->count * sizeof *order);
+    SM_PageHandle *run = (SM_PageHandle *)malloc((size_t)t->count * sizeof *run);
+    if (order == NULL || run == NULL) {
+        free(order);
+        free(run);
+        RC_message = "out of memory for write-back";
+        return RC_WRITE_FAILED;
+    }
+    for (int i = 0; i < t->count; ++i) {
+        order[i].page = t->slotPage[i];
+        order[i].slot = i;
+    }
+    qsort(order, (size_t)t->count, sizeof *order, by_page);
+
+    RC rc = RC_OK;
+    for (int i = 0; i < t->count && rc == RC_OK; ) {
+        int n = 0;
+        do {
+            run[n] = table_page(meta, t, order[i + n].slot);
+            n++;
+        } while (i + n < t->count && order[i + n].page == order[i].page + n);
+        int done = 0;
+        rc = sm_write_pages(meta, order[i].page, run, n, &done);
+        if (rc == RC_OK && done < n) {
+            RC_message = "incomplete write-back";
+            rc = RC_WRITE_FAILED;
+        }
+        count_run(meta, done);
+        i += n;
+    }
+    free(order);
+    free(run);
+    return rc;
+}
+
+/* Swap out the active table and write it. A failure is kept for the next
+   caller to report; its pages are dropped either way. */
+static RC flush_once(SM_Internal *meta) {
+    SM_WriteBack *wb = meta->wb;
+    pthread_mutex_lock(&wb->ioLock);
+    pthread_mutex_lock(&wb->lock);
+    WbTable *t = NULL;
+    if (wb->active->count > 0) {
+        t = wb->active;
+        wb->active = (t == &wb->tables[0]) ? &wb->tables[1] : &wb->tables[0];
+        wb->flushing = t;
+    }
+    pthread_mutex_unlock(&wb->lock);
+
+    RC rc = (t != NULL) ? table_write(meta, t) : RC_OK;
+
+    pthread_mutex_lock(&wb->lock);
+    if (t != NULL) {
+        table_clear(wb, t);
+        wb->flushing = NULL;
+        pthread_cond_broadcast(&wb->changed);
+    }
+    if (rc != RC_OK && wb->error == RC_OK) {
+        wb->error = rc;
+        wb->errorMessage = RC_message;
+    }
+    pthread_mutex_unlock(&wb->lock);
+    pthread_mutex_unlock(&wb->ioLock);
+    return rc;
+}
+
+/* Report (once) a write-back failure. Caller holds lock. */
+static RC take_error(SM_WriteBack *wb) {
+    RC rc = wb->error;
+    if (rc != RC_OK) {
+        RC_message = wb->errorMessage;
+        wb->error = RC_OK;
+    }
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Flusher thread
+   -------------------------------------------------------------------------- */
+
+static void *flusher(void *arg) {
+    SM_Internal *meta = (SM_Internal *)arg;
+    SM_WriteBack *wb = meta->wb;
+    pthread_mutex_lock(&wb->lock);
+    while (!wb->stop) {
+        WbTable *t = wb->active;
+        uint64_t due = t->since + (uint64_t)wb->maxAgeMs * 1000000u;
+        if (t->count > 0 && (t->count >= (wb->cap + 1) / 2 || now_ns() >= due)) {
+            pthread_mutex_unlock(&wb->lock);
+            (void)flush_once(meta);
+            pthread_mutex_lock(&wb->lock);
+        } else if (t->count == 0) {
+            pthread_cond_wait(&wb->wake, &wb->lock);
+        } else {
+            struct timespec ts = {(time_t)(due / 1000000000u), (long)(due % 1000000000u)};
+            pthread_cond_timedwait(&wb->wake, &wb->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return NULL;
+}
+
+/* --------------------------------------------------------------------------
+   Shared with storage_mgr.c, scan.c and async_io.c (storage_mgr_internal.h)
+   -------------------------------------------------------------------------- */
+
+static int alloc_tables(SM_Internal *meta, int cap) {
+    SM_WriteBack *wb = meta->wb;
+    int hashCap = 1;
+    while (hashCap < 2 * cap) hashCap *= 2;
+    if (table_alloc(&wb->tables[0], cap, hashCap, meta->pageSize) != 0) return -1;
+    if (table_alloc(&wb->tables[1], cap, hashCap, meta->pageSize) != 0) {
+        table_free(&wb->tables[0]);
+        return -1;
+    }
+    wb->cap = cap;
+    wb->hashCap = hashCap;
+    wb->active = &wb->tables[0];
+    wb->flushing = NULL;
+    return 0;
+}
+
+RC sm_wb_open(SM_Internal *meta) {
+    SM_WriteBack *wb = (SM_WriteBack *)calloc(1, sizeof *wb);
+    if (wb == NULL) {
+        RC_message = "out of memory for write-back";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    meta->wb = wb;
+    if (alloc_tables(meta, SM_WRITEBACK_PAGES) != 0) {
+        free(wb);
+        meta->wb = NULL;
+        RC_message = "out of memory for write-back";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    wb->maxAgeMs = SM_WRITEBACK_AGE_MS;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wb->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&wb->changed, NULL);
+    pthread_mutex_init(&wb->lock, NULL);
+    pthread_mutex_init(&wb->ioLock, NULL);
+    if (pthread_create(&wb->thread, NULL, flusher, meta) != 0) {
+        pthread_cond_destroy(&wb->wake);
+        pthread_cond_destroy(&wb->changed);
+        pthread_mutex_destroy(&wb->lock);
+        pthread_mutex_destroy(&wb->ioLock);
+        table_free(&wb->tables[0]);
+        table_free(&wb->tables[1]);
+        free(wb);
+        meta->wb = NULL;
+        RC_message = "unable to start the write-back thread";
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+    return RC_OK;
+}
+
+RC sm_wb_close(SM_Internal *meta) {
+    SM_WriteBack *wb = meta->wb;
+    if (wb == NULL) return RC_OK;
+    pthread_mutex_lock(&wb->lock);
+    wb->stop = 1;
+    pthread_cond_signal(&wb->wake);
+    pthread_mutex_unlock(&wb->lock);
+    pthread_join(wb->thread, NULL);
+
+    (void)flush_once(meta);
+    RC rc = take_error(wb);
+    pthread_cond_destroy(&wb->wake);
+    pthread_cond_destroy(&wb->changed);
+    pthread_mutex_destroy(&wb->lock);
+    pthread_mutex_destroy(&wb->ioLock);
+    table_free(&wb->tables[0]);
+    table_free(&wb->tables[1]);
+    free(wb);
+    meta->wb = NULL;
+    return rc;
+}
+
+RC sm_wb_write(SM_Internal *meta, int first, SM_PageHandle *pages, int count) {
+    SM_WriteBack *wb = meta->wb;
+    pthread_mutex_lock(&wb->lock);
+    RC rc = take_error(wb);
+    int i = 0;
+    while (i < count && rc == RC_OK) {
+        WbTable *t = wb->active;
+        int h = table_probe(wb, t, first + i);
+        if (t->hash[h] == 0) {
+            if (t->count == wb->cap) {
+                /* full: let the flusher swap it out, then look again */
+                pthread_cond_signal(&wb->wake);
+                pthread_cond_wait(&wb->changed, &wb->lock);
+                continue;
+            }
+            if (t->count == 0) t->since = now_ns();
+            t->slotPage[t->count] = first + i;
+            t->hash[h] = ++t->count;
+            if (t->count == 1 || t->count == (wb->cap + 1) / 2)
+                pthread_cond_signal(&wb->wake);
+        }
+        sm_page_copy(table_page(meta, t, t->hash[h] - 1), pages[i], meta->pageSize);
+        ++i;
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return rc;
+}
+
+int sm_wb_read(SM_Internal *meta, int pageNum, char *buf) {
+    SM_WriteBack *wb = meta->wb;
+    if (wb == NULL) return 0;
+    pthread_mutex_lock(&wb->lock);
+    char *img = table_find(meta, wb->active, pageNum);
+    if (img == NULL) img = table_find(meta, wb->flushing, pageNum);
+    if (img != NULL && buf != NULL) sm_page_copy(buf, img, meta->pageSize);
+    pthread_mutex_unlock(&wb->lock);
+    return img != NULL;
+}
+
+RC sm_wb_drain(SM_Internal *meta) {
+    SM_WriteBack *wb = meta->wb;
+    if (wb == NULL) return RC_OK;
+    (void)flush_once(meta);
+    pthread_mutex_lock(&wb->lock);
+    RC rc = take_error(wb);
+    pthread_mutex_unlock(&wb->lock);
+    return rc;
+}
+
+void sm_wb_pause(SM_Internal *meta) {
+    if (meta->wb != NULL) pthread_mutex_lock(&meta->wb->ioLock);
+}
+
+void sm_wb_resume(SM_Internal *meta) {
+    if (meta->wb != NULL) pthread_mutex_unlock(&meta->wb->ioLock);
+}
+
+RC sm_wb_set_limits(SM_Internal *meta, int maxDirtyPages, int maxAgeMs) {
+    SM_WriteBack *wb = meta->wb;
+    RC rc = sm_wb_drain(meta);
+    if (rc != RC_OK) return rc;
+
+    pthread_mutex_lock(&wb->ioLock);
+    pthread_mutex_lock(&wb->lock);
+    if (maxDirtyPages != wb->cap) {
+        WbTable old[2] = {wb->tables[0], wb->tables[1]};
+        int oldCap = wb->cap;
+        if (alloc_tables(meta, maxDirtyPages) == 0) {
+            table_free(&old[0]);
+            table_free(&old[1]);
+        } else {
+            wb->tables[0] = old[0];
+            wb->tables[1] = old[1];
+            wb->active = &wb->tables[0];
+            wb->cap = oldCap;
+            RC_message = "out of memory for write-back";
+            rc = RC_WRITE_FAILED;
+        }
+    }
+    if (rc == RC_OK) {
+        wb->maxAgeMs = maxAgeMs;
+        pthread_cond_signal(&wb->wake);     /* re-arm its timer */
+    }
+    pthread_mutex_unlock(&wb->lock);
+    pthread_mutex_unlock(&wb->ioLock);
+    return rc;
+}